@@ -0,0 +1,233 @@
+// dynamicbatch.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+// Compares drawing many small moving nodes one by one with drawing them
+// through a DynamicBatch. GL is stubbed, so the times are the CPU cost of
+// the draw calls and of the transforms, not of the GPU. Also rebuilds a
+// StaticBatch every frame and checks that its temporaries stop taking
+// blocks from the heap once the FrameArena is warmed up
+
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <iomanip>
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "dim/scene/dynamicbatch.hpp"
+#include "dim/scene/staticbatch.hpp"
+#include "dim/core/jobsystem.hpp"
+#include "glstub.hpp"
+
+using namespace dim;
+using namespace glm;
+using namespace std;
+
+namespace
+{
+  class BenchNode : public NodeBase
+  {
+      Scene const *d_scene;
+      Shader const *d_shader;
+
+    public:
+      BenchNode(Scene const &scene, Shader const &shader, vec3 const &location, quat const &orientation)
+      :
+        NodeBase(location, orientation, vec3(1.0)),
+        d_scene(&scene),
+        d_shader(&shader)
+      {
+      }
+
+      NodeBase *clone() const override
+      {
+        return new BenchNode(*this);
+      }
+
+      Shader const &shader(size_t idx) const override
+      {
+        return *d_shader;
+      }
+
+      Scene const &scene() const override
+      {
+        return *d_scene;
+      }
+
+      btRigidBody *rigidBody() override
+      {
+        return 0;
+      }
+  };
+
+  // a box with a normal per face, 24 vertices and 12 triangles
+  Mesh box()
+  {
+    vector<GLfloat> vertices;
+    vector<GLushort> indices;
+
+    for(size_t axis = 0; axis != 3; ++axis)
+    {
+      for(float side : {-1.0f, 1.0f})
+      {
+        vec3 normal(0.0);
+        normal[axis] = side;
+        vec3 u(0.0);
+        u[(axis + 1) % 3] = 1.0;
+        vec3 v = cross(normal, u);
+
+        GLushort first = vertices.size() / 6;
+        for(vec2 corner : {vec2(-1, -1), vec2(1, -1), vec2(1, 1), vec2(-1, 1)})
+        {
+          vec3 position = 0.5f * (normal + corner.x * u + corner.y * v);
+          vertices.insert(vertices.end(), {position.x, position.y, position.z, normal.x, normal.y, normal.z});
+        }
+
+        indices.insert(indices.end(), {first, GLushort(first + 1), GLushort(first + 2),
+                                       first, GLushort(first + 2), GLushort(first + 3)});
+      }
+    }
+
+    Mesh mesh(vertices.data(), 24, {{Shader::vertex, Shader::vec3}, {Shader::normal, Shader::vec3}});
+    mesh.addElementBuffer(indices.data(), 12);
+    return mesh;
+  }
+
+  struct Result
+  {
+    double milliseconds; ///< Per frame
+    size_t calls;        ///< GL calls per frame
+    size_t draws;
+  };
+
+  template <typename Function>
+  Result measure(size_t numOfFrames, Function const &frame)
+  {
+    frame(); // warm up, the first frame allocates
+    glstub::reset();
+
+    auto start = chrono::steady_clock::now();
+    for(size_t idx = 0; idx != numOfFrames; ++idx)
+      frame();
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+    return Result{elapsed.count() / numOfFrames, glstub::numOfCalls() / numOfFrames, glstub::numOfDrawCalls() / numOfFrames};
+  }
+
+  void print(string const &name, Result const &result)
+  {
+    cout << setw(28) << left << name << setw(12) << right << fixed << setprecision(3) << result.milliseconds
+         << setw(12) << result.calls << setw(10) << result.draws << '\n';
+  }
+}
+
+int main(int argc, char **argv)
+{
+  size_t const numOfNodes = argc > 1 ? stoul(argv[1]) : 10000;
+  size_t const numOfFrames = 50;
+
+  glstub::install();
+
+  Shader shader(Shader::fromString, "bench", "void main(){}", "void main(){}");
+  shader.bind("in_position", Shader::vertex);
+  shader.bind("in_normal", Shader::normal);
+  shader.use();
+
+  Scene scene(box());
+
+  mt19937 random(1);
+  uniform_real_distribution<float> coordinate(-100, 100);
+
+  vector<BenchNode> nodes;
+  nodes.reserve(numOfNodes);
+  for(size_t idx = 0; idx != numOfNodes; ++idx)
+  {
+    quat orientation = angleAxis(coordinate(random), normalize(vec3(coordinate(random), coordinate(random), 1.0)));
+    nodes.push_back(BenchNode(scene, shader, vec3(coordinate(random), coordinate(random), coordinate(random)), orientation));
+  }
+
+  ShaderScene state(nodes[0], 0, 1);
+
+  // what SceneGraph::drawNode does for every node that isn't batched
+  auto unbatched = [&]()
+  {
+    for(BenchNode &node : nodes)
+    {
+      mat4 const &model = node.matrix();
+      shader.set("in_mat_model", model);
+      shader.set("in_mat_normal", mat3(inverseTranspose(mat3(model))));
+      scene[0].mesh().draw();
+    }
+  };
+
+  internal::DynamicBatch batch(internal::BatchGeometry::maxVertices);
+  auto batched = [&]()
+  {
+    batch.clear();
+    for(BenchNode &node : nodes)
+      batch.add(state, scene[0], node.matrix());
+
+    batch.transform();
+    batch.draw(0, 0);
+  };
+
+  cout << numOfNodes << " boxes, " << JobSystem::instance().numOfThreads() << " worker threads\n";
+  cout << setw(28) << left << "" << setw(12) << right << "ms/frame" << setw(12) << "GL calls" << setw(10) << "draws" << '\n';
+
+  print("unbatched", measure(numOfFrames, unbatched));
+  print("dynamic batch", measure(numOfFrames, batched));
+
+  JobSystem::instance().setNumOfThreads(0);
+  print("dynamic batch, one thread", measure(numOfFrames, batched));
+
+  // what NodeGrid::rebuildStatic does for a dirty cell, ended like extractSnapshot ends a frame
+  internal::StaticBatch staticBatch;
+  vector<shared_ptr<internal::StaticMesh>> retired;
+  auto rebuilt = [&]()
+  {
+    {
+      FrameArena::Scope scope;
+
+      FrameVector<NodeBase*> cell;
+      cell.reserve(nodes.size());
+      for(BenchNode &node : nodes)
+        cell.push_back(&node);
+
+      staticBatch.rebuild(cell, 1, retired);
+      retired.clear();
+    }
+
+    FrameArena::local().reset();
+  };
+
+  for(BenchNode &node : nodes)
+    node.setStatic(true);
+
+  rebuilt(); // the first frame sizes the arena
+  size_t const heapAllocations = FrameArena::local().stats().heapAllocations;
+
+  print("static rebuild", measure(numOfFrames, rebuilt));
+
+  if(FrameArena::local().stats().heapAllocations != heapAllocations)
+  {
+    cout << "the static rebuild took new blocks from the heap after the first frame\n";
+    return 1;
+  }
+}
@@ -0,0 +1,209 @@
+// glstub.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#include "glstub.hpp"
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <unordered_map>
+
+#include <GL/glew.h>
+
+using namespace std;
+
+namespace dim
+{
+namespace glstub
+{
+  namespace
+  {
+    size_t s_calls = 0;
+    size_t s_draws = 0;
+    size_t s_binds = 0;
+    size_t s_attributes = 0;
+
+    GLuint s_nextName = 1;
+    unordered_map<GLenum, GLuint> s_bound;               ///< By target
+    unordered_map<GLuint, vector<GLubyte>> s_memory;     ///< The contents of the buffers
+    unordered_map<string, GLint> s_locations;            ///< Of attributes and uniforms, by name
+
+    void generate(GLsizei count, GLuint *names)
+    {
+      ++s_calls;
+      for(GLsizei idx = 0; idx != count; ++idx)
+        names[idx] = s_nextName++;
+    }
+
+    vector<GLubyte> &bound(GLenum target)
+    {
+      return s_memory[s_bound[target]];
+    }
+
+    void store(GLenum target, GLsizeiptr size, void const *data)
+    {
+      ++s_calls;
+      vector<GLubyte> &memory = bound(target);
+      memory.assign(size, 0);
+      if(data != 0)
+        memcpy(memory.data(), data, size);
+    }
+
+    GLint location(GLchar const *name)
+    {
+      ++s_calls;
+      auto iter = s_locations.find(name);
+      if(iter == s_locations.end())
+        iter = s_locations.insert(make_pair(string(name), static_cast<GLint>(s_locations.size()))).first;
+
+      return iter->second;
+    }
+  }
+
+  void install()
+  {
+    __GLEW_VERSION_3_0 = GL_TRUE;
+    __GLEW_ARB_vertex_array_object = GL_TRUE;
+    __GLEW_ARB_buffer_storage = GL_TRUE;
+    __GLEW_ARB_draw_instanced = GL_TRUE;
+    __GLEW_ARB_instanced_arrays = GL_TRUE;
+
+    // buffers
+    __glewGenBuffers = [](GLsizei count, GLuint *names) { generate(count, names); };
+    __glewDeleteBuffers = [](GLsizei, GLuint const *) { ++s_calls; };
+    __glewBindBuffer = [](GLenum target, GLuint buffer) { ++s_calls; ++s_binds; s_bound[target] = buffer; };
+    __glewBindBufferRange = [](GLenum target, GLuint, GLuint buffer, GLintptr, GLsizeiptr)
+                            { ++s_calls; ++s_binds; s_bound[target] = buffer; };
+    __glewBufferData = [](GLenum target, GLsizeiptr size, void const *data, GLenum) { store(target, size, data); };
+    __glewBufferStorage = [](GLenum target, GLsizeiptr size, void const *data, GLbitfield) { store(target, size, data); };
+    __glewBufferSubData = [](GLenum target, GLintptr offset, GLsizeiptr size, void const *data)
+                          { ++s_calls; memcpy(bound(target).data() + offset, data, size); };
+    __glewGetBufferSubData = [](GLenum target, GLintptr offset, GLsizeiptr size, void *data)
+                             { ++s_calls; memcpy(data, bound(target).data() + offset, size); };
+    __glewMapBuffer = [](GLenum target, GLenum) -> void* { ++s_calls; return bound(target).data(); };
+    __glewMapBufferRange = [](GLenum target, GLintptr offset, GLsizeiptr, GLbitfield) -> void*
+                           { ++s_calls; return bound(target).data() + offset; };
+    __glewUnmapBuffer = [](GLenum) -> GLboolean { ++s_calls; return GL_TRUE; };
+
+    // vertex arrays and attributes
+    __glewGenVertexArrays = [](GLsizei count, GLuint *names) { generate(count, names); };
+    __glewDeleteVertexArrays = [](GLsizei, GLuint const *) { ++s_calls; };
+    __glewBindVertexArray = [](GLuint) { ++s_calls; ++s_binds; };
+    __glewEnableVertexAttribArray = [](GLuint) { ++s_calls; ++s_attributes; };
+    __glewDisableVertexAttribArray = [](GLuint) { ++s_calls; ++s_attributes; };
+    __glewVertexAttribPointer = [](GLuint, GLint, GLenum, GLboolean, GLsizei, void const *) { ++s_calls; ++s_attributes; };
+    __glewVertexAttribDivisor = [](GLuint, GLuint) { ++s_calls; ++s_attributes; };
+
+    // synchronisation, the GPU is always done
+    __glewFenceSync = [](GLenum, GLbitfield) -> GLsync { ++s_calls; return reinterpret_cast<GLsync>(1); };
+    __glewClientWaitSync = [](GLsync, GLbitfield, GLuint64) -> GLenum { ++s_calls; return GL_ALREADY_SIGNALED; };
+    __glewDeleteSync = [](GLsync) { ++s_calls; };
+
+    // programs always compile and link
+    __glewCreateProgram = []() -> GLuint { ++s_calls; return s_nextName++; };
+    __glewCreateShader = [](GLenum) -> GLuint { ++s_calls; return s_nextName++; };
+    __glewShaderSource = [](GLuint, GLsizei, GLchar const *const *, GLint const *) { ++s_calls; };
+    __glewCompileShader = [](GLuint) { ++s_calls; };
+    __glewAttachShader = [](GLuint, GLuint) { ++s_calls; };
+    __glewDetachShader = [](GLuint, GLuint) { ++s_calls; };
+    __glewDeleteShader = [](GLuint) { ++s_calls; };
+    __glewDeleteProgram = [](GLuint) { ++s_calls; };
+    __glewLinkProgram = [](GLuint) { ++s_calls; };
+    __glewValidateProgram = [](GLuint) { ++s_calls; };
+    __glewGetProgramiv = [](GLuint, GLenum, GLint *value) { ++s_calls; *value = GL_TRUE; };
+    __glewGetProgramInfoLog = [](GLuint, GLsizei, GLsizei *length, GLchar *) { ++s_calls; *length = 0; };
+    __glewGetShaderInfoLog = [](GLuint, GLsizei, GLsizei *length, GLchar *) { ++s_calls; *length = 0; };
+    __glewGetUniformBlockIndex = [](GLuint, GLchar const *) -> GLuint { ++s_calls; return GL_INVALID_INDEX; };
+    __glewUniformBlockBinding = [](GLuint, GLuint, GLuint) { ++s_calls; };
+    __glewUseProgram = [](GLuint) { ++s_calls; ++s_binds; };
+    __glewGetUniformLocation = [](GLuint, GLchar const *name) -> GLint { return location(name); };
+    __glewGetAttribLocation = [](GLuint, GLchar const *name) -> GLint { return location(name); };
+
+    // uniforms
+    __glewUniform1i = [](GLint, GLint) { ++s_calls; };
+    __glewUniform1f = [](GLint, GLfloat) { ++s_calls; };
+    __glewUniform3fv = [](GLint, GLsizei, GLfloat const *) { ++s_calls; };
+    __glewUniform4fv = [](GLint, GLsizei, GLfloat const *) { ++s_calls; };
+    __glewUniformMatrix3fv = [](GLint, GLsizei, GLboolean, GLfloat const *) { ++s_calls; };
+    __glewUniformMatrix4fv = [](GLint, GLsizei, GLboolean, GLfloat const *) { ++s_calls; };
+
+    // draws
+    __glewDrawElementsInstanced = [](GLenum, GLsizei, GLenum, void const *, GLsizei) { ++s_calls; ++s_draws; };
+    __glewDrawArraysInstanced = [](GLenum, GLint, GLsizei, GLsizei) { ++s_calls; ++s_draws; };
+  }
+
+  void reset()
+  {
+    s_calls = 0;
+    s_draws = 0;
+    s_binds = 0;
+    s_attributes = 0;
+  }
+
+  size_t numOfCalls()
+  {
+    return s_calls;
+  }
+
+  size_t numOfDrawCalls()
+  {
+    return s_draws;
+  }
+
+  size_t numOfBinds()
+  {
+    return s_binds;
+  }
+
+  size_t numOfAttributeCalls()
+  {
+    return s_attributes;
+  }
+}
+}
+
+// the OpenGL 1.1 functions aren't loaded by GLEW, these take the place of the ones in libGL
+
+extern "C"
+{
+  void GLAPIENTRY glDrawElements(GLenum, GLsizei, GLenum, void const *)
+  {
+    ++dim::glstub::s_calls;
+    ++dim::glstub::s_draws;
+  }
+
+  void GLAPIENTRY glDrawArrays(GLenum, GLint, GLsizei)
+  {
+    ++dim::glstub::s_calls;
+    ++dim::glstub::s_draws;
+  }
+
+  void GLAPIENTRY glGetIntegerv(GLenum, GLint *value)
+  {
+    // large enough for every limit and alignment that is asked for
+    ++dim::glstub::s_calls;
+    *value = 256;
+  }
+
+  GLenum GLAPIENTRY glGetError()
+  {
+    ++dim::glstub::s_calls;
+    return GL_NO_ERROR;
+  }
+}
@@ -0,0 +1,46 @@
+// glstub.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef GLSTUB_HPP
+#define GLSTUB_HPP
+
+#include <cstddef>
+
+namespace dim
+{
+namespace glstub
+{
+  /**
+   * Points the GLEW entry points at functions that only count how often
+   * they are called, so the benchmarks run without a context. Buffers are
+   * kept in main memory, so mapping them works. Call before anything
+   * touches GL
+   */
+  void install();
+
+  void reset(); ///< Sets the counters to zero
+
+  size_t numOfCalls(); ///< Every GL call
+  size_t numOfDrawCalls();
+  size_t numOfBinds(); ///< Buffer, vertex array and program binds
+  size_t numOfAttributeCalls(); ///< Enabling, disabling and pointing vertex attributes
+}
+}
+
+#endif
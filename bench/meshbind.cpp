@@ -0,0 +1,133 @@
+// meshbind.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+// Counts the GL calls of drawing meshes the way SceneGraph does, bound once
+// per state, and checks that copies sharing a vertex buffer still bind
+// their own vertex arrays. GL is stubbed, so the times are CPU only
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+#include "dim/core/mesh.hpp"
+#include "glstub.hpp"
+
+using namespace dim;
+using namespace std;
+
+namespace
+{
+  struct Result
+  {
+    double milliseconds; ///< Per frame
+    size_t calls;        ///< GL calls per frame
+    size_t binds;
+    size_t draws;
+  };
+
+  template <typename Function>
+  Result measure(size_t numOfFrames, Function const &frame)
+  {
+    frame(); // warm up, the first frame makes the vertex arrays
+    glstub::reset();
+
+    auto start = chrono::steady_clock::now();
+    for(size_t idx = 0; idx != numOfFrames; ++idx)
+      frame();
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+    return Result{elapsed.count() / numOfFrames, glstub::numOfCalls() / numOfFrames,
+                  glstub::numOfBinds() / numOfFrames, glstub::numOfDrawCalls() / numOfFrames};
+  }
+
+  void print(string const &name, Result const &result)
+  {
+    cout << setw(28) << left << name << setw(12) << right << fixed << setprecision(3) << result.milliseconds
+         << setw(12) << result.calls << setw(10) << result.binds << setw(10) << result.draws << '\n';
+  }
+}
+
+int main(int argc, char **argv)
+{
+  size_t const numOfDraws = argc > 1 ? stoul(argv[1]) : 10000;
+  size_t const numOfFrames = 50;
+
+  glstub::install();
+
+  Shader shader(Shader::fromString, "bench", "void main(){}", "void main(){}");
+  shader.bind("in_position", Shader::vertex);
+  shader.use();
+
+  GLfloat const vertices[] = {0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 0};
+  GLushort const front[] = {0, 1, 2, 2, 1, 3};
+  GLushort const back[] = {0, 2, 1, 2, 3, 1};
+
+  // both copies use the vertex buffer of base, each with an element buffer of its own
+  Mesh base(vertices, 4, {{Shader::vertex, Shader::vec3}});
+  Mesh first(base);
+  first.addElementBuffer(front, 2);
+  Mesh second(base);
+  second.addElementBuffer(back, 2);
+
+  // the nodes of one state, as SceneGraph draws them
+  auto bucket = [&]()
+  {
+    first.bind();
+    for(size_t idx = 0; idx != numOfDraws; ++idx)
+      first.draw();
+    first.unbind();
+  };
+
+  // every draw binds and unbinds
+  auto unbound = [&]()
+  {
+    for(size_t idx = 0; idx != numOfDraws; ++idx)
+      first.draw();
+  };
+
+  // states whose meshes share the vertex buffer
+  auto copies = [&]()
+  {
+    for(size_t idx = 0; idx != numOfDraws; ++idx)
+    {
+      Mesh const &mesh = idx % 2 == 0 ? first : second;
+      mesh.bind();
+      mesh.draw();
+    }
+    second.unbind();
+  };
+
+  cout << numOfDraws << " draws\n";
+  cout << setw(28) << left << "" << setw(12) << right << "ms/frame" << setw(12) << "GL calls" << setw(10) << "binds"
+       << setw(10) << "draws" << '\n';
+
+  print("bound once", measure(numOfFrames, bucket));
+  print("bound per draw", measure(numOfFrames, unbound));
+
+  Result shared = measure(numOfFrames, copies);
+  print("copies sharing a buffer", shared);
+
+  // every switch between the copies has to bind the array with the right element buffer
+  if(shared.binds < shared.draws)
+  {
+    cout << "copies sharing a vertex buffer drew with the vertex array of the other copy\n";
+    return 1;
+  }
+}
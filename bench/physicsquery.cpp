@@ -0,0 +1,143 @@
+// physicsquery.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+// Compares a batch of ray queries through PhysicsQuery with the same rays
+// cast one by one through btCollisionWorld::rayTest
+
+#include <chrono>
+#include <random>
+#include <memory>
+#include <iostream>
+#include <iomanip>
+
+#include "dim/scene/physicsquery.hpp"
+#include "dim/core/jobsystem.hpp"
+
+using namespace dim;
+using namespace glm;
+using namespace std;
+
+namespace
+{
+  struct Result
+  {
+    double milliseconds; ///< Per batch
+    size_t hits;
+  };
+
+  template <typename Function>
+  Result measure(size_t numOfBatches, Function const &batch)
+  {
+    batch(); // warm up, the first batch allocates
+
+    size_t hits = 0;
+    auto start = chrono::steady_clock::now();
+    for(size_t idx = 0; idx != numOfBatches; ++idx)
+      hits = batch();
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+    return Result{elapsed.count() / numOfBatches, hits};
+  }
+
+  void print(string const &name, Result const &result)
+  {
+    cout << setw(28) << left << name << setw(12) << right << fixed << setprecision(3) << result.milliseconds
+         << setw(10) << result.hits << '\n';
+  }
+}
+
+int main(int argc, char **argv)
+{
+  size_t const numOfBodies = argc > 1 ? stoul(argv[1]) : 10000;
+  size_t const numOfRays = argc > 2 ? stoul(argv[2]) : 4096;
+  size_t const numOfBatches = 20;
+
+  btDbvtBroadphase broadphase;
+  btDefaultCollisionConfiguration configuration;
+  btCollisionDispatcher dispatcher(&configuration);
+  btSequentialImpulseConstraintSolver solver;
+  btDiscreteDynamicsWorld world(&dispatcher, &broadphase, &solver, &configuration);
+
+  mt19937 random(1);
+  uniform_real_distribution<float> coordinate(-100, 100);
+
+  btSphereShape sphere(1.0);
+  vector<unique_ptr<btDefaultMotionState>> motionStates;
+  vector<unique_ptr<btRigidBody>> bodies;
+  for(size_t idx = 0; idx != numOfBodies; ++idx)
+  {
+    btVector3 origin(coordinate(random), coordinate(random), coordinate(random));
+    motionStates.emplace_back(new btDefaultMotionState(btTransform(btQuaternion::getIdentity(), origin)));
+    bodies.emplace_back(new btRigidBody(0, motionStates.back().get(), &sphere));
+    world.addRigidBody(bodies.back().get());
+  }
+
+  world.updateAabbs();
+
+  vector<Ray> rays;
+  for(size_t idx = 0; idx != numOfRays; ++idx)
+    rays.push_back(Ray{vec3(coordinate(random), coordinate(random), coordinate(random)),
+                       vec3(coordinate(random), coordinate(random), coordinate(random))});
+
+  auto sequential = [&]()
+  {
+    size_t hits = 0;
+    for(Ray const &ray : rays)
+    {
+      btVector3 from(ray.from.x, ray.from.y, ray.from.z);
+      btVector3 to(ray.to.x, ray.to.y, ray.to.z);
+
+      btCollisionWorld::ClosestRayResultCallback callback(from, to);
+      world.rayTest(from, to, callback);
+      hits += callback.hasHit();
+    }
+    return hits;
+  };
+
+  internal::PhysicsQuery query;
+  vector<QueryHit> results;
+  auto batched = [&]()
+  {
+    // what SceneGraph::rayTest does, the capture is the only part under the lock
+    query.capture(broadphase);
+    query.rayTest(rays, results);
+
+    size_t hits = 0;
+    for(QueryHit const &hit : results)
+      hits += hit.hit();
+    return hits;
+  };
+
+  auto capture = [&]()
+  {
+    query.capture(broadphase);
+    return size_t(0);
+  };
+
+  cout << numOfBodies << " spheres, " << numOfRays << " rays, " << JobSystem::instance().numOfThreads() << " worker threads\n";
+  cout << setw(28) << left << "" << setw(12) << right << "ms/batch" << setw(10) << "hits" << '\n';
+
+  print("sequential rayTest", measure(numOfBatches, sequential));
+  print("PhysicsQuery", measure(numOfBatches, batched));
+  print("capture only", measure(numOfBatches, capture));
+
+  JobSystem::instance().setNumOfThreads(0);
+  print("PhysicsQuery, one thread", measure(numOfBatches, batched));
+}
@@ -0,0 +1,132 @@
+// pool.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+// Allocates and frees a million node sized objects with new and delete and
+// through a Pool, in order, in random order and from several threads, and
+// checks that a pool that was filled once doesn't grow when it is filled again
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <thread>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#include "dim/util/pool.hpp"
+
+using namespace dim;
+using namespace std;
+
+namespace
+{
+  // about the size of a node: a transform, a few pointers and flags
+  struct Object
+  {
+    float matrix[16];
+    void *pointers[4];
+    size_t flags;
+  };
+
+  template <typename Allocate, typename Free>
+  double measure(vector<size_t> const &order, Allocate const &allocate, Free const &free)
+  {
+    vector<Object*> objects(order.size());
+
+    auto start = chrono::steady_clock::now();
+    for(size_t idx = 0; idx != objects.size(); ++idx)
+      objects[idx] = allocate();
+    for(size_t idx : order)
+      free(objects[idx]);
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+    return elapsed.count();
+  }
+
+  void print(string const &name, double milliseconds)
+  {
+    cout << setw(28) << left << name << setw(12) << right << fixed << setprecision(3) << milliseconds << '\n';
+  }
+}
+
+int main(int argc, char **argv)
+{
+  size_t const numOfObjects = argc > 1 ? stoul(argv[1]) : 1000000;
+  size_t const numOfThreads = max(thread::hardware_concurrency(), 2u);
+
+  vector<size_t> inOrder(numOfObjects);
+  for(size_t idx = 0; idx != numOfObjects; ++idx)
+    inOrder[idx] = idx;
+
+  vector<size_t> shuffled(inOrder);
+  shuffle(shuffled.begin(), shuffled.end(), mt19937(1));
+
+  auto heapAllocate = []() { return new Object(); };
+  auto heapFree = [](Object *object) { delete object; };
+
+  Pool<Object> &pool = Pool<Object>::instance();
+  auto poolAllocate = [&]() { return pool.create(); };
+  auto poolFree = [&](Object *object) { pool.destroy(object); };
+
+  cout << numOfObjects << " objects of " << sizeof(Object) << " bytes\n";
+  cout << setw(28) << left << "" << setw(12) << right << "ms" << '\n';
+
+  // the first round fills the slabs, the second reuses them
+  measure(inOrder, poolAllocate, poolFree);
+  size_t const capacity = pool.capacity();
+
+  print("new/delete", measure(inOrder, heapAllocate, heapFree));
+  print("pool", measure(inOrder, poolAllocate, poolFree));
+  print("new/delete shuffled free", measure(shuffled, heapAllocate, heapFree));
+  print("pool shuffled free", measure(shuffled, poolAllocate, poolFree));
+
+  if(pool.capacity() != capacity)
+  {
+    cout << "the pool grew from " << capacity << " to " << pool.capacity() << " objects while reusing its slots\n";
+    return 1;
+  }
+
+  // every thread allocates and frees its share, through its own cache
+  auto threaded = [&](bool pooled)
+  {
+    vector<size_t> share(inOrder.begin(), inOrder.begin() + numOfObjects / numOfThreads);
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for(size_t idx = 0; idx != numOfThreads; ++idx)
+    {
+      threads.emplace_back([&]()
+      {
+        if(pooled)
+          measure(share, poolAllocate, poolFree);
+        else
+          measure(share, heapAllocate, heapFree);
+      });
+    }
+    for(thread &worker : threads)
+      worker.join();
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+    return elapsed.count();
+  };
+
+  print("new/delete threaded", threaded(false));
+  print("pool threaded", threaded(true));
+
+}
@@ -0,0 +1,74 @@
+// bonepalette.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#ifndef BONEPALETTE_HPP
+#define BONEPALETTE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "dim/core/dim.hpp"
+#include "dim/core/buffer.hpp"
+
+namespace dim
+{
+
+/**
+ * The bone matrices of all skinned instances drawn in a frame, uploaded
+ * at once into a texture buffer. A shader reads the palette of an instance
+ * from the samplerBuffer as 4 texels per matrix, starting at the offset of
+ * the instance. Set the offset with setOffset for a single draw, or store it
+ * in the instance buffer of an instanced draw
+ */
+class BonePalette
+{
+  std::vector<glm::mat4> d_matrices;
+  Buffer<GLfloat> d_buffer;
+  std::shared_ptr<GLuint> d_texture;
+  size_t d_uploaded;
+
+public:
+  BonePalette();
+
+  void clear(); ///< Call at the start of a frame, the offsets handed out before become invalid
+
+  /**
+   * Reserves a palette of numOfBones matrices and returns its offset.
+   * Reserve the palettes of a frame before filling them from other threads,
+   * reserving moves the palettes filled so far
+   */
+  size_t reserve(size_t numOfBones);
+  size_t add(glm::mat4 const *palette, size_t numOfBones);
+
+  glm::mat4 *data(size_t offset);
+  size_t size() const;
+
+  void upload(); ///< Call once per frame, after the palettes are filled
+
+  void bind(std::string const &variable, uint unit) const;
+  static void setOffset(size_t offset, std::string const &variable = "in_bone_offset");
+
+  GLuint texture() const;
+};
+
+}
+
+#endif
@@ -24,6 +24,7 @@
 
 #include <memory>
 #include <iostream>
+#include <vector>
 
 namespace dim
 {
@@ -132,8 +133,14 @@ namespace dim
 
       void bind(Mode mode) const;
       void update(ListAccessor<Type> const &list);
+      std::vector<Type> contents() const;
 
       Type* map(Access access);
+      /**
+       * Maps count elements from first on, access takes the
+       * glMapBufferRange bits like GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+       */
+      Type* map(size_t first, size_t count, GLbitfield access);
       bool unmap();
 
       GLuint id() const;
@@ -184,6 +191,15 @@ namespace dim
     glBufferSubData(data, 0, d_size * sizeof(Type), list.data());
   }
 
+  template<typename Type>
+  std::vector<Type> Buffer<Type>::contents() const
+  {
+    std::vector<Type> list(d_size);
+    glBindBuffer(data, id());
+    glGetBufferSubData(data, 0, d_size * sizeof(Type), list.data());
+    return list;
+  }
+
   template<typename Type>
   Type* Buffer<Type>::map(Access access)
   {
@@ -195,6 +211,17 @@ namespace dim
     return ptr;
   }
 
+  template<typename Type>
+  Type* Buffer<Type>::map(size_t first, size_t count, GLbitfield access)
+  {
+    glBindBuffer(data, id());
+    Type* ptr = reinterpret_cast<Type*>(glMapBufferRange(data, first * sizeof(Type), count * sizeof(Type), access));
+    if(ptr == 0)
+      log(__FILE__, __LINE__, LogType::warning, "OpenGL failed to map buffer range");
+
+    return ptr;
+  }
+
   template<typename Type>
   bool Buffer<Type>::unmap()
   {
@@ -60,11 +60,14 @@ namespace dim
     float fov() const;
     float height() const;
     float width() const;
+    float zNear() const;
+    float zFar() const;
 
     glm::mat4 const &viewMatrix() const;
     glm::mat4 const &projectionMatrix() const;
 
-    void setAtShader(std::string const &viewMatrix = "viewMatrix", std::string const &projectionMatrix = "projectionMatrix") const;
+    void setAtShader(std::string const &viewMatrix, std::string const &projectionMatrix) const;
+    void setAtShader(char const *viewMatrix = "viewMatrix", char const *projectionMatrix = "projectionMatrix") const;
     void editmode();
     bool frustum(float ox, float oy) const;
 
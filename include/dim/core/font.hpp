@@ -25,6 +25,7 @@
 #include <vector>
 
 #include "dim/core/texture.hpp"
+#include "dim/util/framearena.hpp"
 
 namespace dim
 {
@@ -61,7 +62,7 @@ namespace dim
     uint advance(unsigned char ch) const;
 
   private:
-    std::vector<GLubyte> scale(std::vector<GLubyte> const &textMap, uint oldWidth, uint oldHeight, uint newWidth, uint newHeight) const;
+    FrameVector<GLubyte> scale(FrameVector<GLubyte> const &textMap, uint oldWidth, uint oldHeight, uint newWidth, uint newHeight) const;
 
     static void initialize();
     uint nextPowerOf2(uint number) const;
@@ -0,0 +1,54 @@
+// frustum.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+
+#include <vector>
+
+#include "dim/core/dim.hpp"
+
+namespace dim
+{
+  /**
+   * The six planes of a view volume, taken from a clip matrix. Passing
+   * projection * view gives the frustum in world space, appending a model
+   * matrix gives it in the model space of that matrix
+   */
+  class Frustum
+  {
+      glm::vec4 d_planes[6]; ///< Normalized, the normals point inwards
+
+    public:
+      Frustum(); ///< Everything is inside
+      explicit Frustum(glm::mat4 const &clip);
+
+      bool visible(glm::vec4 const &sphere) const; ///< xyz the center and w the radius
+  };
+
+  /**
+   * Bounding spheres are stored as xyz the center and w the radius. An
+   * infinite radius means the bounds are unknown
+   */
+  glm::vec4 boundingSphere(std::vector<glm::vec3> const &points);
+  glm::vec4 transformSphere(glm::vec4 const &sphere, glm::mat4 const &matrix); ///< Grows the radius by the largest scale
+  glm::vec4 mergeSpheres(glm::vec4 const &lhs, glm::vec4 const &rhs);
+}
+
+#endif
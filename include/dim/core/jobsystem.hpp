@@ -0,0 +1,179 @@
+// jobsystem.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef JOBSYSTEM_HPP
+#define JOBSYSTEM_HPP
+
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+namespace dim
+{
+  /**
+   * A pool of worker threads that take jobs from their own queue first and
+   * steal from the other queues when it runs dry. Jobs for the thread owning
+   * the GL context go to a separate queue that only the main thread, the
+   * thread that first used the JobSystem, executes
+   */
+  class JobSystem
+  {
+    public:
+      typedef std::function<void()> Job;
+
+      /**
+       * Counts the unfinished jobs it was passed to. Jobs can wait for a
+       * counter to drop to zero before they start
+       */
+      class Counter
+      {
+          friend class JobSystem;
+
+          std::atomic<size_t> d_count;
+
+        public:
+          Counter();
+
+          Counter(Counter const &other) = delete;
+          Counter &operator=(Counter const &other) = delete;
+
+          bool done() const;
+      };
+
+    private:
+      struct Entry
+      {
+        Job job;
+        Counter *counter;
+      };
+
+      struct Queue
+      {
+        std::mutex mutex;
+        std::deque<Entry> entries;
+      };
+
+      struct Waiting
+      {
+        Entry entry;
+        Counter *dependency;
+      };
+
+      std::vector<std::unique_ptr<Queue>> d_queues; ///< One per worker
+      std::vector<std::thread> d_threads;
+      Queue d_mainQueue;
+
+      std::mutex d_waitingMutex;
+      std::vector<Waiting> d_waiting; ///< Jobs whose dependency isn't done yet
+
+      std::mutex d_sleepMutex;
+      std::condition_variable d_wake;
+      std::atomic<size_t> d_pending;
+      std::atomic<size_t> d_next;
+      std::atomic<bool> d_running;
+
+      std::thread::id d_mainThread;
+
+    public:
+      static JobSystem &instance();
+
+      JobSystem(JobSystem const &other) = delete;
+      JobSystem &operator=(JobSystem const &other) = delete;
+
+      ~JobSystem();
+
+      /**
+       * With 0 threads every job runs on the calling thread the moment it is
+       * added, so the order of execution is deterministic. Waits for the
+       * queued jobs before changing the number of threads
+       */
+      void setNumOfThreads(size_t numOfThreads);
+      size_t numOfThreads() const;
+
+      void run(Job const &job, Counter *counter = 0);
+      void run(Job const &job, Counter *counter, Counter &dependency); ///< Starts after dependency is done
+      void runOnMainThread(Job const &job, Counter *counter = 0);
+
+      /**
+       * Executes other jobs while waiting, so waiting inside a job doesn't
+       * block a worker
+       */
+      void wait(Counter const &counter);
+      void executeMainThreadJobs(); ///< Call once per frame from the main thread
+
+      /**
+       * Calls function(idx) for every idx in [0, count), split into jobs of
+       * at least minPerJob calls, and returns when all of them are done
+       */
+      template <typename Function>
+      void parallelFor(size_t count, Function const &function, size_t minPerJob = 64);
+
+      bool mainThread() const; ///< Whether the calling thread is the main thread
+
+    private:
+      JobSystem();
+
+      void submit(Entry const &entry, bool mainThread);
+      bool executeOne();
+      bool pop(Entry &entry);
+      void execute(Entry &entry);
+      void finish(Counter *counter); ///< The last job of a counter hands over the jobs waiting on it
+      void work(size_t index);
+      void stop();
+  };
+
+  template <typename Function>
+  void JobSystem::parallelFor(size_t count, Function const &function, size_t minPerJob)
+  {
+    size_t numOfJobs = std::min(4 * d_threads.size(), count / std::max<size_t>(minPerJob, 1));
+
+    if(numOfJobs < 2)
+    {
+      for(size_t idx = 0; idx != count; ++idx)
+        function(idx);
+      return;
+    }
+
+    size_t chunk = (count + numOfJobs - 1) / numOfJobs;
+
+    Counter counter;
+    for(size_t first = chunk; first < count; first += chunk)
+    {
+      size_t last = std::min(count, first + chunk);
+      run([&function, first, last]()
+          {
+            for(size_t idx = first; idx != last; ++idx)
+              function(idx);
+          }, &counter);
+    }
+
+    for(size_t idx = 0; idx != chunk; ++idx)
+      function(idx);
+
+    wait(counter);
+  }
+}
+
+#endif
@@ -37,6 +37,10 @@ class Light
   glm::vec4 d_lightColor;
   glm::vec4 d_position;
   glm::vec4 d_transformedPosition;
+  glm::vec3 d_direction;
+  float d_range; ///< Point and spot lights don't reach further than this
+  float d_cosInner;
+  float d_cosOuter;
 
   glm::mat4 d_lightMatrix;
 
@@ -45,6 +49,7 @@ public:
   {
   	directional,
   	point,
+  	spot,
   };
   
   Light();
@@ -56,11 +61,23 @@ public:
   void setPosition(glm::vec4 const &position);
   void setAmbientIntensity(glm::vec4 const &ambientIntensity);
   void setLightIntensity(glm::vec4 const &lightIntensity);
+  void setDirection(glm::vec3 const &direction);
+  void setRange(float range);
+  void setSpotAngles(float inner, float outer); ///< Half angles of the cone in radians, the light fades out between them
   
   glm::mat4 const &lightMatrix() const;
   glm::vec4 const &position() const;
+  glm::vec4 const &lightColor() const;
+  glm::vec4 const &lightIntensity() const;
+  glm::vec4 const &highlightColor() const;
+  glm::vec4 const &ambientIntensity() const;
+  glm::vec3 const &direction() const;
+  float range() const;
+  float cosInner() const;
+  float cosOuter() const;
+  Light::type mode() const;
 
-  void setAtShader() const;
+  void setAtShader() const; ///< Only sets directional lights, point and spot lights go through a LightGrid
   
 private:
   Light::type d_mode;
@@ -0,0 +1,91 @@
+// lightgrid.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#ifndef LIGHTGRID_HPP
+#define LIGHTGRID_HPP
+
+#include <array>
+#include <vector>
+#include <memory>
+
+#include "dim/core/light.hpp"
+#include "dim/core/camera.hpp"
+
+namespace dim
+{
+
+/**
+ * Assigns the point and spot lights to the clusters of a grid over the view
+ * frustum, tiled on the screen and sliced exponentially in depth. Building
+ * runs on the JobSystem and doesn't touch GL, uploading and binding must run
+ * on the thread owning the context.
+ *
+ * A fragment shader finds its cluster with
+ *   slice = int(log(depth) * in_light_grid_depth.x + in_light_grid_depth.y)
+ *   tile = ivec2(gl_FragCoord.xy / viewportSize * in_light_grid_size.xy)
+ * and fetches offset and count from in_light_clusters (usamplerBuffer) at
+ * (slice * size.y + tile.y) * size.x + tile.x, the light indices from
+ * in_light_indices (usamplerBuffer) and 4 texels per light from in_lights
+ * (samplerBuffer): view space position and range, color and type, view
+ * space direction and the cosine of the outer cone, the cosine of the inner
+ * cone
+ */
+class LightGrid
+{
+  size_t d_numOfX;
+  size_t d_numOfY;
+  size_t d_numOfZ;
+  float d_depthScale;
+  float d_depthBias;
+
+  // the bounding spheres in view space, one array per component so the bounds are computed in vector registers
+  std::vector<float> d_x;
+  std::vector<float> d_y;
+  std::vector<float> d_depth;
+  std::vector<float> d_radius;
+  std::vector<int> d_bounds; ///< First and last tile in x, y and slice per light
+
+  std::vector<std::vector<std::vector<GLuint>>> d_slices; ///< Light indices per tile per slice
+
+  std::vector<glm::vec4> d_lights;
+  std::vector<GLuint> d_clusters; ///< Offset and count per cluster
+  std::vector<GLuint> d_indices;
+
+  std::shared_ptr<std::array<GLuint, 6>> d_objects; ///< Three buffers and their textures, made by the first upload
+  bool d_changed;
+
+public:
+  explicit LightGrid(size_t numOfX = 16, size_t numOfY = 9, size_t numOfZ = 24);
+
+  void build(Camera const &camera, std::vector<Light> const &lights); ///< Directional lights are skipped
+  void upload(); ///< Only uploads after a build
+  void bind(uint firstUnit = 13) const; ///< Uses three texture units
+
+  size_t numOfLights() const;
+  size_t numOfClusters() const;
+  size_t numOfIndices() const; ///< The number of light assignments, a light in several clusters counts several times
+
+private:
+  void assign(size_t slice);
+};
+
+}
+
+#endif
@@ -24,10 +24,12 @@
 #include <string>
 #include <limits>
 #include <vector>
+#include <memory>
 
 #include "dim/core/shader.hpp"
 #include "dim/core/buffer.hpp"
 #include "dim/core/texture.hpp"
+#include "dim/core/streambuffer.hpp"
 
 namespace dim
 {
@@ -101,6 +103,9 @@ namespace dim
 
         bool operator==(AttributeAccessor const &other) const
         {
+          if(d_type != other.d_type)
+            return false;
+
           if(d_type == UnionType::id)
             return d_idAttribute == other.d_idAttribute;
           else if(d_type == UnionType::num)
@@ -140,6 +145,21 @@ namespace dim
             Shader::disableAttribute(d_stringAttribute, format);
         }
 
+        void setPacked(Shader::Format format, Shader::Component component, bool normalized, size_t byteOffset, size_t byteStride) const
+        {
+          Shader::setPacked(location(), format, component, normalized, byteOffset, byteStride);
+        }
+
+        GLint location() const ///< In the active shader
+        {
+          if(d_type == UnionType::id)
+            return Shader::location(d_idAttribute);
+          else if(d_type == UnionType::num)
+            return d_numAttribute;
+          //else if(d_type == UnionType::string)
+          return Shader::location(d_stringAttribute);
+        }
+
         void advancePerInstance(Shader::Format format, bool advance) const
         {
           if(d_type == UnionType::id)
@@ -158,11 +178,42 @@ namespace dim
             d_stringAttribute.~string();
         }
     };
+
+    /**
+     * An attribute of a packed vertex, see Shader::setPacked
+     */
+    struct VertexAttribute
+    {
+      AttributeAccessor attribute;
+      Shader::Format format;
+      Shader::Component component;
+      bool normalized;
+    };
+
+    /**
+     * The vertex array objects of a mesh, one for every layout of attribute
+     * locations it has been drawn with. Copies of a mesh share the cache
+     * until one of them changes its buffers
+     */
+    class VertexArrayCache
+    {
+        std::vector<std::pair<std::vector<GLint>, GLuint>> d_arrays;
+
+      public:
+        VertexArrayCache() = default;
+        VertexArrayCache(VertexArrayCache const &other) = delete;
+        VertexArrayCache &operator=(VertexArrayCache const &other) = delete;
+        ~VertexArrayCache();
+
+        GLuint find(std::vector<GLint> const &layout) const; ///< 0 when the layout has no array yet
+        GLuint add(std::vector<GLint> const &layout);
+    };
   }
 
   class Bone
   {
       glm::mat4 d_offset;
+      glm::mat4 d_transform; ///< Relative to the parent bone in the bind pose
       std::string d_name;
       std::vector<Bone> d_children;
       uint d_index;
@@ -184,6 +235,16 @@ namespace dim
         return d_offset;
       }
 
+      void setTransform(glm::mat4 const &transform)
+      {
+        d_transform = transform;
+      }
+
+      glm::mat4 const &transform() const
+      {
+        return d_transform;
+      }
+
       std::string const &name() const
       {
         return d_name;
@@ -217,6 +278,8 @@ namespace dim
 
       Buffer<GLfloat> d_interleavedVBO;
       Buffer<GLushort> d_indexVBO;
+      Buffer<GLuint> d_wideIndexVBO;
+      GLenum d_indexType;        ///< GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, whichever buffer holds the indices
       size_t d_numOfVertices;
       size_t d_numOfTriangles;
 
@@ -225,10 +288,19 @@ namespace dim
 
       std::vector<Buffer<GLfloat>> d_additionalVBOs;
 
+      std::shared_ptr<internal::VertexArrayCache> d_vertexArrays;
+
+      Buffer<GLubyte> d_packedVBO;
+      std::vector<internal::VertexAttribute> d_layout; ///< Empty unless the vertices are packed
+      glm::mat4 d_positionTransform;
+
       static bool s_bindless;
       static bool s_instanced;
+      static bool s_vertexArrays;
       static GLuint s_bound;
+      static GLuint s_boundArray; ///< The vertex array bind left bound, copies sharing s_bound may record other ones
       static GLuint s_boundElem;
+      static GLuint s_streamArray; ///< The vertex array of drawStreamed
 
       static bool s_initialized;
     public:
@@ -242,20 +314,56 @@ namespace dim
 
       Mesh(GLfloat const *buffer, size_t numOfVertices, std::vector<std::pair<internal::AttributeAccessor, Shader::Format>> const &formats);
       Mesh(GLfloat const *buffer, size_t numOfVertices, internal::AttributeAccessor attribute, Shader::Format format);
+      /**
+       * Interleaved vertices of mixed component types, each attribute
+       * padded to 4 bytes. positionTransform maps quantized positions back
+       * to model space. Packed meshes can't be updated, batched or turned
+       * into collision shapes
+       */
+      Mesh(GLubyte const *buffer, size_t numOfVertices, std::vector<internal::VertexAttribute> const &layout,
+           glm::mat4 const &positionTransform = glm::mat4(1.0));
       void addBuffer(GLfloat const *buffer, internal::AttributeAccessor attribute, Shader::Format format);
 
       void addElementBuffer(GLushort const *buffer, size_t numOfPolygons);
+      /**
+       * Stored as 16 bit indices when they all fit, otherwise as 32 bit
+       * indices
+       */
+      void addElementBuffer(GLuint const *buffer, size_t numOfPolygons);
       void addInstanceBuffer(GLfloat const *buffer, size_t numOfLocations, Shader::Format format);
 
-      Buffer<GLfloat> const &buffer();
-      Buffer<GLushort> const &elementBuffer();
-      Buffer<GLfloat> const &instanceBuffer();
+      Buffer<GLfloat> const &buffer() const;
+      Buffer<GLushort> const &elementBuffer() const;
+      Buffer<GLuint> const &wideElementBuffer() const;
+      GLenum indexType() const;
+      std::vector<GLuint> indices() const; ///< Reads back the indices of either width
+      Buffer<GLfloat> const &instanceBuffer() const;
+
+      std::vector<std::pair<internal::AttributeAccessor, Shader::Format>> const &formats() const;
+      size_t numOfVertices() const;
+      size_t numOfTriangles() const;
+      bool interleaved() const;
+      bool packed() const;
+      std::vector<internal::VertexAttribute> const &layout() const;
+      glm::mat4 const &positionTransform() const; ///< Drawn with model * positionTransform(), the identity for unpacked meshes
+      size_t vertexSize() const;                  ///< In bytes
+      bool hasAttribute(internal::AttributeAccessor attribute) const;
 
       void updateBuffer(GLfloat const *buffer);
       void updateBuffer(GLfloat const *buffer, internal::AttributeAccessor attribute);
       void updateElementBuffer(GLushort const *buffer);
+      void updateElementBuffer(GLuint const *buffer);
       void updateInstanceBuffer(GLfloat const *buffer, size_t locations);
 
+      /**
+       * Replaces the contents of an interleaved mesh with a different
+       * number of vertices or triangles, meant for data that is regenerated
+       * every frame
+       */
+      void streamBuffer(GLfloat const *buffer, size_t numOfVertices);
+      void streamElementBuffer(GLushort const *buffer, size_t numOfTriangles);
+      void streamElementBuffer(GLuint const *buffer, size_t numOfTriangles);
+
       void bind() const;
       void unbind() const;
       void bindElement() const;
@@ -264,6 +372,20 @@ namespace dim
 
       void draw(Shape shape = triangle) const;
       void drawInstanced(size_t numOfPolygons, Shape shape = triangle) const;
+      /**
+       * Reads the float instance data of this frame from instances at offset
+       * instead of from the instance buffer
+       */
+      void drawInstanced(StreamBuffer const &instances, size_t offset, size_t numOfPolygons, Shader::Format format,
+                         Shape shape = triangle) const;
+      void drawRange(size_t firstIndex, size_t numOfIndices, Shape shape = triangle) const; ///< Draws part of the element buffer
+      /**
+       * Draws float vertices in the formats of this mesh that were written
+       * to stream at vertexOffset, with 16 bit indices at indexOffset. The
+       * buffers of the mesh itself aren't used
+       */
+      void drawStreamed(StreamBuffer const &stream, size_t vertexOffset, size_t indexOffset, size_t numOfIndices,
+                        Shape shape = triangle) const;
 
       GLuint id() const;
 
@@ -273,6 +395,15 @@ namespace dim
       static void initialize();
 
       uint numOfElements() const;
+      bool hasElements() const;
+      void storeElements(GLuint const *buffer, size_t numOfTriangles);
+
+      void drawInstances(size_t numOfPolygons, Shape shape) const;
+      void setAttributes() const;
+      bool bound() const; ///< Whether bind would do nothing
+      std::vector<GLint> const &locations() const; ///< The attribute locations in the active shader, picks the vertex array
+      void bindVertexArray() const;
+      void resetVertexArrays(); ///< After the buffers or the formats changed
   };
 }
 
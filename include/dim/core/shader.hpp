@@ -72,6 +72,8 @@ class Shader
   constexpr static int const s_attributeArraySize = 6;
   std::array<GLint, s_attributeArraySize> d_attributeArray;
 
+  GLuint d_blocks = 0; ///< A bit per Block the program declares, set when it is linked
+
 public:
   enum FromString
   {
@@ -110,6 +112,18 @@ public:
     texture = 13
   };
 
+  /**
+   * Binding points of the std140 blocks in uniformblock.hpp, blocks with
+   * these names are bound when a program is linked
+   */
+  enum Block: GLuint
+  {
+    frameBlock = 0,    ///< FrameBlock
+    viewBlock = 1,     ///< ViewBlock
+    lightBlock = 2,    ///< LightBlock
+    materialBlock = 3  ///< MaterialBlock
+  };
+
   enum Format: uint
   {
     vec1 = 11,
@@ -127,6 +141,20 @@ public:
     mat4 = 44
   };
 
+  /**
+   * The type of the components of a vertex attribute in its buffer
+   */
+  enum Component: GLenum
+  {
+    float32 = GL_FLOAT,
+    float16 = GL_HALF_FLOAT,
+    int16 = GL_SHORT,
+    uint16 = GL_UNSIGNED_SHORT,
+    int8 = GL_BYTE,
+    uint8 = GL_UNSIGNED_BYTE,
+    int2_10_10_10 = GL_INT_2_10_10_10_REV ///< Four components in 32 bits
+  };
+
   ~Shader();
 
   Shader();
@@ -138,12 +166,18 @@ public:
 
   void bind(std::string const &variable, Uniform uniform);
   void bind(std::string const &variable, Attribute attribute);
+  bool bind(std::string const &block, GLuint binding) const; ///< Binds a uniform block, false if the program doesn't have it
+  bool hasBlock(Block block) const; ///< Whether the program declares the block, programs without it need the separate uniforms
 
   template<typename Type>
   static GLint set(std::string const &variable, Type const &value);
+  template<typename Type>
+  static GLint set(char const *variable, Type const &value); ///< Copies the name into a thread_local string, which stops allocating once it fits the longest name
   
   template<typename Type>
   static void set(std::string const &variable, Texture<Type> const &value, uint unit);
+  template<typename Type>
+  static void set(char const *variable, Texture<Type> const &value, uint unit);
 
   static void enableAttribute(Attribute attribute, Format format);
   static void disableAttribute(Attribute attribute, Format format);
@@ -155,6 +189,16 @@ public:
   static void disableAttribute(GLint attribute, Format format);
   static void advanceAttributePerInstance(GLint attribute, Format format, bool advance);
 
+  /**
+   * Points an attribute at the buffer bound to GL_ARRAY_BUFFER. Integer
+   * components are read as [-1, 1] or [0, 1] when normalized and as their
+   * value otherwise
+   */
+  static void setPacked(GLint attribute, Format format, Component component, bool normalized, size_t byteOffset, size_t byteStride);
+
+  static GLint location(Attribute attribute); ///< In the active shader
+  static GLint location(std::string const &attribute);
+
   template<typename Type>
   static void set(Attribute attribute, Buffer<Type> const &value, Format format, uint floatStartOffset = 0, uint floatStride = 0);
   template<typename Type>
@@ -211,6 +255,7 @@ public:
   GLuint id() const;
 
   static Shader const &defaultShader();
+  static Shader const &depthShader(); ///< Writes only depth, reads the camera from the ViewBlock
 
 private:
   static Shader &activePrivate();
@@ -219,6 +264,7 @@ private:
   void checkCompile(GLuint shader, std::string const &filename, std::string const &stage) const;
   void checkProgram(GLuint program) const;
   GLint findUniform(std::string const &variable) const;
+  GLint findUniform(char const *variable) const;
   GLint findAttribute(std::string const &variable) const;
 
   void parseGLSL(std::string const &vertexFile, std::string const &vertexInput,
@@ -249,6 +295,14 @@ private:
     return loc;
   }
 
+  template<typename Type>
+  GLint Shader::set(char const *variable, Type const &value)
+  {
+    GLint loc = active().findUniform(variable);
+    set(loc, value);
+    return loc;
+  }
+
   template<typename Type>
   GLint Shader::set(std::string const &variable, Type const *values, size_t size)
   {
@@ -283,6 +337,17 @@ private:
     texture.bind();
   }
 
+  template<typename Type>
+  void Shader::set(char const *variable, Texture<Type> const &texture, uint unit)
+  {
+    if(static_cast<int>(unit) > s_maxTextureUnits)
+      log(__FILE__, __LINE__, LogType::warning, "This graphics card does not support " + std::to_string(unit) + " texture units");
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    set(variable, static_cast<int>(unit));
+    texture.bind();
+  }
+
   template<typename Type>
   inline void Shader::set(Attribute attribute, Buffer<Type> const &value, Format format, uint floatStartOffset, uint floatStride)
   {
@@ -327,6 +392,41 @@ private:
 
       return columns * rows;
     }
+
+    inline uint componentSize(Shader::Component component)
+    {
+      switch(component)
+      {
+        case Shader::float16:
+        case Shader::int16:
+        case Shader::uint16:
+          return 2;
+        case Shader::int8:
+        case Shader::uint8:
+          return 1;
+        default:
+          return 4;
+      }
+    }
+
+    /**
+     * The bytes one column of an attribute takes, padded to 4 bytes to keep
+     * the attributes aligned
+     */
+    inline uint columnSize(Shader::Format format, Shader::Component component)
+    {
+      uint rows = format % 10;
+
+      if(component == Shader::int2_10_10_10)
+        return 4;
+
+      return (rows * componentSize(component) + 3) / 4 * 4;
+    }
+
+    inline uint attributeSize(Shader::Format format, Shader::Component component)
+    {
+      return format / 10 * columnSize(format, component);
+    }
   }
 }
 
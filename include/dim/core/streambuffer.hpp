@@ -0,0 +1,92 @@
+// streambuffer.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef STREAMBUFFER_HPP
+#define STREAMBUFFER_HPP
+
+#include <memory>
+#include <vector>
+
+#include "dim/core/dim.hpp"
+
+namespace dim
+{
+
+/**
+ * A ring buffer for data the CPU writes every frame, like instance data,
+ * uniform block ranges and dynamic batches. Every frame in flight writes
+ * to its own region, guarded by a fence, so a write only waits when the GPU
+ * is that many frames behind. With ARB_buffer_storage the buffer stays
+ * mapped, otherwise every write maps its range unsynchronized. The storage
+ * is made by the first write
+ */
+class StreamBuffer
+{
+  std::shared_ptr<GLuint> d_id;
+  GLubyte *d_data;                ///< The persistent mapping, 0 without one
+  size_t d_frameSize;
+  size_t d_numOfFrames;
+  size_t d_frame;
+  size_t d_offset;                ///< Within the region of the current frame
+  std::vector<GLsync> d_fences;   ///< One per region, 0 when the GPU is done with it
+
+  public:
+    explicit StreamBuffer(size_t frameSize, size_t numOfFrames = 3);
+    StreamBuffer(StreamBuffer const &other) = delete;
+    StreamBuffer &operator=(StreamBuffer const &other) = delete;
+    ~StreamBuffer();
+
+    /**
+     * Fences the draws reading the current region and moves on to the
+     * next one, waiting until the GPU is done with it
+     */
+    void nextFrame();
+
+    /**
+     * Copies size bytes into the current region and returns their offset
+     * in the buffer. Throws when the region is full
+     */
+    size_t write(void const *data, size_t size, size_t alignment = 16);
+    template <typename Type>
+    size_t write(std::vector<Type> const &data, size_t alignment = 16);
+
+    void bind(GLenum target) const;
+    void bindRange(GLenum target, GLuint binding, size_t offset, size_t size) const; ///< For uniform blocks
+
+    GLuint id() const;
+    size_t frameSize() const;
+    size_t remaining() const; ///< The bytes left in the current region, ignoring alignment
+    bool persistent() const;
+
+    static size_t uniformAlignment(); ///< Uniform block ranges have to start at a multiple of this
+
+  private:
+    void initialize();
+    void wait(size_t frame);
+};
+
+template <typename Type>
+size_t StreamBuffer::write(std::vector<Type> const &data, size_t alignment)
+{
+  return write(data.data(), data.size() * sizeof(Type), alignment);
+}
+
+}
+
+#endif
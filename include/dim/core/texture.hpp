@@ -57,6 +57,7 @@ namespace dim
   {
     RGBA8 = GL_RGBA8,
     RGBA16 = GL_RGBA16,
+    RGB10A2 = GL_RGB10_A2, ///< Packed normals
     sRGB8A8 = GL_SRGB8_ALPHA8,
     RGB8 = GL_RGB8,
     RGB16 = GL_RGB16,
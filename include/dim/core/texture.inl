@@ -89,6 +89,8 @@ namespace dim
           return "GL_RGBA16UI";
         case GL_RGBA16:
           return "GL_RGBA16";
+        case GL_RGB10_A2:
+          return "GL_RGB10_A2";
         case GL_RGB16F:
           return "GL_RGB16F";
         case GL_RGB16I:
@@ -607,6 +609,7 @@ namespace dim
         case GL_RGBA8:
         case GL_SRGB8_ALPHA8:
         case GL_RGBA16:
+        case GL_RGB10_A2:
         case GL_RGBA8I:
         case GL_RGBA8UI:
         case GL_RGBA16I:
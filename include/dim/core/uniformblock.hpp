@@ -0,0 +1,313 @@
+// uniformblock.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#ifndef UNIFORMBLOCK_HPP
+#define UNIFORMBLOCK_HPP
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstring>
+
+#include "dim/core/camera.hpp"
+#include "dim/core/light.hpp"
+#include "dim/core/streambuffer.hpp"
+
+namespace dim
+{
+
+/*
+ * The blocks only hold vec4s, uvec4s and mat4s, which have the same size
+ * and alignment in C++ as in the std140 layout, so the structs are copied
+ * into the buffers as they are. The GLSL declarations must list the same
+ * members in the same order
+ */
+
+struct FrameBlock
+{
+  glm::vec4 time; ///< Seconds since the first frame, seconds since the previous frame
+};
+
+struct ViewBlock
+{
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::mat4 viewProjection;
+  glm::mat4 inverseProjection;
+  glm::vec4 depthRange; ///< Near and far plane
+
+  static ViewBlock fromCamera(Camera const &camera);
+};
+
+struct LightBlock
+{
+  static size_t const s_maxLights = 8;
+
+  struct Directional
+  {
+    glm::vec4 lightColor;
+    glm::vec4 highlightColor;
+    glm::vec4 lightIntensity;
+    glm::vec4 ambientIntensity;
+    glm::vec4 position;
+    glm::mat4 lightMatrix;
+  };
+
+  Directional lights[s_maxLights];
+  glm::uvec4 numOfLights; ///< Only x is used
+
+  static LightBlock fromLights(std::vector<Light> const &lights); ///< Point and spot lights go through a LightGrid
+};
+
+struct MaterialBlock
+{
+  glm::vec4 ambient;
+  glm::vec4 diffuse;
+  glm::vec4 specular; ///< The shininess is stored in w
+};
+
+static_assert(sizeof(FrameBlock) == 16, "FrameBlock doesn't match the std140 layout");
+static_assert(offsetof(ViewBlock, projection) == 64 && offsetof(ViewBlock, viewProjection) == 128 &&
+              offsetof(ViewBlock, inverseProjection) == 192 && offsetof(ViewBlock, depthRange) == 256 &&
+              sizeof(ViewBlock) == 272, "ViewBlock doesn't match the std140 layout");
+static_assert(offsetof(LightBlock::Directional, lightMatrix) == 80 && sizeof(LightBlock::Directional) == 144,
+              "LightBlock::Directional doesn't match the std140 layout");
+static_assert(offsetof(LightBlock, numOfLights) == 144 * LightBlock::s_maxLights &&
+              sizeof(LightBlock) == 144 * LightBlock::s_maxLights + 16, "LightBlock doesn't match the std140 layout");
+static_assert(offsetof(MaterialBlock, specular) == 32 && sizeof(MaterialBlock) == 48,
+              "MaterialBlock doesn't match the std140 layout");
+
+/**
+ * A uniform buffer holding one block, bound to a fixed binding point so
+ * every program reads it without setting anything when it is used. The
+ * buffer is made by the first upload
+ */
+template<typename Type>
+class UniformBlock
+{
+  Type d_data;
+  std::shared_ptr<GLuint> d_id;
+  GLuint d_binding;
+  bool d_changed;
+
+public:
+  explicit UniformBlock(GLuint binding);
+
+  Type &data(); ///< Marks the block as changed
+  Type const &data() const;
+  void set(Type const &data);
+
+  void upload(); ///< Only uploads when the block changed
+  void upload(StreamBuffer &stream); ///< Writes the block to the current region of stream and binds that range
+  void bind() const;
+
+  GLuint binding() const;
+};
+
+/**
+ * Blocks of the same type in one uniform buffer, of which one at a time is
+ * bound to the binding point, for example the materials indexed by their id
+ */
+template<typename Type>
+class UniformBlockArray
+{
+  std::vector<GLubyte> d_data;
+  std::shared_ptr<GLuint> d_id;
+  GLuint d_binding;
+  size_t d_stride;
+  size_t d_uploaded;
+  bool d_changed;
+
+public:
+  explicit UniformBlockArray(GLuint binding);
+
+  void set(size_t idx, Type const &block); ///< Grows the array when needed
+  size_t size() const;
+
+  void upload();
+  void bind(size_t idx) const;
+
+private:
+  static size_t stride();
+};
+
+template<typename Type>
+UniformBlock<Type>::UniformBlock(GLuint binding)
+:
+  d_data(),
+  d_binding(binding),
+  d_changed(true)
+{
+}
+
+template<typename Type>
+Type &UniformBlock<Type>::data()
+{
+  d_changed = true;
+  return d_data;
+}
+
+template<typename Type>
+Type const &UniformBlock<Type>::data() const
+{
+  return d_data;
+}
+
+template<typename Type>
+void UniformBlock<Type>::set(Type const &data)
+{
+  d_data = data;
+  d_changed = true;
+}
+
+template<typename Type>
+void UniformBlock<Type>::upload()
+{
+  if(not d_id)
+  {
+    d_id.reset(new GLuint(0), [](GLuint *ptr)
+               { glDeleteBuffers(1, ptr);
+                 delete ptr;});
+
+    glGenBuffers(1, d_id.get());
+    glBindBuffer(GL_UNIFORM_BUFFER, *d_id);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(Type), 0, GL_DYNAMIC_DRAW);
+  }
+
+  if(not d_changed)
+    return;
+
+  glBindBuffer(GL_UNIFORM_BUFFER, *d_id);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Type), &d_data);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  d_changed = false;
+}
+
+template<typename Type>
+void UniformBlock<Type>::upload(StreamBuffer &stream)
+{
+  size_t offset = stream.write(&d_data, sizeof(Type), StreamBuffer::uniformAlignment());
+  stream.bindRange(GL_UNIFORM_BUFFER, d_binding, offset, sizeof(Type));
+
+  d_changed = false;
+}
+
+template<typename Type>
+void UniformBlock<Type>::bind() const
+{
+  if(not d_id)
+  {
+    log(__FILE__, __LINE__, LogType::warning, "Binding a uniform block that has never been uploaded");
+    return;
+  }
+
+  glBindBufferBase(GL_UNIFORM_BUFFER, d_binding, *d_id);
+}
+
+template<typename Type>
+GLuint UniformBlock<Type>::binding() const
+{
+  return d_binding;
+}
+
+template<typename Type>
+UniformBlockArray<Type>::UniformBlockArray(GLuint binding)
+:
+  d_binding(binding),
+  d_stride(0),
+  d_uploaded(0),
+  d_changed(false)
+{
+}
+
+template<typename Type>
+size_t UniformBlockArray<Type>::stride()
+{
+  // the offset of a bound range must be a multiple of this alignment
+  static size_t stride = 0;
+  if(stride == 0)
+  {
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    stride = (sizeof(Type) + alignment - 1) / alignment * alignment;
+  }
+  return stride;
+}
+
+template<typename Type>
+void UniformBlockArray<Type>::set(size_t idx, Type const &block)
+{
+  if(d_stride == 0)
+    d_stride = stride();
+
+  if((idx + 1) * d_stride > d_data.size())
+    d_data.resize((idx + 1) * d_stride);
+
+  std::memcpy(&d_data[idx * d_stride], &block, sizeof(Type));
+  d_changed = true;
+}
+
+template<typename Type>
+size_t UniformBlockArray<Type>::size() const
+{
+  return d_stride == 0 ? 0 : d_data.size() / d_stride;
+}
+
+template<typename Type>
+void UniformBlockArray<Type>::upload()
+{
+  if(not d_changed)
+    return;
+
+  if(not d_id)
+  {
+    d_id.reset(new GLuint(0), [](GLuint *ptr)
+               { glDeleteBuffers(1, ptr);
+                 delete ptr;});
+    glGenBuffers(1, d_id.get());
+  }
+
+  glBindBuffer(GL_UNIFORM_BUFFER, *d_id);
+  if(d_data.size() != d_uploaded)
+    glBufferData(GL_UNIFORM_BUFFER, d_data.size(), d_data.data(), GL_DYNAMIC_DRAW);
+  else
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, d_data.size(), d_data.data());
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  d_uploaded = d_data.size();
+  d_changed = false;
+}
+
+template<typename Type>
+void UniformBlockArray<Type>::bind(size_t idx) const
+{
+  if(not d_id || (idx + 1) * d_stride > d_uploaded)
+  {
+    log(__FILE__, __LINE__, LogType::warning, "Binding a uniform block that has not been uploaded");
+    return;
+  }
+
+  glBindBufferRange(GL_UNIFORM_BUFFER, d_binding, *d_id, idx * d_stride, sizeof(Type));
+}
+
+}
+
+#endif
@@ -0,0 +1,105 @@
+// animationclip.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#ifndef ANIMATIONCLIP_HPP
+#define ANIMATIONCLIP_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "dim/scene/skeleton.hpp"
+
+namespace dim
+{
+
+/**
+ * The key frames of one animation of a skeleton. Keys that linear
+ * interpolation of their neighbours reproduces within the tolerance are
+ * dropped, rotations are stored as four 16-bit integers, and the keys of
+ * all bones are stored together per kind of key
+ */
+class AnimationClip
+{
+  public:
+    struct Channel
+    {
+      uint bone;
+      std::vector<std::pair<float, glm::vec3>> positions; ///< Times in seconds
+      std::vector<std::pair<float, glm::quat>> rotations;
+      std::vector<std::pair<float, glm::vec3>> scalings;
+    };
+
+  private:
+    struct QuantizedQuat
+    {
+      int16_t x;
+      int16_t y;
+      int16_t z;
+      int16_t w;
+    };
+
+    struct Range
+    {
+      uint32_t first;
+      uint32_t count;
+    };
+
+    struct Track
+    {
+      uint bone;
+      Range positions;
+      Range rotations;
+      Range scalings;
+    };
+
+    std::string d_name;
+    float d_duration;
+
+    std::vector<Track> d_tracks;
+    std::vector<float> d_positionTimes;
+    std::vector<glm::vec3> d_positions;
+    std::vector<float> d_rotationTimes;
+    std::vector<QuantizedQuat> d_rotations;
+    std::vector<float> d_scalingTimes;
+    std::vector<glm::vec3> d_scalings;
+
+  public:
+    AnimationClip(std::string const &name, float duration, std::vector<Channel> const &channels, float tolerance = 0.0001);
+
+    std::string const &name() const;
+    float duration() const;
+    size_t numOfKeys() const;
+
+    /**
+     * Overwrites the transforms of the bones animated by this clip, the
+     * other bones keep their transform. Safe to call from several threads at
+     * once
+     */
+    void sample(float time, Pose &pose) const;
+
+  private:
+    static QuantizedQuat quantize(glm::quat const &rotation);
+    static glm::quat dequantize(QuantizedQuat const &rotation);
+};
+
+}
+
+#endif
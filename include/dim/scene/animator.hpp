@@ -0,0 +1,130 @@
+// animator.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#ifndef ANIMATOR_HPP
+#define ANIMATOR_HPP
+
+#include <vector>
+
+#include "dim/scene/skeleton.hpp"
+#include "dim/scene/animationclip.hpp"
+#include "dim/core/bonepalette.hpp"
+
+namespace dim
+{
+
+/**
+ * Per bone weights of a layer, indexed by the bone index
+ */
+class BoneMask
+{
+  std::vector<float> d_weights;
+
+public:
+  BoneMask(Skeleton const &skeleton, float weight = 0);
+
+  void set(Skeleton const &skeleton, std::string const &bone, float weight); ///< Sets the bone and every bone below it
+  float operator[](size_t bone) const;
+};
+
+/**
+ * Blends poses over each other, the masks may be 0 to blend all bones with
+ * the same weight
+ */
+void blend(Pose const &from, Pose const &to, float weight, BoneMask const *mask, Pose &result);
+void addPose(Pose const &additive, Pose const &reference, float weight, BoneMask const *mask, Pose &result); ///< Adds the difference to reference
+
+/**
+ * The animation state of one skinned instance: a clip that plays, the clip
+ * it fades from, and layers blended on top of them
+ */
+class Animator
+{
+  public:
+    enum Mode
+    {
+      replace,
+      additive ///< Adds the difference between the clip and the bind pose
+    };
+
+    struct Layer
+    {
+      AnimationClip const *clip;
+      float time;
+      float weight;
+      Mode mode;
+      BoneMask const *mask; ///< 0 for all bones
+      bool loop;
+    };
+
+  private:
+    Skeleton const *d_skeleton;
+
+    Layer d_current;
+    Layer d_previous;
+    float d_fade;
+    float d_fadeDuration;
+
+    std::vector<Layer> d_layers;
+    size_t d_paletteOffset;
+
+  public:
+    explicit Animator(Skeleton const &skeleton);
+
+    Skeleton const &skeleton() const;
+
+    void play(AnimationClip const &clip, float fadeDuration = 0, bool loop = true); ///< Crossfades from the playing clip
+    size_t addLayer(AnimationClip const &clip, float weight, Mode mode = replace, BoneMask const *mask = 0, bool loop = true);
+    Layer &layer(size_t idx);
+    void clearLayers();
+
+    void update(float time); ///< Advances the clips by time seconds
+    void evaluate(glm::mat4 *palette) const;
+
+    size_t paletteOffset() const; ///< The offset of the palette written by the last AnimationSystem::update
+    void setPaletteOffset(size_t offset);
+
+  private:
+    static void advance(Layer &layer, float time);
+};
+
+/**
+ * Updates the animators of all instances in parallel on the JobSystem and
+ * writes their palettes into one BonePalette. The animators aren't owned
+ */
+class AnimationSystem
+{
+  std::vector<Animator*> d_animators;
+
+public:
+  void add(Animator &animator);
+  void remove(Animator &animator);
+  size_t size() const;
+
+  /**
+   * Clears palette and fills it with a palette per animator, call from the
+   * thread that uploads the palette
+   */
+  void update(float time, BonePalette &palette);
+};
+
+}
+
+#endif
@@ -0,0 +1,87 @@
+// batchgeometry.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef BATCHGEOMETRY_HPP
+#define BATCHGEOMETRY_HPP
+
+#include <vector>
+#include <limits>
+
+#include "dim/core/mesh.hpp"
+
+namespace dim
+{
+namespace internal
+{
+  /**
+   * A copy of the vertices and indices of a Mesh in main memory, used to
+   * merge meshes into one buffer on the CPU
+   */
+  class BatchGeometry
+  {
+      std::vector<GLfloat> d_vertices;
+      std::vector<GLuint> d_indices;
+      size_t d_stride;
+
+    public:
+      static size_t const maxVertices = std::numeric_limits<GLushort>::max(); ///< Batches are drawn with 16 bit indices
+
+      BatchGeometry();
+      explicit BatchGeometry(Mesh const &mesh); ///< Reads the geometry back from the GPU
+      /**
+       * Takes over the interleaved vertices and the indices a mesh was
+       * created from, formats describes the vertices
+       */
+      BatchGeometry(std::vector<GLfloat> &&vertices, std::vector<GLuint> &&indices,
+                    std::vector<std::pair<AttributeAccessor, Shader::Format>> const &formats);
+
+      static bool mergeable(Mesh const &mesh); ///< Whether the vertices of the mesh can be merged into a batch
+
+      size_t numOfVertices() const;
+      size_t numOfIndices() const;
+      size_t stride() const; ///< The number of floats per vertex
+
+      std::vector<GLuint> const &indices() const;
+      /**
+       * The positions of the vertices, formats has to describe the mesh
+       * the geometry was read from
+       */
+      std::vector<glm::vec3> positions(std::vector<std::pair<AttributeAccessor, Shader::Format>> const &formats) const;
+
+      /**
+       * Appends the geometry transformed by the model matrix to the given
+       * lists. Positions are transformed as points, normals, binormals and
+       * tangents by the normal matrix, every other attribute is copied
+       */
+      void appendTo(std::vector<GLfloat> &vertices, std::vector<GLushort> &indices,
+                    std::vector<std::pair<AttributeAccessor, Shader::Format>> const &formats,
+                    glm::mat4 const &model, glm::mat3 const &normalMatrix) const;
+      /**
+       * Like appendTo, but writes to lists that already have room for the
+       * geometry and adds base to the indices. Different parts of the lists
+       * can be written by different threads
+       */
+      void transformTo(GLfloat *vertices, GLushort *indices, GLushort base,
+                       std::vector<std::pair<AttributeAccessor, Shader::Format>> const &formats,
+                       glm::mat4 const &model, glm::mat3 const &normalMatrix) const;
+  };
+}
+}
+
+#endif
@@ -21,28 +21,55 @@
 #define BULLETMANAGER_HPP
 
 #include <string>
+#include <memory>
 #include <unordered_map>
-#include <BulletWorldImporter/btBulletWorldImporter.h>
+
+#include "dim/scene/scene.hpp"
+
+#include <btBulletDynamicsCommon.h>
 
 namespace dim
 {
   /**
-   * A class to handle resources from disk. This class makes it possible to
-   * request a set of bullet objects as filename and the class will then keep
-   * a copy to make sure the set of bullet objects is not loaded twice
+   * A class to handle collision shapes. Shapes are requested by name and
+   * loaded or built only once, so all the nodes of one model share the same
+   * shape. A shape lives as long as the manager or any body using it
    */
   class BulletManager
   {
-      std::unordered_map<std::string, btBulletWorldImporter> d_bulletMap;
+      std::unordered_map<std::string, std::shared_ptr<btCollisionShape>> d_shapeMap;
 
     public:
+      enum ShapeType
+      {
+        triangleMesh,         ///< The exact geometry, only for static bodies
+        convexHull,           ///< One hull around the whole Scene
+        convexDecomposition   ///< A compound of one hull per mesh of the Scene
+      };
+
       /**
-       * Either loads a set of bullet objects or returns the copy from an
-       * earlier load
+       * Either loads the last shape of a bullet file or returns the copy
+       * from an earlier load
        */
-      btBulletWorldImporter &request(std::string const &filename);
+      std::shared_ptr<btCollisionShape> request(std::string const &filename);
+      /**
+       * Either builds a shape from the geometry of the Scene or returns the
+       * copy from an earlier request with the same name
+       */
+      std::shared_ptr<btCollisionShape> request(std::string const &name, Scene const &scene, ShapeType type);
 
-      void remove(std::string const &filename); ///< Removes the stored loaded copy
+      /**
+       * Writes the shape in bullet's binary format, so it can be requested
+       * from that file next time
+       */
+      void bake(std::string const &name, std::string const &filename) const;
+
+      void remove(std::string const &name); ///< Removes the stored copy, bodies keep their shape
+
+      /**
+       * A body that keeps its shape alive. Bodies with a mass of 0 are static
+       */
+      static std::shared_ptr<btRigidBody> createBody(std::shared_ptr<btCollisionShape> const &shape, float mass, btMotionState *motionState);
   };
 }
 
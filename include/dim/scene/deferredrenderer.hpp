@@ -0,0 +1,88 @@
+// deferredrenderer.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#ifndef DEFERREDRENDERER_HPP
+#define DEFERREDRENDERER_HPP
+
+#include <string>
+#include <vector>
+
+#include "dim/core/surface.hpp"
+#include "dim/core/doublebufferedsurface.hpp"
+#include "dim/core/lightgrid.hpp"
+#include "dim/core/uniformblock.hpp"
+
+namespace dim
+{
+  /**
+   * Renders in two passes. The geometry pass draws a scene into the targets
+   * of a G-buffer, the light pass shades every pixel once with a full screen
+   * quad that loops over the lights of its cluster in a LightGrid, so the
+   * cost of lighting no longer grows with the number of objects or their
+   * overdraw. The layout of the G-buffer is chosen by Types and the targets
+   * added to gBuffer(), for example an RGBA8 albedo, an RGB10A2 or RG16
+   * packed normal, an R11G11B10 emission and a D32 depth target
+   */
+  template<typename ...Types>
+  class DeferredRenderer
+  {
+      Surface<Types...> d_gBuffer;
+      DoubleBufferedSurface<GLfloat> d_output;
+      LightGrid d_lightGrid;
+      UniformBlock<ViewBlock> d_view;
+      UniformBlock<LightBlock> d_lights;
+
+    public:
+      DeferredRenderer(uint width, uint height, NormalizedFormat firstTarget, Format outputFormat = Format::R11G11B10);
+      DeferredRenderer(uint width, uint height, Format firstTarget, Format outputFormat = Format::R11G11B10);
+
+      Surface<Types...> &gBuffer();
+      DoubleBufferedSurface<GLfloat> &output(); ///< Holds the composite of the last light pass
+      LightGrid &lightGrid(); ///< Used by the light pass that isn't given a grid
+
+      /**
+       * Draws the scene with the shaders of renderMode, which write the
+       * G-buffer targets instead of a colour
+       */
+      template<typename SceneType>
+      void geometryPass(SceneType &scene, Camera const &camera, size_t renderMode);
+
+      /**
+       * The G-buffer targets are bound to in_gbuffer0, in_gbuffer1 and so on,
+       * in the texture units of the same number. The camera and the
+       * directional lights are in the ViewBlock and the LightBlock, the
+       * other lights go through the light grid
+       */
+      void lightPass(Shader const &shader, Camera const &camera, std::vector<Light> const &lights);
+      /**
+       * Shades with a light grid that was already built and uploaded for the
+       * camera and the lights, like the one of the snapshot a SceneGraph drew
+       */
+      void lightPass(Shader const &shader, Camera const &camera, std::vector<Light> const &lights,
+                     LightGrid const &lightGrid);
+
+      template<typename SceneType>
+      void render(SceneType &scene, Camera const &camera, size_t renderMode, Shader const &lightShader);
+  };
+}
+
+#include "dim/scene/deferredrenderer.inl"
+
+#endif
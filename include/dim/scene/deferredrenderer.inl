@@ -0,0 +1,139 @@
+// deferredrenderer.inl
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+namespace dim
+{
+namespace internal
+{
+  template<size_t Index>
+  struct GBufferBinder
+  {
+    template<typename SurfaceType>
+    static void bind(SurfaceType &surface)
+    {
+      GBufferBinder<Index - 1>::bind(surface);
+      Shader::set("in_gbuffer" + std::to_string(Index - 1), surface.template texture<Index - 1>(), Index - 1);
+    }
+  };
+
+  template<>
+  struct GBufferBinder<0>
+  {
+    template<typename SurfaceType>
+    static void bind(SurfaceType &surface)
+    {
+    }
+  };
+}
+
+  template<typename ...Types>
+  DeferredRenderer<Types...>::DeferredRenderer(uint width, uint height, NormalizedFormat firstTarget, Format outputFormat)
+  :
+    d_gBuffer(width, height, firstTarget, Filtering::nearest),
+    d_output(width, height, outputFormat, Filtering::linear),
+    d_view(Shader::viewBlock),
+    d_lights(Shader::lightBlock)
+  {
+  }
+
+  template<typename ...Types>
+  DeferredRenderer<Types...>::DeferredRenderer(uint width, uint height, Format firstTarget, Format outputFormat)
+  :
+    d_gBuffer(width, height, firstTarget, Filtering::nearest),
+    d_output(width, height, outputFormat, Filtering::linear),
+    d_view(Shader::viewBlock),
+    d_lights(Shader::lightBlock)
+  {
+  }
+
+  template<typename ...Types>
+  Surface<Types...> &DeferredRenderer<Types...>::gBuffer()
+  {
+    return d_gBuffer;
+  }
+
+  template<typename ...Types>
+  DoubleBufferedSurface<GLfloat> &DeferredRenderer<Types...>::output()
+  {
+    return d_output;
+  }
+
+  template<typename ...Types>
+  LightGrid &DeferredRenderer<Types...>::lightGrid()
+  {
+    return d_lightGrid;
+  }
+
+  template<typename ...Types>
+  template<typename SceneType>
+  void DeferredRenderer<Types...>::geometryPass(SceneType &scene, Camera const &camera, size_t renderMode)
+  {
+    d_gBuffer.setBlending(false);
+    d_gBuffer.renderTo(true);
+
+    scene.draw(camera, renderMode);
+  }
+
+  template<typename ...Types>
+  void DeferredRenderer<Types...>::lightPass(Shader const &shader, Camera const &camera, std::vector<Light> const &lights)
+  {
+    d_lightGrid.build(camera, lights);
+    d_lightGrid.upload();
+
+    lightPass(shader, camera, lights, d_lightGrid);
+  }
+
+  template<typename ...Types>
+  void DeferredRenderer<Types...>::lightPass(Shader const &shader, Camera const &camera, std::vector<Light> const &lights,
+                                             LightGrid const &lightGrid)
+  {
+    d_output.renderTo(true, true);
+    internal::setBlending(false);
+
+    // the geometry pass may have bound the blocks of another camera
+    d_view.set(ViewBlock::fromCamera(camera));
+    d_view.upload();
+    d_view.bind();
+
+    d_lights.set(LightBlock::fromLights(lights));
+    d_lights.upload();
+    d_lights.bind();
+
+    shader.use();
+    shader.set("in_viewport", glm::vec2(d_gBuffer.width(), d_gBuffer.height()));
+
+    internal::GBufferBinder<sizeof...(Types)>::bind(d_gBuffer);
+
+    lightGrid.bind();
+
+    glDepthMask(false);
+    drawFullscreenQuad();
+    glDepthMask(true);
+  }
+
+  template<typename ...Types>
+  template<typename SceneType>
+  void DeferredRenderer<Types...>::render(SceneType &scene, Camera const &camera, size_t renderMode, Shader const &lightShader)
+  {
+    geometryPass(scene, camera, renderMode);
+
+    // drawing the scene built and uploaded the grid for this camera already
+    lightPass(lightShader, camera, scene.lights(), scene.lightGrid());
+  }
+}
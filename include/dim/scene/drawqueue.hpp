@@ -0,0 +1,89 @@
+// drawqueue.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef DRAWQUEUE_HPP
+#define DRAWQUEUE_HPP
+
+#include <vector>
+
+#include "dim/scene/nodestoragebase.hpp"
+
+namespace dim
+{
+namespace internal
+{
+  /**
+   * A list of nodes to draw this frame, keyed on their distance to the
+   * camera. Ranges of the list are sorted with a radix sort on that key.
+   * Only the keys and the indices of the items move, the items stay where
+   * they were added
+   */
+  class DrawQueue
+  {
+    public:
+      enum Order
+      {
+        frontToBack,
+        backToFront
+      };
+
+      struct Item
+      {
+        glm::mat4 matrix; ///< A copy, so the node can move while the item is drawn
+        ShaderScene const *state;
+      };
+
+    private:
+      struct Key
+      {
+        GLuint key;
+        GLuint item; ///< Index in d_items
+      };
+
+      std::vector<Item> d_items;
+      std::vector<Key> d_keys;   ///< In drawing order once sorted
+      std::vector<Key> d_buffer;
+
+      Order d_order;
+      glm::mat4 d_view;
+
+    public:
+      explicit DrawQueue(Order order);
+
+      void setView(glm::mat4 const &view); ///< The view matrix used to find the depth of added nodes
+
+      void add(glm::mat4 const &matrix, ShaderScene const &state);
+      /**
+       * Sorts the items in [first, last) in the order of the queue. After
+       * reserveSort, ranges that don't overlap can be sorted at the same time
+       */
+      void sort(size_t first, size_t last);
+      void reserveSort(); ///< Sizes the scratch space for every item in the queue
+      void clear();
+
+      size_t size() const;
+      Item const &operator[](size_t idx) const; ///< In sorted order
+
+    private:
+      GLuint depthKey(float depth) const;
+  };
+}
+}
+
+#endif
@@ -0,0 +1,130 @@
+// dynamicbatch.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef DYNAMICBATCH_HPP
+#define DYNAMICBATCH_HPP
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "dim/scene/nodestoragebase.hpp"
+#include "dim/scene/batchgeometry.hpp"
+#include "dim/core/streambuffer.hpp"
+
+namespace dim
+{
+namespace internal
+{
+  /**
+   * Collects the small meshes of moving nodes during a frame and draws them
+   * with one draw call per material. The vertices are transformed on the
+   * CPU by the JobSystem and written to a StreamBuffer when they are drawn.
+   * The matrices are copied when the nodes are added, so neither transforming
+   * nor drawing looks at the nodes
+   */
+  class DynamicBatch
+  {
+      typedef std::unordered_map<GLuint, std::pair<Mesh, BatchGeometry>> GeometryCache;
+
+      struct Part
+      {
+        BatchGeometry const *geometry;
+        glm::mat4 matrix;
+        size_t firstVertex; ///< Where the part goes in the vertices and indices of its group
+        size_t firstIndex;
+        GLushort base;      ///< Added to its indices, they count from the start of the chunk
+      };
+
+      struct Chunk ///< Vertices that can be drawn with 16 bit indices
+      {
+        size_t firstVertex;
+        size_t numOfVertices;
+        size_t firstIndex;
+        size_t numOfIndices;
+      };
+
+      struct Group
+      {
+        ShaderScene state;
+        std::vector<Part> parts;
+        std::vector<GLfloat> vertices;
+        std::vector<GLushort> indices;
+        std::vector<Chunk> chunks;
+      };
+
+      std::vector<Group> d_groups;
+      std::vector<std::pair<Group*, Part const*>> d_work; ///< The parts of all groups, for transform
+      std::shared_ptr<GeometryCache> d_geometry;
+
+      size_t d_maxVertices;
+
+      StreamBuffer d_stream;
+      bool d_transformed;
+      bool d_streaming; ///< Whether this frame has written to the stream
+
+      size_t d_numOfDrawCalls;
+      size_t d_numOfNodes;
+
+    public:
+      static size_t const streamSize = 1 << 22; ///< The bytes a frame can stream before it waits for the GPU
+
+      explicit DynamicBatch(size_t maxVertices = 0);
+
+      /**
+       * Meshes with at most this number of vertices are batched, 0 turns
+       * dynamic batching off
+       */
+      void setMaxVertices(size_t maxVertices);
+      size_t maxVertices() const;
+
+      bool batchable(DrawState const &drawState) const;
+      void add(ShaderScene const &state, DrawState const &drawState, glm::mat4 const &matrix);
+
+      /**
+       * Transforms the vertices of everything added this frame, spread over
+       * the JobSystem. Doesn't use GL, so it can run before drawing starts
+       */
+      void transform();
+
+      size_t size() const; ///< The number of materials that have been batched
+      bool empty(size_t group) const; ///< Whether nothing was collected for this material this frame
+      ShaderScene const &state(size_t group) const;
+      void draw(size_t group, size_t renderMode); ///< Transforms first when transform wasn't called
+
+      void clear(); ///< Starts a new frame, the transformed vertices keep their storage
+      void clearCache(); ///< Forgets the CPU copies of the batched meshes
+
+      /**
+       * Lets other use the CPU copies of the meshes of this batch. Adding to
+       * one batch while the other draws is fine, clearCache is not
+       */
+      void shareCache(DynamicBatch &other) const;
+
+      size_t numOfDrawCalls() const; ///< Draw calls issued since the last clear
+      size_t numOfNodes() const; ///< Nodes batched since the last clear
+
+    private:
+      BatchGeometry const &geometry(DrawState const &drawState);
+      void layout(Group &group); ///< Splits the group into chunks and places its parts
+  };
+}
+}
+
+#endif
@@ -21,6 +21,7 @@
 #define FILEDRAWNODE_HPP
 
 #include <string>
+#include <memory>
 #include <unordered_map>
 
 #include "dim/scene/nodebase.hpp"
@@ -30,20 +31,22 @@
 #include "dim/scene/shadermanager.hpp"
 #include "dim/scene/bulletmanager.hpp"
 #include "dim/core/shader.hpp"
+#include "dim/util/pool.hpp"
 
 #include <BulletDynamics/Dynamics/btRigidBody.h>
 
 namespace dim
 {
 
-  class FileDrawNode : public NodeBase
+  class FileDrawNode : public NodeBase, public PoolAllocated<FileDrawNode>
   {
       struct Object
       {
           std::string filename;
           std::vector<Shader> shaders;
           std::vector<Scene> scenes;
-          //btRigidBody rigidBody;
+          std::vector<std::shared_ptr<btCollisionShape>> shapes; ///< One per scene, may be empty
+          std::vector<float> masses;
       };
 
       static std::vector<Object> &objects();
@@ -52,9 +55,14 @@ namespace dim
 
       uint d_sceneIdx;
 
+      std::shared_ptr<btRigidBody> d_rigidBody;
+
     public:
       FileDrawNode();
       FileDrawNode(std::string const &filename, glm::vec3 const &coor, glm::quat const &orient, glm::vec3 const &scale);
+      FileDrawNode(FileDrawNode const &other);
+
+      FileDrawNode &operator=(FileDrawNode const &other);
 
       static void setDefaultShaders(std::vector<Shader> const &shaders);
 
@@ -74,6 +82,9 @@ namespace dim
     private:
       static std::vector<Shader> &defaultShaders();
 
+      void createBody(); ///< Every node gets a body of its own around the shared shape
+      void replaceBody(); ///< createBody for a node that may be in a graph
+
       void insert(std::ostream &out) const override;
       void extract(std::istream &in) override;
   };
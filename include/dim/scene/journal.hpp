@@ -0,0 +1,119 @@
+// journal.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <cstdint>
+
+namespace dim
+{
+namespace internal
+{
+  /**
+   * Keeps a base file with the saved nodes and a journal next to it with
+   * the changes made since. Changes are appended on a thread of the
+   * journal. Once the journal outgrows its limit it is merged into a new
+   * base, which is synced to disk and replaces the old one with a rename,
+   * so a crash never leaves a half written base. A record torn by a crash
+   * is dropped on replay.
+   *
+   * The base holds the same records as the journal behind a header line,
+   * the nodes in it are keyed by id. SceneGraph::save writes the nodes
+   * one after the other without ids, SceneGraph::loadJournal turns such a
+   * file into a base before opening its journal
+   */
+  class Journal
+  {
+    public:
+      struct Record
+      {
+        enum Type : char
+        {
+          put = 'p',   ///< Adds the node or replaces the saved one
+          remove = 'd',
+          clear = 'c'  ///< Removes all nodes
+        };
+
+        Type type;
+        uint64_t id;
+        std::string data; ///< The node as written by operator<<
+      };
+
+    private:
+      std::string d_filename;
+      size_t d_maxSize;
+
+      std::ofstream d_journal;
+      size_t d_size;
+
+      std::vector<Record> d_queue;
+      bool d_writing;
+      bool d_running;
+
+      std::mutex d_mutex;
+      std::condition_variable d_condition;
+      std::thread d_writer;
+
+    public:
+      Journal(std::string const &filename, size_t maxSize);
+      ~Journal(); ///< Writes what was appended before returning
+
+      Journal(Journal const &other) = delete;
+      Journal &operator=(Journal const &other) = delete;
+
+      void append(std::vector<Record> &&records); ///< Returns at once, the records are written by the journal thread
+      void flush(); ///< Waits until every appended record is written
+      void setMaxSize(size_t maxSize);
+
+      /**
+       * The nodes in the base with the journal replayed on top, by id
+       */
+      static std::map<uint64_t, std::string> replay(std::string const &filename);
+
+      static std::string journalName(std::string const &filename);
+      static bool plain(std::string const &filename); ///< Whether filename lacks the header of a base, like the files written by save
+
+      /**
+       * Replaces filename with a base holding the nodes, false when it
+       * couldn't be written. The journal is left alone
+       */
+      static bool writeBase(std::string const &filename, std::map<uint64_t, std::string> const &nodes);
+
+    private:
+      void run();
+      void write(std::vector<Record> const &records);
+      void compact();
+
+      static bool read(std::istream &in, Record &record); ///< False at the end or at a torn record
+      static void write(std::ostream &out, Record const &record);
+      static bool apply(std::string const &filename, std::map<uint64_t, std::string> &nodes); ///< False when the file ends in a torn record
+  };
+}
+}
+
+#endif
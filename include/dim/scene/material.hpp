@@ -0,0 +1,75 @@
+// material.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#ifndef MATERIAL_HPP
+#define MATERIAL_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "dim/core/texture.hpp"
+
+namespace dim
+{
+
+/**
+ * The textures and lighting parameters of a DrawState. Materials don't
+ * change once made, equal materials are interned into one table entry and
+ * compared by the 32-bit id of that entry
+ */
+class Material
+{
+    std::vector<std::pair<Texture<GLubyte>, std::string>> d_textures; ///< Sorted by texture id
+    glm::vec3 d_ambient;
+    glm::vec3 d_diffuse;
+    glm::vec3 d_specular;
+    float d_shininess;
+    bool d_transparent;
+    size_t d_hash;
+
+  public:
+    explicit Material(std::vector<std::pair<Texture<GLubyte>, std::string>> const &textures = {},
+                      glm::vec3 const &ambient = glm::vec3(1.0), glm::vec3 const &diffuse = glm::vec3(1.0),
+                      glm::vec3 const &specular = glm::vec3(1.0), float shininess = 0, bool transparent = false);
+
+    std::vector<std::pair<Texture<GLubyte>, std::string>> const &textures() const;
+    glm::vec3 const &ambientIntensity() const;
+    glm::vec3 const &diffuseIntensity() const;
+    glm::vec3 const &specularIntensity() const;
+    float shininess() const;
+    bool transparent() const; ///< Transparent materials are blended and drawn back to front after the opaque ones
+
+    size_t hash() const;
+    bool operator==(Material const &other) const;
+
+    /**
+     * The id of the interned copy of the material, which is added to the
+     * table when no equal material was interned before. Safe to call from
+     * any thread, the interned materials are never moved or removed
+     */
+    static uint32_t intern(Material const &material);
+    static Material const &get(uint32_t id);
+    static size_t numOfMaterials();
+};
+
+}
+
+#endif
@@ -0,0 +1,58 @@
+// meshlet.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef MESHLET_HPP
+#define MESHLET_HPP
+
+#include <vector>
+
+#include "dim/core/dim.hpp"
+
+namespace dim
+{
+  /**
+   * A run of triangles in the element buffer of a mesh, small enough to
+   * be culled on its own. Bounds are in model space
+   */
+  struct Meshlet
+  {
+    size_t firstIndex;
+    size_t numOfIndices;
+    glm::vec3 center;   ///< Of the bounding sphere
+    float radius;
+    glm::vec3 coneAxis; ///< Average facing direction of the triangles
+    float coneAngle;    ///< Angle between the axis and the most deviating normal, pi when the triangles face all ways
+
+    /**
+     * True when every triangle faces away from eye, given in model space.
+     * Counter clockwise triangles are front facing
+     */
+    bool backFacing(glm::vec3 const &eye) const;
+  };
+
+  /**
+   * Splits the triangles into consecutive meshlets of at most maxVertices
+   * distinct vertices and maxTriangles triangles, the indices are not
+   * reordered
+   */
+  std::vector<Meshlet> buildMeshlets(std::vector<glm::vec3> const &positions, std::vector<GLuint> const &indices,
+                                     size_t maxVertices = 64, size_t maxTriangles = 126);
+}
+
+#endif
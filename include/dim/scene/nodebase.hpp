@@ -35,12 +35,24 @@ namespace dim
 {
   class NodeBase;
 
+  /**
+   * Bullet asks kinematic bodies for their transform on the physics thread,
+   * so it reads a copy instead of the node. A node outside a SceneGraph
+   * keeps the copy up to date itself, inside one the graph hands the
+   * transforms over to the physics thread
+   */
   class MotionState : public btMotionState
   {
       NodeBase *d_node;
+      btTransform d_transform;
+
     public:
       MotionState(NodeBase *node);
 
+      NodeBase *node() const;
+
+      void setTransform(btTransform const &transform); ///< Only while no other thread steps the body
+
     private:
       virtual void getWorldTransform(btTransform &worldTransform) const;
 
@@ -65,10 +77,14 @@ namespace dim
       glm::vec3 d_scale;
       glm::mat4 d_modelMatrix;
       bool d_changed;
+      bool d_static;
+      bool d_modified; ///< Changed since it was last written to a journal
 
     public:
       NodeBase(glm::vec3 const &coor, glm::quat const &orient, glm::vec3 const &scale);
       NodeBase();
+      NodeBase(NodeBase const &other); ///< The copy gets a motion state of its own
+      NodeBase &operator=(NodeBase const &other);
 
       virtual ~NodeBase();
 
@@ -80,6 +96,9 @@ namespace dim
       virtual btRigidBody *rigidBody() = 0;
 
       virtual void updateNode(NodeBase *node, glm::vec3 const &from, glm::vec3 const &to){};
+      virtual void changedNode(NodeBase *node){};
+      virtual void attachBody(NodeBase *node){}; ///< Called after a node in the graph replaced its body
+      virtual void detachBody(NodeBase *node){}; ///< Called before a node in the graph replaces its body
 
       glm::vec3 location() const;
       void setLocation(glm::vec3 const &coor);
@@ -93,9 +112,20 @@ namespace dim
       glm::mat4 const &matrix();
 
       MotionState *motionState();
+      btTransform bodyTransform() const; ///< The location and orientation for bullet
 
       void setChanged();
 
+      bool isStatic() const;
+      void setStatic(bool isStatic);
+
+      /**
+       * The transform setters mark the node, nodes changing other state that
+       * is written by insert have to mark themselves
+       */
+      bool modified() const;
+      void setModified(bool modified = true);
+
       virtual void draw();
 
     protected:
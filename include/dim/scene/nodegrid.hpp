@@ -28,10 +28,20 @@
 #include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <sstream>
+#include <cstdint>
+#include <type_traits>
 
 #include "dim/scene/nodestoragebase.hpp"
-#include "dim/util/ptrvector.hpp"
+#include "dim/scene/staticbatch.hpp"
+#include "dim/scene/dynamicbatch.hpp"
+#include "dim/scene/drawqueue.hpp"
+#include "dim/scene/journal.hpp"
+#include "dim/util/slotmap.hpp"
 #include "dim/util/copyptr.hpp"
+#include "dim/util/framearena.hpp"
+#include "dim/util/pool.hpp"
+#include "dim/core/jobsystem.hpp"
 
 #include <glm/gtc/matrix_inverse.hpp>
 
@@ -43,17 +53,51 @@ namespace internal
   class NodeGrid : public NodeStorageBase
   {
       typedef Onepair<long, 10000000> Key;
-      typedef std::unordered_map<Key, PtrVector<RefType>, Key::Hash, std::equal_to<Key>> Storage;
+
+      struct Member
+      {
+        RefType *node;
+        Handle handle; ///< The handle of the node in d_nodes
+        bool visible;  ///< Set by cull
+      };
+
+      struct Entry
+      {
+        RefType *node;
+        Key cell;
+        Handle slot; ///< The handle of the node in its cell
+        uint64_t id; ///< Identifies the node in journals
+        bool pooled; ///< Made by create, given back through destroy
+      };
+
+      /// Types deriving from PoolAllocated already take their memory from a Pool
+      typedef std::integral_constant<bool, not std::is_base_of<PoolAllocated<RefType>, RefType>::value> Pooled;
+
+      typedef SlotMap<Member> Cell;
+      typedef std::unordered_map<Key, Cell, Key::Hash, std::equal_to<Key>> Storage;
       
+      typedef std::unordered_map<Key, StaticBatch, Key::Hash, std::equal_to<Key>> BatchStorage;
+
       Storage d_map;
+      SlotMap<Entry> d_nodes; ///< Owns the nodes, the handles stay valid while nodes move between cells
+      BatchStorage d_batches;
 
       size_t d_gridSize;
       
       size_t d_numOfShaders;
 
+      bool d_staticBatching;
+
+      uint64_t d_lastId;
+      std::vector<uint64_t> d_removed; ///< Ids of the nodes deleted since the last collectChanges
+      bool d_cleared;
+
     public:
     // constuctors
       NodeGrid();
+      NodeGrid(NodeGrid const &other);
+      NodeGrid &operator=(NodeGrid const &other);
+      ~NodeGrid();
 
       void setGridSize(size_t gridSize);
       void setNumOfShaders(size_t numOfShaders);
@@ -76,6 +120,7 @@ namespace internal
         void increment();
         bool equal(CopyPtr<Iterable> const &other) const;
         void erase();
+        Handle handle() const;
 
         virtual void v_increment();
         virtual NodeBase &v_dereference();
@@ -99,20 +144,70 @@ namespace internal
 
     public:
     // regular functions
-      iterator add(bool changing, RefType *object);
+      /**
+       * Nodes the graph makes itself, when loading or copying, come from the
+       * Pool of RefType. Add them with pooled set, so they are given back to it
+       */
+      template<typename ...Args>
+      static RefType *create(Args &&...args);
+      static void destroy(RefType *node, bool pooled);
+
+      Handle add(bool changing, RefType *object, uint64_t id = 0, bool pooled = false); ///< Id 0 gives the node a new id
       iterator find(float x, float z);
 
+      RefType *get(Handle handle); ///< 0 when the node was deleted
+      bool erase(Handle handle);   ///< Deletes the node, false when it was deleted already
+
+      /**
+       * Records the nodes added, modified or deleted since the last call and
+       * unmarks the nodes. Finding the modified nodes reads one flag per node.
+       * With all set the records replace everything with the current nodes
+       */
+      void collectChanges(std::vector<Journal::Record> &records, bool all = false);
+
+      /**
+       * These call the nodes through RefType, so the calls are resolved at
+       * compile time when RefType is final. SceneGraph reaches them through
+       * its tuple of storages, the virtual versions forward to them
+       */
+      void cull(Visibility const &visibility); ///< Spread over the JobSystem by cell
+      void collect(ShaderScene const &state, DrawQueue &queue, DynamicBatch &dynamicBatch);
+      void rebuildStatic(std::vector<std::shared_ptr<StaticMesh>> &retired);
+      void collectStatic(ShaderScene const &state, std::vector<std::shared_ptr<StaticMesh>> &meshes,
+                         Visibility const &visibility);
+      bool updateNode(NodeBase *node, glm::vec3 const &from, glm::vec3 const &to);
+      bool changedNode(NodeBase *node);
+      void setStaticBatching(bool batching);
+
     private:
       void v_clear() override;
-      void v_draw(ShaderScene const &state, size_t renderMode) override;
+      void v_cull(Visibility const &visibility) override;
+      void v_collect(ShaderScene const &state, DrawQueue &queue, DynamicBatch &dynamicBatch) override;
+      void v_rebuildStatic(std::vector<std::shared_ptr<StaticMesh>> &retired) override;
+      void v_collectStatic(ShaderScene const &state, std::vector<std::shared_ptr<StaticMesh>> &meshes,
+                           Visibility const &visibility) override;
       NodeStorageBase::iterator v_find(NodeBase *node) override;
       NodeStorageBase::iterator v_find(float x, float z) override;
       NodeStorageBase::iterator v_find(ShaderScene const &state, float x, float z) override;
       void v_del(NodeStorageBase::iterator &object) override;
       bool v_updateNode(NodeBase *node, glm::vec3 const &from, glm::vec3 const &to) override;
+      bool v_changedNode(NodeBase *node) override;
+      void v_setStaticBatching(bool batching) override;
 
     // private functions
       size_t count() const;
+      Key cell(glm::vec3 const &location) const;
+      void place(Handle handle);
+      void remove(Entry const &entry);
+      void deleteNodes();
+      void cloneNodes();
+
+      template<typename ...Args>
+      static RefType *allocate(std::true_type, Args &&...args);
+      template<typename ...Args>
+      static RefType *allocate(std::false_type, Args &&...args);
+      static void release(std::true_type, RefType *node);
+      static void release(std::false_type, RefType *node);
   };
   
 }
@@ -38,10 +38,59 @@ namespace internal
   NodeGrid<RefType>::NodeGrid()
       :
         d_gridSize(0),
-        d_numOfShaders(0)
+        d_numOfShaders(0),
+        d_staticBatching(false),
+        d_lastId(0),
+        d_cleared(false)
   {
   }
 
+  template<typename RefType>
+  NodeGrid<RefType>::NodeGrid(NodeGrid const &other)
+      :
+        NodeStorageBase(other),
+        d_map(other.d_map),
+        d_nodes(other.d_nodes),
+        d_batches(other.d_batches),
+        d_gridSize(other.d_gridSize),
+        d_numOfShaders(other.d_numOfShaders),
+        d_staticBatching(other.d_staticBatching),
+        d_lastId(other.d_lastId),
+        d_removed(other.d_removed),
+        d_cleared(other.d_cleared)
+  {
+    cloneNodes();
+  }
+
+  template<typename RefType>
+  NodeGrid<RefType> &NodeGrid<RefType>::operator=(NodeGrid const &other)
+  {
+    if(this == &other)
+      return *this;
+
+    deleteNodes();
+
+    NodeStorageBase::operator=(other);
+    d_map = other.d_map;
+    d_nodes = other.d_nodes;
+    d_batches = other.d_batches;
+    d_gridSize = other.d_gridSize;
+    d_numOfShaders = other.d_numOfShaders;
+    d_staticBatching = other.d_staticBatching;
+    d_lastId = other.d_lastId;
+    d_removed = other.d_removed;
+    d_cleared = other.d_cleared;
+
+    cloneNodes();
+    return *this;
+  }
+
+  template<typename RefType>
+  NodeGrid<RefType>::~NodeGrid()
+  {
+    deleteNodes();
+  }
+
   /* iterators */
 
   template<typename RefType>
@@ -119,13 +168,13 @@ namespace internal
   template<typename RefType>
   RefType &NodeGrid<RefType>::Iterable::dereference()
   {
-    return *d_mapIterator->second[d_listIdx];
+    return *d_mapIterator->second[d_listIdx].node;
   }
 
   template<typename RefType>
   RefType const &NodeGrid<RefType>::Iterable::dereference() const
   {
-    return *d_mapIterator->second[d_listIdx];
+    return *d_mapIterator->second[d_listIdx].node;
   }
 
   template<typename RefType>
@@ -137,8 +186,14 @@ namespace internal
   template<typename RefType>
   void NodeGrid<RefType>::Iterable::erase()
   {
-    auto &list = d_mapIterator->second;
-    list.erase(list.begin() + d_listIdx);
+    // the last node of the cell takes the place of this one, so the iterator stays usable
+    d_container->erase(handle());
+  }
+
+  template<typename RefType>
+  Handle NodeGrid<RefType>::Iterable::handle() const
+  {
+    return d_mapIterator->second[d_listIdx].handle;
   }
 
   template <typename RefType>
@@ -199,76 +254,250 @@ namespace internal
   template <typename RefType>
   size_t NodeGrid<RefType>::count() const
   {
-    size_t count = 0;
-    for(auto mapPart : d_map)
-      count += mapPart.second.size();
+    return d_nodes.size();
+  }
+
+  template <typename RefType>
+  typename NodeGrid<RefType>::Key NodeGrid<RefType>::cell(glm::vec3 const &location) const
+  {
+    int xloc, zloc;
+    xloc = location.x / d_gridSize;
+    zloc = location.z / d_gridSize;
 
-    return count;
+    return Key(xloc, zloc);
   }
   
   /* regular functions */
 
   template<typename RefType>
-  typename NodeGrid<RefType>::iterator NodeGrid<RefType>::add(bool changing, RefType *object)
+  void NodeGrid<RefType>::place(Handle handle)
   {
-    int xloc, zloc;
-    xloc = object->location().x / d_gridSize;
-    zloc = object->location().z / d_gridSize;
+    Entry &entry = *d_nodes.get(handle);
 
-    auto list = d_map.find(Key(xloc, zloc));
-    if(list == d_map.end())
-      list = d_map.insert(make_pair(Key(xloc, zloc), PtrVector<RefType>{})).first;
+    entry.cell = cell(entry.node->location());
+    entry.slot = d_map[entry.cell].insert(Member{entry.node, handle, true});
 
-    //std::pair<size_t, DrawNode::Key> id(list.size(), DrawNode::Key(xloc, zloc));
+    if(d_staticBatching && entry.node->isStatic())
+      d_batches[entry.cell].setDirty();
+  }
 
-    //object.d_id = id;
-    //RefType tmp(object);
-    //tmp.d_id = id;
+  template<typename RefType>
+  void NodeGrid<RefType>::remove(Entry const &entry)
+  {
+    d_map[entry.cell].erase(entry.slot);
 
-    auto iter = lower_bound(list->second.begin(), list->second.end(), object, [&](NodeBase const *lhs, NodeBase const *rhs) -> bool
-                            {
-                              for(size_t shader = 0; shader != d_numOfShaders; ++shader)
-                              {
-                                if(lhs->shader(shader).id() < rhs->shader(shader).id())
-                                  return true;
-                                if(lhs->shader(shader).id() != rhs->shader(shader).id())
-                                  return false;
-                              }
-
-                              return lhs->scene() < rhs->scene();
-                            });
+    if(d_staticBatching && entry.node->isStatic())
+      d_batches[entry.cell].setDirty();
+  }
+
+  template<typename RefType>
+  void NodeGrid<RefType>::deleteNodes()
+  {
+    for(Entry &entry : d_nodes)
+      destroy(entry.node, entry.pooled);
+  }
+
+  template<typename RefType>
+  void NodeGrid<RefType>::cloneNodes()
+  {
+    // the slot maps are copied as they are, so the handles of the copy match the original
+    for(auto &mapPart : d_map)
+    {
+      for(Member &member : mapPart.second)
+      {
+        Entry &entry = *d_nodes.get(member.handle);
+
+        member.node = create(*member.node);
+        entry.node = member.node;
+        entry.pooled = true;
+      }
+    }
+  }
+
+  template<typename RefType>
+  template<typename ...Args>
+  RefType *NodeGrid<RefType>::create(Args &&...args)
+  {
+    return allocate(Pooled(), std::forward<Args>(args)...);
+  }
 
-    iter = list->second.insert(iter, object);
+  template<typename RefType>
+  void NodeGrid<RefType>::destroy(RefType *node, bool pooled)
+  {
+    if(pooled)
+      release(Pooled(), node);
+    else
+      delete node;
+  }
 
-    // TODO improve efficiency
-    size_t idx = distance(list->second.begin(), iter);
+  template<typename RefType>
+  template<typename ...Args>
+  RefType *NodeGrid<RefType>::allocate(std::true_type, Args &&...args)
+  {
+    return Pool<RefType>::instance().create(std::forward<Args>(args)...);
+  }
 
-    return typename NodeGrid<RefType>::iterator(CopyPtr<Iterable>(new Iterable(idx, d_map.find(Key(xloc, zloc)), this)));
+  template<typename RefType>
+  template<typename ...Args>
+  RefType *NodeGrid<RefType>::allocate(std::false_type, Args &&...args)
+  {
+    return new RefType(std::forward<Args>(args)...);
+  }
+
+  template<typename RefType>
+  void NodeGrid<RefType>::release(std::true_type, RefType *node)
+  {
+    Pool<RefType>::instance().destroy(node);
+  }
+
+  template<typename RefType>
+  void NodeGrid<RefType>::release(std::false_type, RefType *node)
+  {
+    delete node;
+  }
+
+  template<typename RefType>
+  Handle NodeGrid<RefType>::add(bool changing, RefType *object, uint64_t id, bool pooled)
+  {
+    if(id == 0)
+      id = ++d_lastId;
+    else
+      d_lastId = std::max(d_lastId, id);
+
+    Handle handle = d_nodes.insert(Entry{object, Key(), Handle(), id, pooled});
+    place(handle);
+
+    return handle;
+  }
+
+  template<typename RefType>
+  RefType *NodeGrid<RefType>::get(Handle handle)
+  {
+    Entry *entry = d_nodes.get(handle);
+
+    return entry == 0 ? 0 : entry->node;
+  }
+
+  template<typename RefType>
+  bool NodeGrid<RefType>::erase(Handle handle)
+  {
+    Entry *entry = d_nodes.get(handle);
+    if(entry == 0)
+      return false;
+
+    remove(*entry);
+    d_removed.push_back(entry->id);
+    destroy(entry->node, entry->pooled);
+    d_nodes.erase(handle);
+
+    return true;
   }
 
   template<typename RefType>
   void NodeGrid<RefType>::v_clear()
   {
+    deleteNodes();
+    d_nodes.clear();
     d_map.clear();
+    d_batches.clear();
+
+    d_removed.clear();
+    d_cleared = true;
   }
 
   template<typename RefType>
-  void NodeGrid<RefType>::v_draw(ShaderScene const &scene, size_t renderMode)
+  void NodeGrid<RefType>::collectChanges(std::vector<Journal::Record> &records, bool all)
   {
-    //TODO optimize optimize optimize
-    for(auto mapPart : d_map)
+    if(all)
     {
-      for(NodeBase *node : mapPart.second)
+      d_removed.clear();
+      d_cleared = true;
+    }
+
+    if(d_cleared)
+    {
+      records.push_back(Journal::Record{Journal::Record::clear, 0, std::string()});
+      d_cleared = false;
+    }
+
+    for(uint64_t id : d_removed)
+      records.push_back(Journal::Record{Journal::Record::remove, id, std::string()});
+    d_removed.clear();
+
+    std::ostringstream out;
+    for(Entry &entry : d_nodes)
+    {
+      if(not all && not entry.node->modified())
+        continue;
+
+      out.str(std::string());
+      out << *entry.node;
+
+      records.push_back(Journal::Record{Journal::Record::put, entry.id, out.str()});
+      entry.node->setModified(false);
+    }
+  }
+
+  template<typename RefType>
+  void NodeGrid<RefType>::cull(Visibility const &visibility)
+  {
+    FrameArena::Scope scope;
+
+    FrameVector<Cell*> cells;
+    cells.reserve(d_map.size());
+    for(auto &mapPart : d_map)
+      cells.push_back(&mapPart.second);
+
+    // every node is in one cell, so each job only touches its own nodes
+    JobSystem::instance().parallelFor(cells.size(), [&](size_t idx)
+                                      {
+                                        for(Member &member : *cells[idx])
+                                        {
+                                          RefType *node = member.node;
+                                          member.visible = visibility.visible(transformSphere(node->scene().bounds(), node->matrix()));
+                                        }
+                                      }, 1);
+  }
+
+  template<typename RefType>
+  void NodeGrid<RefType>::v_cull(Visibility const &visibility)
+  {
+    cull(visibility);
+  }
+
+  template<typename RefType>
+  void NodeGrid<RefType>::collect(ShaderScene const &state, DrawQueue &queue, DynamicBatch &dynamicBatch)
+  {
+    bool transparent = state.state().transparent();
+
+    for(auto &mapPart : d_map)
+    {
+      for(Member &member : mapPart.second)
       {
-        for(size_t idx = 0; idx != node->scene().size(); ++idx)
+        if(not member.visible)
+          continue;
+
+        RefType *node = member.node;
+        Scene const &scene = node->scene();
+
+        for(size_t idx = 0; idx != scene.size(); ++idx)
         {
-          if(node->scene()[idx] == scene.state())
-          {
-            glm::mat3 normalMatrix(glm::inverseTranspose(node->matrix()));
-            node->shader(renderMode).set("in_mat_model", node->matrix());
-            node->shader(renderMode).set("in_mat_normal", normalMatrix);
+          DrawState const &drawState = scene[idx];
 
-            scene.state().mesh().draw();
+          if(drawState == state.state())
+          {
+            // already part of the merged geometry of this cell
+            if(d_staticBatching && StaticBatch::batchable(drawState, node->isStatic()))
+              break;
+
+            // small meshes are streamed together after all the states are drawn
+            if(not transparent && dynamicBatch.batchable(drawState))
+            {
+              dynamicBatch.add(state, drawState, node->matrix());
+              break;
+            }
+
+            queue.add(node->matrix(), state);
             break;
           }
         }
@@ -276,6 +505,60 @@ namespace internal
     }
   }
 
+  template<typename RefType>
+  void NodeGrid<RefType>::v_collect(ShaderScene const &state, DrawQueue &queue, DynamicBatch &dynamicBatch)
+  {
+    collect(state, queue, dynamicBatch);
+  }
+
+  template<typename RefType>
+  void NodeGrid<RefType>::rebuildStatic(std::vector<std::shared_ptr<StaticMesh>> &retired)
+  {
+    if(not d_staticBatching)
+      return;
+
+    for(auto &mapPart : d_map)
+    {
+      StaticBatch &batch = d_batches[mapPart.first];
+
+      if(batch.dirty())
+      {
+        FrameArena::Scope scope;
+
+        FrameVector<NodeBase*> nodes;
+        nodes.reserve(mapPart.second.size());
+        for(Member &member : mapPart.second)
+          nodes.push_back(member.node);
+
+        batch.rebuild(nodes, d_numOfShaders, retired);
+      }
+    }
+  }
+
+  template<typename RefType>
+  void NodeGrid<RefType>::v_rebuildStatic(std::vector<std::shared_ptr<StaticMesh>> &retired)
+  {
+    rebuildStatic(retired);
+  }
+
+  template<typename RefType>
+  void NodeGrid<RefType>::collectStatic(ShaderScene const &state, std::vector<std::shared_ptr<StaticMesh>> &meshes,
+                                        Visibility const &visibility)
+  {
+    if(not d_staticBatching)
+      return;
+
+    for(auto const &batch : d_batches)
+      batch.second.collect(state, meshes, visibility);
+  }
+
+  template<typename RefType>
+  void NodeGrid<RefType>::v_collectStatic(ShaderScene const &state, std::vector<std::shared_ptr<StaticMesh>> &meshes,
+                                          Visibility const &visibility)
+  {
+    collectStatic(state, meshes, visibility);
+  }
+
   template<typename RefType>
   void NodeGrid<RefType>::v_del(NodeStorageBase::iterator &object)
   {
@@ -332,7 +615,7 @@ namespace internal
 
     for(size_t idx = 0; idx != mapPart->second.size(); ++idx)
     {
-      if(mapPart->second[idx] == node)
+      if(mapPart->second[idx].node == node)
         return NodeStorageBase::iterator(ClonePtr<NodeStorageBase::Iterable>(new NodeGrid::Iterable(idx, mapPart, this)));
     }
 
@@ -352,7 +635,7 @@ namespace internal
 
     for(size_t idx = 0; idx != mapPart->second.size(); ++idx)
     {
-      glm::vec3 coor = mapPart->second[idx]->location();
+      glm::vec3 coor = mapPart->second[idx].node->location();
 
       if((coor.x - x) * (coor.x - x) + (coor.z - z) * (coor.z - z) < 1)
         return typename NodeGrid<RefType>::iterator(CopyPtr<Iterable>(new NodeGrid::Iterable(idx, mapPart, this)));
@@ -362,7 +645,7 @@ namespace internal
   }
 
   template<typename RefType>
-  bool NodeGrid<RefType>::v_updateNode(NodeBase *node, glm::vec3 const &from, glm::vec3 const &to)
+  bool NodeGrid<RefType>::updateNode(NodeBase *node, glm::vec3 const &from, glm::vec3 const &to)
   {
     // check if we have to delete from this
     int xloc, zloc;
@@ -373,13 +656,14 @@ namespace internal
     if(mapPart == d_map.end())
       return false; // it is not in this nodegrid
 
-    for(size_t idx = 0; idx != mapPart->second.size(); ++idx)
+    for(Member &member : mapPart->second)
     {
-      if(mapPart->second[idx] == node)
+      if(member.node == node)
       {
-        mapPart->second.erase(mapPart->second.begin() + idx);
+        Handle handle = member.handle;
 
-        add(true, reinterpret_cast<RefType *>(node));
+        remove(*d_nodes.get(handle));
+        place(handle);
 
         return true; // it is here
       }
@@ -387,5 +671,52 @@ namespace internal
 
     return false;
   }
+
+  template<typename RefType>
+  bool NodeGrid<RefType>::v_updateNode(NodeBase *node, glm::vec3 const &from, glm::vec3 const &to)
+  {
+    return updateNode(node, from, to);
+  }
+
+  template<typename RefType>
+  bool NodeGrid<RefType>::changedNode(NodeBase *node)
+  {
+    Key key = cell(node->location());
+
+    auto mapPart = d_map.find(key);
+    if(mapPart == d_map.end())
+      return false; // it is not in this nodegrid
+
+    auto member = std::find_if(mapPart->second.begin(), mapPart->second.end(), [node](Member const &other)
+                               {
+                                 return other.node == node;
+                               });
+    if(member == mapPart->second.end())
+      return false;
+
+    if(d_staticBatching)
+      d_batches[key].setDirty();
+
+    return true;
+  }
+
+  template<typename RefType>
+  bool NodeGrid<RefType>::v_changedNode(NodeBase *node)
+  {
+    return changedNode(node);
+  }
+
+  template<typename RefType>
+  void NodeGrid<RefType>::setStaticBatching(bool batching)
+  {
+    d_staticBatching = batching;
+    d_batches.clear();
+  }
+
+  template<typename RefType>
+  void NodeGrid<RefType>::v_setStaticBatching(bool batching)
+  {
+    setStaticBatching(batching);
+  }
 }
 }
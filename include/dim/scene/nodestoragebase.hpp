@@ -29,11 +29,14 @@
 #include <iostream>
 #include <algorithm>
 #include <tuple>
+#include <deque>
+#include <cstdint>
 
 #include "dim/scene/nodebase.hpp"
 #include "dim/scene/iteratorbase.hpp"
 #include "dim/util/onepair.hpp"
 #include "dim/util/copyptr.hpp"
+#include "dim/core/frustum.hpp"
 
 namespace dim
 {
@@ -43,64 +46,55 @@ namespace dim
     private:
       std::vector<GLuint> d_shaderIds;
 
-      static std::unordered_map<GLuint, Shader> &shaderMap()
-      {
-        static std::unordered_map<GLuint, Shader> map;
-        return map;
-      }
+      /**
+       * Equal draw states share one copy, so a ShaderScene only refers to it
+       * and its id. The copy and its id go back when the last ShaderScene
+       * referring to them goes, which frees the buffers of the mesh
+       */
+      struct StateTable;
+      struct Release;
 
-      DrawState d_state;
+      static StateTable &stateTable();
 
-    public:
-      ShaderScene(NodeBase const &node, size_t sceneIdx, size_t numOfShaders)
-      :
-        d_shaderIds(),
-        d_state(node.scene()[sceneIdx])
-      {
-        for(size_t shader = 0; shader != numOfShaders; ++shader)
-        {
-          GLuint shaderId = node.shader(shader).id();
+      std::shared_ptr<DrawState const> d_state;
+      uint32_t d_stateId;
 
-          d_shaderIds.push_back(shaderId); // Will this work?
-          if(shaderMap().find(shaderId) == shaderMap().end())
-            shaderMap().insert(std::make_pair(shaderId, node.shader(shader)));
-        }
-      }
+    public:
+      ShaderScene(NodeBase const &node, size_t sceneIdx, size_t numOfShaders);
 
       size_t numOfShaders() const
       {
         return d_shaderIds.size();
       }
 
-      Shader &shader(size_t idx)
-      {
-        auto iter = shaderMap().find(d_shaderIds.at(idx));
-        if(iter == shaderMap().end())
-          throw log(__FILE__, __LINE__, LogType::error, "This should never throw, bug in the ShaderScene code");
-
-        return iter->second;
-      }
+      Shader &shader(size_t idx);
+      Shader const &shader(size_t idx) const;
 
-      Shader const &shader(size_t idx) const
+      DrawState const &state() const
       {
-        auto iter = shaderMap().find(d_shaderIds.at(idx));
-        if(iter == shaderMap().end())
-          throw log(__FILE__, __LINE__, LogType::error, "This should never throw, bug in the ShaderScene code");
-
-        return iter->second;
+        return *d_state;
       }
 
-      DrawState &state()
+      uint32_t stateId() const
       {
-        return d_state;
+        return d_stateId;
       }
 
-      DrawState const &state() const
+      bool operator==(ShaderScene const &other) const
       {
-        return d_state;
+        if(other.numOfShaders() != numOfShaders())
+          throw log(__FILE__, __LINE__, LogType::error, "This should never throw, bug in the ShaderScene code");
+
+        for(size_t shader = 0; shader != numOfShaders(); ++shader)
+        {
+          if(d_shaderIds[shader] != other.d_shaderIds[shader])
+            return false;
+        }
+
+        return d_stateId == other.d_stateId;
       }
 
-      bool operator==(ShaderScene const &other) const
+      bool sameMaterial(ShaderScene const &other) const
       {
         if(other.numOfShaders() != numOfShaders())
           throw log(__FILE__, __LINE__, LogType::error, "This should never throw, bug in the ShaderScene code");
@@ -111,7 +105,7 @@ namespace dim
             return false;
         }
 
-        return d_state == other.d_state;
+        return d_state->materialId() == other.d_state->materialId();
       }
 
       bool operator<(ShaderScene const &other) const
@@ -127,15 +121,36 @@ namespace dim
             return false;
         }
 
-        if(d_state < other.d_state)
-          return true;
-
-        return false;
+        return *d_state < *other.d_state;
       }
   };
 
 namespace internal
 {
+  class DynamicBatch;
+  class DrawQueue;
+  struct StaticMesh;
+
+  /**
+   * Decides which bounding spheres are drawn in a frame. Besides the ones
+   * outside the frustum it skips the ones that cover less than detail
+   * units per unit of distance from the eye, see SceneGraph::setDetailCulling
+   */
+  struct Visibility
+  {
+    Frustum frustum;
+    glm::vec3 eye;
+    float detail;
+
+    bool visible(glm::vec4 const &sphere) const
+    {
+      if(not frustum.visible(sphere))
+        return false;
+
+      return sphere.w >= detail * glm::length(glm::vec3(sphere) - eye);
+    }
+  };
+
   class NodeStorageBase
   {
     public:
@@ -177,21 +192,33 @@ namespace internal
     public:
     // regular functions
       void clear();
-      void draw(ShaderScene const &state, size_t renderMode);
+      void cull(Visibility const &visibility); ///< Decides which nodes collect adds
+      void collect(ShaderScene const &state, DrawQueue &queue, DynamicBatch &dynamicBatch);
+      void rebuildStatic(std::vector<std::shared_ptr<StaticMesh>> &retired); ///< Rebuilds the static batches that changed
+      void collectStatic(ShaderScene const &state, std::vector<std::shared_ptr<StaticMesh>> &meshes,
+                         Visibility const &visibility);
       iterator find(ShaderScene const &state, float x, float z);
       iterator find(float x, float z);
       iterator find(NodeBase* node);
       void del(iterator &object);
       bool updateNode(NodeBase *node, glm::vec3 const &from, glm::vec3 const &to);
+      bool changedNode(NodeBase *node);
+      void setStaticBatching(bool batching);
 
     private:
       virtual void v_clear() = 0;
-      virtual void v_draw(ShaderScene const &state, size_t renderMode) = 0;
+      virtual void v_cull(Visibility const &visibility) = 0;
+      virtual void v_collect(ShaderScene const &state, DrawQueue &queue, DynamicBatch &dynamicBatch) = 0;
+      virtual void v_rebuildStatic(std::vector<std::shared_ptr<StaticMesh>> &retired) = 0;
+      virtual void v_collectStatic(ShaderScene const &state, std::vector<std::shared_ptr<StaticMesh>> &meshes,
+                                   Visibility const &visibility) = 0;
       virtual iterator v_find(NodeBase *node) = 0;
       virtual iterator v_find(float x, float z) = 0;
       virtual iterator v_find(ShaderScene const &state, float x, float z) = 0;
       virtual void v_del(iterator &object) = 0;
       virtual bool v_updateNode(NodeBase *node, glm::vec3 const &from, glm::vec3 const &to) = 0;
+      virtual bool v_changedNode(NodeBase *node) = 0;
+      virtual void v_setStaticBatching(bool batching) = 0;
   };
 }
 }
@@ -0,0 +1,110 @@
+// physicsquery.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef PHYSICSQUERY_HPP
+#define PHYSICSQUERY_HPP
+
+#include <vector>
+
+#include "dim/scene/nodebase.hpp"
+
+#include <btBulletDynamicsCommon.h>
+
+namespace dim
+{
+  struct Ray
+  {
+    glm::vec3 from;
+    glm::vec3 to;
+  };
+
+  /**
+   * A sphere moving from one point to another
+   */
+  struct Sweep
+  {
+    glm::vec3 from;
+    glm::vec3 to;
+    float radius;
+  };
+
+  struct Overlap
+  {
+    glm::vec3 center;
+    float radius;
+  };
+
+  struct QueryHit
+  {
+    btCollisionObject const *object; ///< 0 when nothing was hit
+    NodeBase *node;                  ///< The node owning the body, if any
+    glm::vec3 point;
+    glm::vec3 normal;
+    float fraction;
+
+    bool hit() const
+    {
+      return object != 0;
+    }
+  };
+
+namespace internal
+{
+  /**
+   * Runs batches of queries on the JobSystem against a copy of the
+   * broadphase. Only capture needs the world to hold still, the queries
+   * themselves can run while the physics thread steps. The shapes are not
+   * copied, so bodies must not be deleted between capture and the queries
+   */
+  class PhysicsQuery
+  {
+      struct Body
+      {
+        btCollisionObject *object;
+        btTransform transform;
+        btBroadphaseProxy proxy; ///< Only the collision filter is used
+        NodeBase *node;          ///< 0 unless the body belongs to a node
+      };
+
+      std::vector<Body> d_bodies;
+      btDbvt d_trees[2]; ///< The moving and the static tree of the broadphase
+
+    public:
+      PhysicsQuery() = default;
+      PhysicsQuery(PhysicsQuery const &other) = delete;
+      PhysicsQuery &operator=(PhysicsQuery const &other) = delete;
+
+      void capture(btDbvtBroadphase const &broadphase); ///< While the world is locked
+
+      void rayTest(std::vector<Ray> const &rays, std::vector<QueryHit> &hits) const;
+      void sweepTest(std::vector<Sweep> const &sweeps, std::vector<QueryHit> &hits) const;
+      /**
+       * Convex shapes are tested exactly, other shapes by their bounding box
+       */
+      void overlapTest(std::vector<Overlap> const &overlaps, std::vector<std::vector<NodeBase*>> &nodes) const;
+
+    private:
+      QueryHit ray(Ray const &query) const;
+      QueryHit sweep(Sweep const &query) const;
+      void overlap(Overlap const &query, std::vector<NodeBase*> &nodes) const;
+  };
+}
+}
+
+#endif
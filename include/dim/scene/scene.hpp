@@ -26,6 +26,11 @@
 #include "dim/core/texture.hpp"
 #include "dim/core/shader.hpp"
 #include "dim/scene/texturemanager.hpp"
+#include "dim/scene/material.hpp"
+#include "dim/scene/animationclip.hpp"
+#include "dim/scene/meshlet.hpp"
+#include "dim/scene/batchgeometry.hpp"
+#include "dim/core/frustum.hpp"
 
 namespace dim
 {
@@ -35,17 +40,42 @@ class DrawState
     friend class Scene;
 
     Mesh d_mesh;
-    std::vector<std::pair<Texture<GLubyte>, std::string>> d_textures;
-    glm::vec3 d_ambient;
-    glm::vec3 d_diffuse;
-    glm::vec3 d_specular;
-    float d_shininess;
-
-    DrawState(Mesh const &mesh, std::vector<std::pair<Texture<GLubyte>, std::string>> const &textures);
+    std::shared_ptr<internal::BatchGeometry> d_geometry; ///< Shared by the copies of the state
+    std::vector<Meshlet> d_meshlets;
+    glm::vec4 d_bounds;
+    Material const *d_material; ///< The interned copy of the material
+    uint32_t d_materialId;
+    uint64_t d_serial; ///< Shared by the copies of the state
+
+    /**
+     * Without a geometry a mesh the batches can merge is read back here, on
+     * the GL thread, so the snapshots never read the GPU
+     */
+    DrawState(Mesh const &mesh, std::vector<std::pair<Texture<GLubyte>, std::string>> const &textures,
+              internal::BatchGeometry &&geometry = internal::BatchGeometry());
   
   public:
     std::vector<std::pair<Texture<GLubyte>, std::string>> const &textures() const;
     Mesh const &mesh() const;
+    std::vector<Meshlet> const &meshlets() const; ///< Empty unless the scene was loaded with Scene::splitMeshlets
+    /**
+     * The bounding sphere of the mesh in model space, see boundingSphere.
+     * Only meshes loaded from a file know their bounds
+     */
+    glm::vec4 const &bounds() const;
+    /**
+     * The vertices and indices of the mesh in main memory. Meshes loaded
+     * from a file keep the copy they were created from and meshes the
+     * batches can merge are copied when the state is made, reading those
+     * is safe on any thread. Other meshes are read back from the GPU the
+     * first time, so that call has to be on the GL thread
+     */
+    internal::BatchGeometry const &geometry() const;
+
+    Material const &material() const;
+    uint32_t materialId() const;
+    uint64_t serial() const; ///< Tells the meshes of the states apart, unlike the names of the GL buffers it is never reused
+    void setMaterial(Material const &material);
     
     void setTextures(std::vector<std::pair<Texture<GLubyte>, std::string>> const &param);
     void setMaterial(glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, float shininess);
@@ -55,10 +85,21 @@ class DrawState
     glm::vec3 const &specularIntensity() const;
     float shininess() const;
 
-    bool operator==(DrawState const &other) const;
+    void setTransparent(bool transparent); ///< Transparent states are blended and drawn back to front after the opaque ones
+    bool transparent() const;
+
+    bool operator==(DrawState const &other) const; ///< Compares the serial and the id of the material
     bool operator<(DrawState const &other) const;
+    bool sameMaterial(DrawState const &other) const; ///< Equal material ids, the meshes may differ
 
     void draw() const;
+    /**
+     * Skips the meshlets facing away from eye and the ones outside the
+     * frustum, both given in model space. States without meshlets are drawn
+     * whole. SceneGraph draws the nodes loaded with Scene::splitMeshlets
+     * this way
+     */
+    void draw(glm::vec3 const &eye, Frustum const &frustum = Frustum()) const;
 };
 
 class Scene
@@ -80,6 +121,10 @@ public:
     load2BoneWeights,
     load4BoneWeights,
     //load8BoneWeights
+    splitMeshlets,
+    optimizeVertexCache, ///< Reorders triangles and vertices at import and logs the cache statistics
+    packVertices,        ///< See packMesh, positions are quantized to the bounds of every mesh
+    halfPositions,       ///< Packs the vertices with half float positions
   };
 
   Scene() = default;
@@ -91,6 +136,8 @@ public:
 	void add(Mesh const &mesh, std::vector<std::pair<Texture<GLubyte>, std::string>> const &textures = {});
 
   void draw() const;
+  void draw(glm::vec3 const &eye) const; ///< See DrawState::draw(eye)
+  glm::vec4 bounds() const; ///< Around the bounds of all the states
 
   DrawState &operator[](size_t idx);
   DrawState const &operator[](size_t idx) const;
@@ -102,6 +149,16 @@ public:
 
   static std::vector<GLfloat> loadPointData(std::string const &filename, std::vector<Option> list = {});
   static std::pair<std::vector<GLfloat>, Bone> loadPointDataAndBones(std::string const &filename, std::vector<Option> list = {});
+  /**
+   * The bone indices match the boneId attribute of the meshes loaded from the
+   * same file, so one palette of bone matrices serves all of its meshes
+   */
+  static Bone loadBones(std::string const &filename, std::vector<Option> list = {});
+  /**
+   * Animated nodes that aren't bones are skipped, keys closer than tolerance
+   * to the interpolation of their neighbours are dropped
+   */
+  static std::vector<AnimationClip> loadAnimations(std::string const &filename, std::vector<Option> list = {}, float tolerance = 0.0001);
 };
 }
 
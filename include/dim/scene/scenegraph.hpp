@@ -21,17 +21,31 @@
 #define DRAWMAP_HPP
 
 #include "dim/scene/nodegrid.hpp"
+#include "dim/scene/physicsquery.hpp"
 #include "dim/scene/scene.hpp"
 #include "dim/util/ptrvector.hpp"
 #include "dim/core/camera.hpp"
 #include "dim/core/light.hpp"
+#include "dim/core/lightgrid.hpp"
+#include "dim/core/uniformblock.hpp"
+#include "dim/core/jobsystem.hpp"
 #include "dim/util/tupleforeach.hpp"
+#include "dim/util/triplebuffer.hpp"
+#include "dim/util/framearena.hpp"
+#include "dim/util/pool.hpp"
 
 #include <vector>
 #include <map>
 #include <string>
 #include <iostream>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <iterator>
+#include <cmath>
 
 #include <btBulletDynamicsCommon.h>
 #include <BulletCollision/CollisionDispatch/btGhostObject.h>
@@ -51,10 +65,127 @@ namespace dim
   //{
   //};
 
+namespace internal
+{
+  /**
+   * The transforms of the moving bodies after one physics step
+   */
+  struct PhysicsState
+  {
+    struct Transform
+    {
+      NodeBase *node;
+      glm::vec3 coor;
+      glm::quat orient;
+    };
+
+    std::vector<Transform> transforms;
+    std::chrono::steady_clock::time_point time;
+    size_t epoch = 0; ///< States from before a body was removed are ignored
+  };
+
+  /**
+   * The transforms of the kinematic bodies, handed from the render thread
+   * to the physics thread before a step
+   */
+  struct KinematicState
+  {
+    struct Transform
+    {
+      MotionState *motionState;
+      btTransform transform;
+    };
+
+    std::vector<Transform> transforms;
+    size_t epoch = 0;
+  };
+
+  /**
+   * Everything draw needs from the visible nodes of one frame. It only
+   * refers to the draw states of the graph, never to the nodes, so the nodes
+   * can change while it is drawn
+   */
+  struct RenderSnapshot
+  {
+    struct Bucket
+    {
+      ShaderScene const *state;
+      size_t first; ///< The range of the bucket in the opaque queue
+      size_t last;
+      size_t firstStatic; ///< The range of the bucket in the static meshes
+      size_t lastStatic;
+    };
+
+    Camera camera;
+    glm::vec3 eye;              ///< For the meshlet culling, in world space
+    glm::mat4 viewProjection;
+    std::vector<Light> lights;
+    LightGrid lightGrid;
+
+    DrawQueue opaqueQueue;
+    DrawQueue transparentQueue;
+    std::vector<Bucket> buckets;
+    std::vector<std::shared_ptr<StaticMesh>> staticMeshes;
+    std::vector<std::shared_ptr<StaticMesh>> retired; ///< Dropped where the snapshot is drawn, they may hold GL buffers
+    DynamicBatch dynamicBatch;
+
+    RenderSnapshot()
+    :
+      opaqueQueue(DrawQueue::frontToBack),
+      transparentQueue(DrawQueue::backToFront)
+    {
+    }
+
+    void clear()
+    {
+      opaqueQueue.clear();
+      transparentQueue.clear();
+      buckets.clear();
+      std::move(staticMeshes.begin(), staticMeshes.end(), std::back_inserter(retired));
+      staticMeshes.clear();
+      dynamicBatch.clear();
+    }
+
+    void release() ///< On the drawing thread, once it is done with the snapshot
+    {
+      staticMeshes.clear();
+      retired.clear();
+    }
+  };
+
+  /**
+   * The uniform blocks read by the shaders of a SceneGraph, uploaded once
+   * per drawn snapshot instead of once per program
+   */
+  struct SceneBlocks
+  {
+    UniformBlock<FrameBlock> frame;
+    UniformBlock<ViewBlock> view;
+    UniformBlock<LightBlock> lights;
+    UniformBlockArray<MaterialBlock> materials; ///< Indexed by the material id
+    StreamBuffer stream;                        ///< Holds the blocks that change every frame
+
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point previous;
+    bool started;
+
+    SceneBlocks()
+    :
+      frame(Shader::frameBlock),
+      view(Shader::viewBlock),
+      lights(Shader::lightBlock),
+      materials(Shader::materialBlock),
+      stream(4096),
+      started(false)
+    {
+    }
+  };
+}
+
   template<typename... Types>
   class SceneGraph : public NodeBase
   {
-      std::multimap<ShaderScene, internal::NodeStorageBase*> d_drawStates;
+      std::multimap<ShaderScene, size_t> d_drawStates; ///< Refers to the storages by their index in d_storages
 
       std::vector<internal::NodeStorageBase*> d_storagePtrs;
       std::tuple<internal::NodeGrid<Types>...> d_storages;
@@ -65,6 +196,12 @@ namespace dim
 
       std::vector<Light> d_lights;
 
+      TripleBuffer<internal::RenderSnapshot> d_snapshots; ///< Written by extractSnapshot, read by drawSnapshot
+      float d_detailPixels;
+      internal::SceneBlocks d_blocks;
+
+      bool d_depthPrePass;
+
     // bullet
       btDbvtBroadphase d_broadphase;
       btDefaultCollisionConfiguration d_collisionConfiguration;
@@ -73,6 +210,28 @@ namespace dim
 
       btDiscreteDynamicsWorld d_dynamicsWorld;
 
+      std::vector<std::unique_ptr<btBulletWorldImporter>> d_importers; ///< Own the objects loaded by addBulletFile
+      internal::PhysicsQuery d_query; ///< The broadphase as the last batch of queries saw it
+
+    // physics thread
+      TripleBuffer<internal::PhysicsState> d_physicsStates;
+      TripleBuffer<internal::KinematicState> d_kinematicStates;
+      std::vector<NodeBase*> d_kinematicNodes; ///< Nodes whose body was kinematic when it was added
+      internal::PhysicsState d_previousPhysicsState;
+      bool d_physicsSettled;
+
+      std::thread d_physicsThread;
+      std::mutex d_physicsMutex; ///< Guards the dynamics world
+      std::atomic<bool> d_physicsRunning;
+      float d_physicsStepTime;
+      size_t d_physicsEpoch;
+
+      bool d_deferUpdates;
+      std::vector<std::pair<NodeBase*, glm::vec3>> d_pendingUpdates;
+
+      std::map<std::string, std::unique_ptr<internal::Journal>> d_journals; ///< By the name of their base file
+      size_t d_journalLimit;
+
     public:
       virtual Shader const &shader(size_t idx) const
       {
@@ -146,29 +305,91 @@ namespace dim
       SceneGraph &operator=(SceneGraph const &other);
       SceneGraph &operator=(SceneGraph &&tmp);
 
+      ~SceneGraph();
+
     // regular functions
+      /**
+       * Takes ownership of the node. The handle stays valid until the node is
+       * deleted, after which get returns 0 for it
+       */
       template<typename RefType>
-      typename internal::NodeGrid<RefType>::iterator add(bool saved, RefType *object);
+      Handle add(bool saved, RefType *object);
 
       //btDiscreteDynamicsWorld *physicsWorld();
-      void addRigidBody(btRigidBody *rigidBody);
+      void addRigidBody(btRigidBody *rigidBody); ///< The user pointer of the body has to be 0 or the NodeBase owning it
       void updateRigidBody(btRigidBody *rigidBody);
       void addAction(btActionInterface *action);
       void addGhost(btGhostObject *ghost);
       void addBulletFile(std::string const &filename);
 
       void addLight(Light const &light);
+      std::vector<Light> const &lights() const;
+      LightGrid const &lightGrid() const; ///< Of the snapshot drawn last, built by extractSnapshot and uploaded by drawSnapshot
 
       template<typename RefType>
-      void load(std::string const &filename);
+      void load(std::string const &filename); ///< Reads files written by save, or by saveDelta through loadJournal
 
       template<typename RefType>
       void save(std::string const &filename);
       void clear();
 
+      /**
+       * Appends the nodes of RefType added, changed or deleted since the last
+       * call to the journal of filename. Only those nodes are written out
+       * here, the journal writes the file on a thread of its own and merges
+       * itself into filename once it outgrows the limit. The first delta of
+       * a graph that wasn't loaded from filename replaces its contents.
+       * Keep one node type per file
+       */
+      template<typename RefType>
+      void saveDelta(std::string const &filename);
+      template<typename RefType>
+      void loadJournal(std::string const &filename); ///< Adds the nodes of filename with its journal replayed on top, a file written by save is turned into a base first
+      void setJournalLimit(size_t maxSize); ///< The size in bytes at which a journal is merged into its base
+      void flushJournals(); ///< Waits until every delta is written
+
       void updateNode(NodeBase *node, glm::vec3 const &from, glm::vec3 const &to) override;
+      void changedNode(NodeBase *node) override;
+      void attachBody(NodeBase *node) override; ///< Adds the body of the node to the world
+      void detachBody(NodeBase *node) override;
+
+      /**
+       * Merges the static nodes of every grid cell that share a shader and
+       * textures into one pre-transformed mesh, which is only rebuilt when
+       * one of those nodes changes
+       */
+      void setStaticBatching(bool batching);
+
+      /**
+       * Moving nodes whose mesh has at most maxVertices vertices are
+       * transformed on the CPU and drawn with one draw call per material,
+       * 0 turns this off
+       */
+      void setDynamicBatching(size_t maxVertices);
+      size_t dynamicBatchDrawCalls() const; ///< Draw calls used by the dynamic batch last frame
+      size_t dynamicBatchNodes() const; ///< Nodes drawn by the dynamic batch last frame
+
+      /**
+       * Draws the opaque nodes with a depth only shader before shading them,
+       * so every pixel is shaded at most once
+       */
+      void setDepthPrePass(bool prePass);
+
+      /**
+       * Skips the nodes and static batches whose bounding sphere covers less
+       * than this number of pixels on the screen. The meshes have a single
+       * level of detail, so a far away node is either drawn in full or not
+       * at all. 0, the default, only culls against the frustum
+       */
+      void setDetailCulling(float pixels);
 
       void del(SceneGraph::iterator object);
+      template<typename RefType>
+      void del(Handle handle);
+
+      template<typename RefType>
+      RefType *get(Handle handle);
+
       SceneGraph::iterator get(float x, float z);
 
       SceneGraph::iterator get(ShaderScene const &state, float x, float z);
@@ -178,13 +399,140 @@ namespace dim
       template<typename RefType>
       typename internal::NodeGrid<RefType>::iterator get(float x, float z);
 
-      void physicsStep(float time);
+      void physicsStep(float time); ///< Ignored while the physics thread runs
+
+      /**
+       * Batched queries against the physics world, spread over the JobSystem.
+       * The world is only locked while its broadphase is copied, the queries
+       * run on the copy. Hits refer to the node owning the body, if any
+       */
+      void rayTest(std::vector<Ray> const &rays, std::vector<QueryHit> &hits);
+      void sweepTest(std::vector<Sweep> const &sweeps, std::vector<QueryHit> &hits);
+      void overlapTest(std::vector<Overlap> const &overlaps, std::vector<std::vector<NodeBase*>> &nodes);
+
+      /**
+       * Steps the physics at a fixed rate on a thread of its own. draw
+       * interpolates the nodes between the last two steps. Copies and moves
+       * of the SceneGraph don't take the thread along
+       */
+      void startPhysics(float stepTime = 1.0f / 60);
+      void stopPhysics();
+      void syncPhysics(); ///< Moves the nodes to the latest physics state, extractSnapshot calls this while the physics thread runs
+
+      /**
+       * Culls the nodes on the JobSystem and copies the matrices and draw
+       * states of the visible ones into a snapshot, so the simulation can
+       * change the nodes while drawSnapshot draws them. Call it at a point
+       * where nothing changes the graph. It doesn't use GL, the batches
+       * merge the copies of the meshes the draw states made on the GL
+       * thread. The snapshot being drawn stays untouched while the next one
+       * is filled. Ends with a reset of the FrameArena of the calling
+       * thread, so don't call it inside a FrameArena::Scope or while
+       * holding frame memory
+       */
+      void extractSnapshot(Camera const &camera);
+      void drawSnapshot(size_t renderMode); ///< Draws the last extracted snapshot
+      void draw(Camera camera, size_t renderMode); ///< Extracts and draws a snapshot at once
+
+    // deferred changes
+      /**
+       * Records changes to the graph without touching it, so any thread can
+       * fill one. Every thread fills a buffer of its own and hands it to the
+       * graph with submit, which moves it into a buffer from the Pool
+       */
+      class CommandBuffer : public PoolAllocated<CommandBuffer>
+      {
+          friend class SceneGraph;
+
+          enum Type
+          {
+            addNode,
+            moveNode,
+            orientNode,
+            scaleNode,
+            staticNode,
+            removeNode,
+            removeHandle
+          };
+
+          struct Command
+          {
+            Type type;
+            NodeBase *node;
+            Handle handle;
+            glm::vec3 value; ///< The location or scaling
+            glm::quat orient;
+            bool flag;       ///< Whether an added node is saved or a node becomes static
+            void (*apply)(SceneGraph &graph, Command const &command); ///< Applies the commands needing the type of the node
+          };
+
+          std::vector<Command> d_commands;
+          CommandBuffer *d_next; ///< The buffer submitted before this one
+
+        public:
+          CommandBuffer();
+          CommandBuffer(CommandBuffer &&tmp);
+          ~CommandBuffer(); ///< Deletes the nodes of adds that were never submitted
+
+          CommandBuffer(CommandBuffer const &other) = delete;
+          CommandBuffer &operator=(CommandBuffer const &other) = delete;
+
+          template<typename RefType>
+          void add(bool saved, RefType *object); ///< The graph takes ownership of the node once it is applied
+          template<typename RefType>
+          void del(Handle handle);
+          void del(NodeBase *node);
+
+          void setLocation(NodeBase *node, glm::vec3 const &coor);
+          void setOrientation(NodeBase *node, glm::quat const &orient);
+          void setScaling(NodeBase *node, glm::vec3 const &scale);
+          void setStatic(NodeBase *node, bool isStatic);
+
+          size_t size() const;
+
+        private:
+          Command &record(Type type, NodeBase *node);
+
+          template<typename RefType>
+          static void applyAdd(SceneGraph &graph, Command const &command);
+          template<typename RefType>
+          static void applyDel(SceneGraph &graph, Command const &command);
+      };
+
+      void submit(CommandBuffer &&buffer); ///< Can be called from any thread, only the Pool locks now and then
 
-      void draw(Camera camera, size_t renderMode);
+      /**
+       * Applies the submitted buffers: the adds first, then the changes sorted
+       * by node, keeping only the last change of a kind to a node, and the
+       * removals last. extractSnapshot starts with this, call it only where
+       * nothing else changes the graph
+       */
+      void applyCommands();
 
     private:
-      void add(ShaderScene const &state, internal::NodeStorageBase* ptr);
+      std::atomic<CommandBuffer*> d_submitted; ///< Stack of submitted buffers, the last submitted on top
+
+      static size_t phase(typename CommandBuffer::Command const &command);
+      void apply(typename CommandBuffer::Command const &command);
+
+      template<typename RefType>
+      Handle add(bool saved, RefType *object, uint64_t id, bool pooled); ///< Pooled when the node came from NodeGrid::create
+      void add(ShaderScene const &state, size_t storage);
+      internal::Journal &journal(std::string const &filename);
+      void updateBlocks(internal::RenderSnapshot const &snapshot);
+      void prepare(ShaderScene const &state, internal::RenderSnapshot &snapshot, size_t renderMode, GLuint &previousShader);
+      void drawDepth(internal::RenderSnapshot &snapshot, size_t renderMode);
+      void drawNode(ShaderScene const &state, internal::RenderSnapshot const &snapshot, glm::mat4 const &model, size_t renderMode);
+      void drawStatic(ShaderScene const &state, internal::RenderSnapshot const &snapshot,
+                      internal::RenderSnapshot::Bucket const &bucket, size_t renderMode);
       SceneGraph::iterator find(float x, float z);
+
+      void runPhysics();
+      void publishPhysics();
+      void captureQuery();
+      void publishKinematic(); ///< On the render thread
+      void applyKinematic(); ///< With the physics mutex locked
+      void flushUpdates();
   };
 
   // TODO fix
@@ -210,6 +558,13 @@ namespace dim
   template<typename RefType>
   void SceneGraph<Types...>::load(std::string const &filename)
   {
+    // a base written by a journal has the journal replayed on top
+    if(not internal::Journal::plain(filename))
+    {
+      loadJournal<RefType>(filename);
+      return;
+    }
+
     // open the file
     std::ifstream file(filename.c_str());
     if(not file.is_open())
@@ -218,35 +573,125 @@ namespace dim
       return;
     }
 
-    RefType *ref = new RefType;
+    // the graph owns what it reads, so the nodes come from the pool of RefType
+    RefType *ref = internal::NodeGrid<RefType>::create();
     while(file >> *ref)
     {
-      //TODO room for optimization
-      add(false, ref);
-      ref = new RefType;
+      add(false, ref, 0, true);
+      ref = internal::NodeGrid<RefType>::create();
     }
-    delete ref;
+    internal::NodeGrid<RefType>::destroy(ref, true);
     file.close();
 
   }
 
   template<typename... Types>
   template<typename RefType>
-  typename internal::NodeGrid<RefType>::iterator SceneGraph<Types...>::add(bool saved, RefType *object)
+  Handle SceneGraph<Types...>::add(bool saved, RefType *object)
+  {
+    return add(saved, object, 0, false);
+  }
+
+  template<typename... Types>
+  template<typename RefType>
+  Handle SceneGraph<Types...>::add(bool saved, RefType *object, uint64_t id, bool pooled)
   {
     internal::NodeGrid<RefType> &storage = dim::get<internal::NodeGrid<RefType>>(d_storages);
     object->setParent(this);
 
-    typename internal::NodeGrid<RefType>::iterator iter = storage.add(!saved, object);
+    Handle handle = storage.add(!saved, object, id, pooled);
 
     // Add the drawstate
     for(size_t idx = 0; idx != object->scene().size(); ++idx)
-      add(ShaderScene(*object, idx, d_numOfRenderModes), &storage);
+      add(ShaderScene(*object, idx, d_numOfRenderModes), internal::TypeIndex<0, RefType, Types...>::value);
+
+    attachBody(object);
+
+    return handle;
+  }
+
+  template<typename... Types>
+  template<typename RefType>
+  void SceneGraph<Types...>::saveDelta(std::string const &filename)
+  {
+    bool known = d_journals.find(filename) != d_journals.end();
+
+    std::vector<internal::Journal::Record> records;
+    dim::get<internal::NodeGrid<RefType>>(d_storages).collectChanges(records, not known);
+
+    journal(filename).append(std::move(records));
+  }
+
+  template<typename... Types>
+  template<typename RefType>
+  void SceneGraph<Types...>::loadJournal(std::string const &filename)
+  {
+    // a file written by save becomes the base of the journal, before the
+    // journal can merge itself into it
+    if(d_journals.find(filename) == d_journals.end() && internal::Journal::plain(filename))
+    {
+      std::ifstream file(filename.c_str());
+      if(file.is_open())
+      {
+        std::map<uint64_t, std::string> nodes;
+
+        RefType ref;
+        while(file >> ref)
+        {
+          std::ostringstream out;
+          out << ref;
+          nodes[nodes.size() + 1] = out.str();
+        }
+
+        if(not internal::Journal::writeBase(filename, nodes))
+          throw log(__FILE__, __LINE__, LogType::error, "Failed to turn " + filename + " into the base of a journal");
+      }
+    }
+
+    // a journal ending in a torn record is repaired when it is opened
+    internal::Journal &nodeJournal = journal(filename);
+    nodeJournal.flush();
+
+    for(auto const &node : internal::Journal::replay(filename))
+    {
+      std::istringstream in(node.second);
 
-    if(object->rigidBody() != 0)
-      d_dynamicsWorld.addRigidBody(object->rigidBody());
+      RefType *ref = internal::NodeGrid<RefType>::create();
+      if(not (in >> *ref))
+      {
+        log(__FILE__, __LINE__, LogType::warning, "Skipped a node of " + filename + " that couldn't be read");
+        internal::NodeGrid<RefType>::destroy(ref, true);
+        continue;
+      }
 
-    return iter;
+      add(false, ref, node.first, true);
+      ref->setModified(false);
+    }
+  }
+
+  template<typename... Types>
+  template<typename RefType>
+  void SceneGraph<Types...>::del(Handle handle)
+  {
+    internal::NodeGrid<RefType> &storage = dim::get<internal::NodeGrid<RefType>>(d_storages);
+
+    RefType *node = storage.get(handle);
+    if(node == 0)
+    {
+      log(__FILE__, __LINE__, LogType::warning, "Tried to delete a node through a stale handle");
+      return;
+    }
+
+    detachBody(node);
+
+    storage.erase(handle);
+  }
+
+  template<typename... Types>
+  template<typename RefType>
+  RefType *SceneGraph<Types...>::get(Handle handle)
+  {
+    return dim::get<internal::NodeGrid<RefType>>(d_storages).get(handle);
   }
 
   template<typename... Types>
@@ -64,6 +64,106 @@ namespace dim
         d_list.push_back(&storage);
       }
     };
+
+    struct Initializer
+    {
+      size_t d_gridSize;
+      size_t d_numOfShaders;
+
+      template<typename Type>
+      void operator()(Type &storage)
+      {
+        storage.setGridSize(d_gridSize);
+        storage.setNumOfShaders(d_numOfShaders);
+      }
+    };
+
+    struct Collector
+    {
+      ShaderScene const &d_state;
+      DrawQueue &d_queue;
+      DynamicBatch &d_dynamicBatch;
+
+      template<typename Type>
+      void operator()(Type &storage)
+      {
+        storage.collect(d_state, d_queue, d_dynamicBatch);
+      }
+    };
+
+    struct Culler
+    {
+      Visibility const &d_visibility;
+
+      template<typename Type>
+      void operator()(Type &storage)
+      {
+        storage.cull(d_visibility);
+      }
+    };
+
+    struct StaticRebuilder
+    {
+      std::vector<std::shared_ptr<StaticMesh>> &d_retired;
+
+      template<typename Type>
+      void operator()(Type &storage)
+      {
+        storage.rebuildStatic(d_retired);
+      }
+    };
+
+    struct StaticCollector
+    {
+      ShaderScene const &d_state;
+      std::vector<std::shared_ptr<StaticMesh>> &d_meshes;
+      Visibility const &d_visibility;
+
+      template<typename Type>
+      void operator()(Type &storage)
+      {
+        storage.collectStatic(d_state, d_meshes, d_visibility);
+      }
+    };
+
+    struct NodeUpdater
+    {
+      NodeBase *d_node;
+      glm::vec3 const &d_from;
+      glm::vec3 const &d_to;
+      bool d_found;
+
+      template<typename Type>
+      void operator()(Type &storage)
+      {
+        if(not d_found)
+          d_found = storage.updateNode(d_node, d_from, d_to);
+      }
+    };
+
+    struct NodeChanger
+    {
+      NodeBase *d_node;
+      bool d_found;
+
+      template<typename Type>
+      void operator()(Type &storage)
+      {
+        if(not d_found)
+          d_found = storage.changedNode(d_node);
+      }
+    };
+
+    struct StaticBatching
+    {
+      bool d_batching;
+
+      template<typename Type>
+      void operator()(Type &storage)
+      {
+        storage.setStaticBatching(d_batching);
+      }
+    };
   }
 
   template<typename... Types>
@@ -71,10 +171,23 @@ namespace dim
       :
           d_gridSize(gridSize),
           d_numOfRenderModes(numOfRenderModes),
+          d_detailPixels(0),
+          d_depthPrePass(false),
           d_dispatcher(&d_collisionConfiguration),
-          d_dynamicsWorld(&d_dispatcher, &d_broadphase, &d_solver, &d_collisionConfiguration)
+          d_dynamicsWorld(&d_dispatcher, &d_broadphase, &d_solver, &d_collisionConfiguration),
+          d_physicsSettled(true),
+          d_physicsRunning(false),
+          d_physicsStepTime(1.0f / 60),
+          d_physicsEpoch(0),
+          d_deferUpdates(false),
+          d_journalLimit(64 << 20),
+          d_submitted(0)
   {
     forEach(d_storages, internal::Adder{d_storagePtrs});
+    forEach(d_storages, internal::Initializer{d_gridSize, d_numOfRenderModes});
+
+    for(size_t idx = 1; idx != 3; ++idx)
+      d_snapshots.buffer(0).dynamicBatch.shareCache(d_snapshots.buffer(idx).dynamicBatch);
 
     // bullet
     d_dynamicsWorld.setGravity(btVector3(0, -10, 0));
@@ -91,13 +204,26 @@ namespace dim
       d_gridSize(other.d_gridSize),
       d_numOfRenderModes(other.d_numOfRenderModes),
       d_lights(other.d_lights),
+      d_detailPixels(other.d_detailPixels),
+      d_depthPrePass(other.d_depthPrePass),
       d_collisionConfiguration(other.d_collisionConfiguration),
       d_dispatcher(other.d_dispatcher),
       d_solver(other.d_solver),
-      d_dynamicsWorld(other.d_dynamicsWorld)
+      d_dynamicsWorld(other.d_dynamicsWorld),
+      d_physicsSettled(true),
+      d_physicsRunning(false),
+      d_physicsStepTime(other.d_physicsStepTime),
+      d_physicsEpoch(0),
+      d_deferUpdates(false),
+      d_journalLimit(other.d_journalLimit),
+      d_submitted(0)
   {
     forEach(d_storages, internal::Adder{d_storagePtrs});
 
+    for(size_t idx = 1; idx != 3; ++idx)
+      d_snapshots.buffer(0).dynamicBatch.shareCache(d_snapshots.buffer(idx).dynamicBatch);
+    setDynamicBatching(other.d_snapshots.front().dynamicBatch.maxVertices());
+
     for(NodeBase &drawNode: *this)
       drawNode.setParent(this);
   }
@@ -110,13 +236,26 @@ namespace dim
       d_gridSize(move(tmp.d_gridSize)),
       d_numOfRenderModes(move(tmp.d_numOfRenderModes)),
       d_lights(move(tmp.d_lights)),
+      d_detailPixels(tmp.d_detailPixels),
+      d_depthPrePass(tmp.d_depthPrePass),
       d_collisionConfiguration(move(tmp.d_collisionConfiguration)),
       d_dispatcher(move(tmp.d_dispatcher)),
       d_solver(move(tmp.d_solver)),
-      d_dynamicsWorld(move(tmp.d_dynamicsWorld))
+      d_dynamicsWorld(move(tmp.d_dynamicsWorld)),
+      d_physicsSettled(true),
+      d_physicsRunning(false),
+      d_physicsStepTime(tmp.d_physicsStepTime),
+      d_physicsEpoch(0),
+      d_deferUpdates(false),
+      d_journalLimit(tmp.d_journalLimit),
+      d_submitted(0)
   {
     forEach(d_storages, internal::Adder{d_storagePtrs});
 
+    for(size_t idx = 1; idx != 3; ++idx)
+      d_snapshots.buffer(0).dynamicBatch.shareCache(d_snapshots.buffer(idx).dynamicBatch);
+    setDynamicBatching(tmp.d_snapshots.front().dynamicBatch.maxVertices());
+
     for(NodeBase &drawNode: *this)
       drawNode.setParent(this);
   }
@@ -124,11 +263,20 @@ namespace dim
   template<typename... Types>
   SceneGraph<Types...> &SceneGraph<Types...>::operator=(SceneGraph const &other)
   {
+    stopPhysics();
+
+    // the nodes they refer to are replaced
+    d_kinematicNodes.clear();
+
     d_drawStates = other.d_drawStates;
     d_storages = other.d_storages;
     d_gridSize = other.d_gridSize;
     d_numOfRenderModes = other.d_numOfRenderModes;
     d_lights = other.d_lights;
+    setDynamicBatching(other.d_snapshots.front().dynamicBatch.maxVertices());
+    d_depthPrePass = other.d_depthPrePass;
+    d_detailPixels = other.d_detailPixels;
+    d_physicsStepTime = other.d_physicsStepTime;
     d_collisionConfiguration = other.d_collisionConfiguration;
     d_dispatcher = other.d_dispatcher;
     d_solver = other.d_solver;
@@ -145,11 +293,21 @@ namespace dim
   template<typename... Types>
   SceneGraph<Types...> &SceneGraph<Types...>::operator=(SceneGraph &&tmp)
   {
+    stopPhysics();
+    tmp.stopPhysics();
+
+    // the nodes they refer to are replaced
+    d_kinematicNodes.clear();
+
     d_drawStates = move(tmp.d_drawStates);
     d_storages = move(tmp.d_storages);
     d_gridSize = move(tmp.d_gridSize);
     d_numOfRenderModes = move(tmp.d_numOfRenderModes);
     d_lights = move(tmp.d_lights);
+    setDynamicBatching(tmp.d_snapshots.front().dynamicBatch.maxVertices());
+    d_depthPrePass = tmp.d_depthPrePass;
+    d_detailPixels = tmp.d_detailPixels;
+    d_physicsStepTime = tmp.d_physicsStepTime;
     d_collisionConfiguration = move(tmp.d_collisionConfiguration);
     d_dispatcher = move(tmp.d_dispatcher);
     d_solver = move(tmp.d_solver);
@@ -163,6 +321,24 @@ namespace dim
     return *this;
   }
 
+  template<typename... Types>
+  SceneGraph<Types...>::~SceneGraph()
+  {
+    stopPhysics();
+
+    // buffers that were never applied still own the nodes they add
+    for(CommandBuffer *buffer = d_submitted; buffer != 0; )
+    {
+      CommandBuffer *next = buffer->d_next;
+      delete buffer;
+      buffer = next;
+    }
+
+    // removes the loaded objects from the world before deleting them
+    for(auto &importer : d_importers)
+      importer->deleteAllData();
+  }
+
   /* iterators */
   template<typename... Types>
   typename SceneGraph<Types...>::iterator SceneGraph<Types...>::begin()
@@ -268,35 +444,52 @@ namespace dim
   void SceneGraph<Types...>::addRigidBody(btRigidBody *rigidBody)
   {
     if(rigidBody != 0)
+    {
+      std::lock_guard<std::mutex> lock(d_physicsMutex);
       d_dynamicsWorld.addRigidBody(rigidBody);
+    }
   }
 
   template<typename... Types>
   void SceneGraph<Types...>::updateRigidBody(btRigidBody *rigidBody)
   {
     if(rigidBody != 0)
+    {
+      std::lock_guard<std::mutex> lock(d_physicsMutex);
       d_dynamicsWorld.updateSingleAabb(rigidBody);
+    }
   }
 
   template<typename... Types>
   void SceneGraph<Types...>::addAction(btActionInterface *action)
   {
     if(action != 0)
+    {
+      std::lock_guard<std::mutex> lock(d_physicsMutex);
       d_dynamicsWorld.addAction(action);
+    }
   }
 
   template<typename... Types>
   void SceneGraph<Types...>::addGhost(btGhostObject *ghost)
   {
     if(ghost != 0)
+    {
+      std::lock_guard<std::mutex> lock(d_physicsMutex);
       d_dynamicsWorld.addCollisionObject(ghost, btBroadphaseProxy::CharacterFilter, btBroadphaseProxy::AllFilter);
+    }
   }
 
   template<typename... Types>
   void SceneGraph<Types...>::addBulletFile(std::string const &filename)
   {
-    static btBulletWorldImporter fileLoader(&d_dynamicsWorld);
-    fileLoader.loadFile(filename.c_str());
+    std::lock_guard<std::mutex> lock(d_physicsMutex);
+
+    std::unique_ptr<btBulletWorldImporter> importer(new btBulletWorldImporter(&d_dynamicsWorld));
+    if(importer->loadFile(filename.c_str()) == false)
+      throw log(__FILE__, __LINE__, LogType::error, "Failed to load bullet file: " + filename);
+
+    d_importers.push_back(std::move(importer));
   }
 
   template<typename... Types>
@@ -306,62 +499,642 @@ namespace dim
   }
 
   template<typename... Types>
-  void SceneGraph<Types...>::add(ShaderScene const &state, internal::NodeStorageBase* ptr)
+  std::vector<Light> const &SceneGraph<Types...>::lights() const
+  {
+    return d_lights;
+  }
+
+  template<typename... Types>
+  LightGrid const &SceneGraph<Types...>::lightGrid() const
+  {
+    return d_snapshots.front().lightGrid;
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::add(ShaderScene const &state, size_t storage)
   {
     auto range = d_drawStates.equal_range(state);
 
     for(auto iter = range.first; iter != range.second; ++iter)
     {
-      if(iter->second == ptr)
+      if(iter->second == storage)
         return;
     }
 
-    d_drawStates.insert(std::make_pair(state, ptr));
+    d_drawStates.insert(std::make_pair(state, storage));
   }
 
   template<typename... Types>
   void SceneGraph<Types...>::physicsStep(float time)
   {
-    uint substeps = std::max(1.0f, (1 / 60) / time) + 2;
-    d_dynamicsWorld.stepSimulation(time, substeps);
+    // the physics thread is the only one publishing physics states while it runs
+    if(d_physicsRunning)
+    {
+      log(__FILE__, __LINE__, LogType::warning, "physicsStep ignored, the physics thread is running");
+      return;
+    }
+
+    publishKinematic();
+
+    {
+      std::lock_guard<std::mutex> lock(d_physicsMutex);
+
+      applyKinematic();
+
+      // bullet steps 1/60 seconds at a time, one more covers the rounding
+      int substeps = static_cast<int>(std::ceil(time * 60)) + 1;
+      d_dynamicsWorld.stepSimulation(time, substeps);
+
+      publishPhysics();
+    }
+
+    syncPhysics();
   }
 
   template<typename... Types>
-  void SceneGraph<Types...>::draw(Camera camera, size_t renderMode)
+  void SceneGraph<Types...>::rayTest(std::vector<Ray> const &rays, std::vector<QueryHit> &hits)
   {
-    GLuint previousShader = 0;
+    captureQuery();
+    d_query.rayTest(rays, hits);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::sweepTest(std::vector<Sweep> const &sweeps, std::vector<QueryHit> &hits)
+  {
+    captureQuery();
+    d_query.sweepTest(sweeps, hits);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::overlapTest(std::vector<Overlap> const &overlaps, std::vector<std::vector<NodeBase*>> &nodes)
+  {
+    captureQuery();
+    d_query.overlapTest(overlaps, nodes);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::captureQuery()
+  {
+    // only the copy waits for the physics thread, not the queries
+    std::lock_guard<std::mutex> lock(d_physicsMutex);
+    d_query.capture(d_broadphase);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::startPhysics(float stepTime)
+  {
+    stopPhysics();
+
+    d_physicsStepTime = stepTime;
+    d_physicsRunning = true;
+    d_physicsThread = std::thread(&SceneGraph<Types...>::runPhysics, this);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::stopPhysics()
+  {
+    if(not d_physicsThread.joinable())
+      return;
+
+    d_physicsRunning = false;
+    d_physicsThread.join();
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::runPhysics()
+  {
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::duration step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(d_physicsStepTime));
+    Clock::time_point next = Clock::now();
+
+    while(d_physicsRunning)
+    {
+      {
+        std::lock_guard<std::mutex> lock(d_physicsMutex);
+
+        applyKinematic();
+
+        // without substeps bullet takes exactly one step of the given size
+        d_dynamicsWorld.stepSimulation(d_physicsStepTime, 0);
+
+        publishPhysics();
+      }
+
+      next += step;
+
+      // give up on catching up when the simulation can't keep up at all
+      if(Clock::now() > next + 4 * step)
+        next = Clock::now();
+
+      std::this_thread::sleep_until(next);
+    }
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::publishPhysics()
+  {
+    internal::PhysicsState &state = d_physicsStates.back();
+    state.transforms.clear();
+
+    btCollisionObjectArray &objects = d_dynamicsWorld.getCollisionObjectArray();
+    for(int idx = 0; idx != objects.size(); ++idx)
+    {
+      btRigidBody *body = btRigidBody::upcast(objects[idx]);
+      if(body == 0 || body->isStaticOrKinematicObject())
+        continue;
+
+      MotionState *motionState = dynamic_cast<MotionState*>(body->getMotionState());
+      if(motionState == 0)
+        continue;
+
+      btTransform const &transform = body->getWorldTransform();
+      btQuaternion orient = transform.getRotation();
+      btVector3 const &coor = transform.getOrigin();
+
+      state.transforms.push_back(internal::PhysicsState::Transform{motionState->node(),
+                                                                   glm::vec3(coor.x(), coor.y(), coor.z()),
+                                                                   glm::quat(orient.w(), orient.x(), orient.y(), orient.z())});
+    }
+
+    state.time = std::chrono::steady_clock::now();
+    state.epoch = d_physicsEpoch;
+
+    d_physicsStates.publish();
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::publishKinematic()
+  {
+    if(d_kinematicNodes.empty())
+      return;
+
+    internal::KinematicState &state = d_kinematicStates.back();
+    state.transforms.clear();
+
+    for(NodeBase *node : d_kinematicNodes)
+      state.transforms.push_back(internal::KinematicState::Transform{node->motionState(), node->bodyTransform()});
+
+    state.epoch = d_physicsEpoch;
+    d_kinematicStates.publish();
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::applyKinematic()
+  {
+    if(not d_kinematicStates.update())
+      return;
+
+    internal::KinematicState const &state = d_kinematicStates.front();
+
+    // bodies may have been removed since the state was published
+    if(state.epoch != d_physicsEpoch)
+      return;
+
+    for(auto const &transform : state.transforms)
+      transform.motionState->setTransform(transform.transform);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::attachBody(NodeBase *node)
+  {
+    btRigidBody *body = node->rigidBody();
+    if(body == 0)
+      return;
+
+    body->setUserPointer(node);
+
+    if(body->isKinematicObject())
+      d_kinematicNodes.push_back(node);
+
+    std::lock_guard<std::mutex> lock(d_physicsMutex);
+
+    // from now on the physics thread reads the motion state
+    node->motionState()->setTransform(node->bodyTransform());
+    d_dynamicsWorld.addRigidBody(body);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::detachBody(NodeBase *node)
+  {
+    btRigidBody *body = node->rigidBody();
+    if(body == 0)
+      return;
+
+    if(body->isKinematicObject())
+      d_kinematicNodes.erase(std::remove(d_kinematicNodes.begin(), d_kinematicNodes.end(), node), d_kinematicNodes.end());
+
+    std::lock_guard<std::mutex> lock(d_physicsMutex);
+    d_dynamicsWorld.removeRigidBody(body);
+    ++d_physicsEpoch;
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::syncPhysics()
+  {
+    if(d_physicsStates.fresh())
+    {
+      // the front buffer goes back to the physics thread after the update,
+      // swapping hands it the vector of the state before instead of copying
+      std::swap(d_previousPhysicsState, d_physicsStates.front());
+      d_physicsStates.update();
+      d_physicsSettled = false;
+    }
+    else if(d_physicsSettled)
+      return;
+
+    internal::PhysicsState const &current = d_physicsStates.front();
+    internal::PhysicsState const &previous = d_previousPhysicsState;
+
+    // some of the nodes in this state may have been deleted since
+    if(current.epoch != d_physicsEpoch)
+      return;
+
+    // the nodes lag one step behind the simulation
+    float alpha = 1;
+    if(d_physicsRunning)
+      alpha = std::min(1.0f, std::chrono::duration<float>(std::chrono::steady_clock::now() - current.time).count() / d_physicsStepTime);
+
+    d_physicsSettled = alpha == 1;
+
+    bool interpolate = alpha != 1 && previous.epoch == current.epoch && previous.transforms.size() == current.transforms.size();
+
+    d_deferUpdates = true;
+
+    for(size_t idx = 0; idx != current.transforms.size(); ++idx)
+    {
+      internal::PhysicsState::Transform const &to = current.transforms[idx];
+
+      if(interpolate && previous.transforms[idx].node == to.node)
+      {
+        to.node->setOrientation(glm::slerp(previous.transforms[idx].orient, to.orient, alpha));
+        to.node->setLocation(glm::mix(previous.transforms[idx].coor, to.coor, alpha));
+      }
+      else
+      {
+        to.node->setOrientation(to.orient);
+        to.node->setLocation(to.coor);
+      }
+    }
+
+    d_deferUpdates = false;
+
+    flushUpdates();
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::flushUpdates()
+  {
+    for(auto const &update : d_pendingUpdates)
+      updateNode(update.first, update.second, update.first->location());
+
+    d_pendingUpdates.clear();
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::updateBlocks(internal::RenderSnapshot const &snapshot)
+  {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(not d_blocks.started)
+    {
+      d_blocks.start = now;
+      d_blocks.previous = now;
+      d_blocks.started = true;
+    }
+
+    d_blocks.frame.data().time = glm::vec4(std::chrono::duration<float>(now - d_blocks.start).count(),
+                                           std::chrono::duration<float>(now - d_blocks.previous).count(), 0, 0);
+    d_blocks.previous = now;
+
+    d_blocks.view.set(ViewBlock::fromCamera(snapshot.camera));
+    d_blocks.lights.set(LightBlock::fromLights(snapshot.lights));
+
+    // materials are never removed, so only the ones interned since the last frame are added
+    for(size_t id = d_blocks.materials.size(); id < Material::numOfMaterials(); ++id)
+    {
+      Material const &material = Material::get(id);
+      d_blocks.materials.set(id, MaterialBlock{glm::vec4(material.ambientIntensity(), 1.0),
+                                               glm::vec4(material.diffuseIntensity(), 1.0),
+                                               glm::vec4(material.specularIntensity(), material.shininess())});
+    }
+
+    // a new region every frame, so the blocks are written without waiting on the previous frame
+    d_blocks.stream.nextFrame();
+    d_blocks.frame.upload(d_blocks.stream);
+    d_blocks.view.upload(d_blocks.stream);
+    d_blocks.lights.upload(d_blocks.stream);
+
+    d_blocks.materials.upload();
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::prepare(ShaderScene const &state, internal::RenderSnapshot &snapshot, size_t renderMode, GLuint &previousShader)
+  {
+    Shader const &shader = state.shader(renderMode);
+    GLuint shaderId = shader.id();
+
+    // the camera and the lights are in uniform blocks, which stay bound when the program changes
+    if(shaderId != previousShader)
+    {
+      shader.use();
+      previousShader = shaderId;
+
+      snapshot.lightGrid.bind();
+
+      // programs without the blocks, like the default shader, read the separate uniforms
+      if(not shader.hasBlock(Shader::viewBlock))
+        snapshot.camera.setAtShader("in_mat_view", "in_mat_projection");
+
+      if(not shader.hasBlock(Shader::lightBlock))
+      {
+        for(Light const &light: snapshot.lights)
+          light.setAtShader();
+      }
+    }
+
+    if(shader.hasBlock(Shader::materialBlock))
+      d_blocks.materials.bind(state.state().materialId());
+    else
+    {
+      shader.set("in_material.diffuse", state.state().diffuseIntensity());
+      shader.set("in_material.ambient", state.state().ambientIntensity());
+      shader.set("in_material.specular", state.state().specularIntensity());
+      shader.set("in_material.shininess", state.state().shininess());
+    }
+
+    for(size_t tex = 0; tex != state.state().textures().size(); ++tex)
+      shader.set(state.state().textures()[tex].second, state.state().textures()[tex].first, tex);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::extractSnapshot(Camera const &camera)
+  {
+    applyCommands();
+
+    if(d_physicsRunning)
+    {
+      publishKinematic();
+      syncPhysics();
+    }
+
+    // the snapshot being drawn and the newest one stay untouched
+    internal::RenderSnapshot &snapshot = d_snapshots.back();
+
+    snapshot.clear();
+    snapshot.camera = camera;
+    snapshot.lights = d_lights;
+    snapshot.lightGrid.build(camera, d_lights);
+
+    snapshot.opaqueQueue.setView(camera.viewMatrix());
+    snapshot.transparentQueue.setView(camera.viewMatrix());
+
+    // the radius a sphere needs per unit of distance to cover d_detailPixels,
+    // orthogonal projections don't shrink with the distance
+    glm::mat4 const &projection = camera.projectionMatrix();
+    float detail = 0;
+    if(d_detailPixels > 0 && projection[2][3] != 0)
+      detail = d_detailPixels / (projection[1][1] * camera.height() * 0.5f);
+
+    snapshot.eye = glm::vec3(glm::inverse(camera.viewMatrix())[3]);
+    snapshot.viewProjection = projection * camera.viewMatrix();
+
+    internal::Visibility visibility{Frustum(snapshot.viewProjection), snapshot.eye, detail};
+
+    // the nodes look up the matrix of the graph, which the jobs then only read
+    matrix();
+    forEach(d_storages, internal::Culler{visibility});
+
+    forEach(d_storages, internal::StaticRebuilder{snapshot.retired});
+
     for(auto const &element: d_drawStates)
     {
-      // TODO optimize optimize optimize
       ShaderScene const &state = element.first;
 
-      GLuint shaderId = state.shader(renderMode).id();
-
-      if(shaderId != previousShader)
+      // transparent nodes of all states are sorted together
+      if(state.state().transparent())
       {
-        state.shader(renderMode).use();
-        previousShader = shaderId;
+        forIndex(d_storages, element.second, internal::Collector{state, snapshot.transparentQueue, snapshot.dynamicBatch});
+        continue;
+      }
+
+      size_t first = snapshot.opaqueQueue.size();
+      forIndex(d_storages, element.second, internal::Collector{state, snapshot.opaqueQueue, snapshot.dynamicBatch});
+
+      size_t firstStatic = snapshot.staticMeshes.size();
+      forIndex(d_storages, element.second, internal::StaticCollector{state, snapshot.staticMeshes, visibility});
+
+      snapshot.buckets.push_back(internal::RenderSnapshot::Bucket{&state, first, snapshot.opaqueQueue.size(),
+                                                                  firstStatic, snapshot.staticMeshes.size()});
+    }
+
+    // the transparent queue sorts next to the buckets of the opaque queue,
+    // which don't overlap, and the batched vertices
+    JobSystem &jobSystem = JobSystem::instance();
+    JobSystem::Counter sorted;
+
+    jobSystem.run([&]()
+                  {
+                    snapshot.transparentQueue.sort(0, snapshot.transparentQueue.size());
+                  }, &sorted);
 
-        camera.setAtShader(state.shader(renderMode), "in_mat_view", "in_mat_projection");
+    snapshot.opaqueQueue.reserveSort();
+    jobSystem.run([&]()
+                  {
+                    jobSystem.parallelFor(snapshot.buckets.size(), [&](size_t idx)
+                                          {
+                                            snapshot.opaqueQueue.sort(snapshot.buckets[idx].first, snapshot.buckets[idx].last);
+                                          }, 1);
+                  }, &sorted);
+
+    // the batched vertices are ready before drawing starts
+    snapshot.dynamicBatch.transform();
+
+    jobSystem.wait(sorted);
+
+    d_snapshots.publish();
+
+    // the end of the frame for the temporaries of this thread
+    FrameArena::local().reset();
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::drawNode(ShaderScene const &state, internal::RenderSnapshot const &snapshot,
+                                      glm::mat4 const &model, size_t renderMode)
+  {
+    glm::mat3 normalMatrix(glm::inverseTranspose(model));
 
-        for(Light &light: d_lights)
-          light.setAtShader(state.shader(renderMode));
+    // packed normals aren't quantized, only the positions are
+    state.shader(renderMode).set("in_mat_model", model * state.state().mesh().positionTransform());
+    state.shader(renderMode).set("in_mat_normal", normalMatrix);
 
-        state.shader(renderMode).set("in_material.diffuse", state.state().diffuseIntensity());
-        state.shader(renderMode).set("in_material.ambient", state.state().ambientIntensity());
-        state.shader(renderMode).set("in_material.specular", state.state().specularIntensity());
-        state.shader(renderMode).set("in_material.shininess", state.state().shininess());
+    if(state.state().meshlets().empty())
+    {
+      state.state().mesh().draw();
+      return;
+    }
+
+    // the bounds of the meshlets are in model space
+    glm::vec3 eye(glm::inverse(model) * glm::vec4(snapshot.eye, 1.0));
+    state.state().draw(eye, Frustum(snapshot.viewProjection * model));
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::drawStatic(ShaderScene const &state, internal::RenderSnapshot const &snapshot,
+                                        internal::RenderSnapshot::Bucket const &bucket, size_t renderMode)
+  {
+    if(bucket.firstStatic == bucket.lastStatic)
+      return;
+
+    // the vertices are already in world space
+    state.shader(renderMode).set("in_mat_model", glm::mat4(1.0));
+    state.shader(renderMode).set("in_mat_normal", glm::mat3(1.0));
+
+    for(size_t idx = bucket.firstStatic; idx != bucket.lastStatic; ++idx)
+      snapshot.staticMeshes[idx]->draw();
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::drawDepth(internal::RenderSnapshot &snapshot, size_t renderMode)
+  {
+    // the camera comes from the view block updateBlocks bound
+    Shader const &shader = Shader::depthShader();
+
+    shader.use();
+
+    glColorMask(false, false, false, false);
+
+    for(internal::RenderSnapshot::Bucket const &bucket: snapshot.buckets)
+    {
+      Mesh const &mesh = bucket.state->state().mesh();
+
+      mesh.bind();
+      for(size_t idx = bucket.first; idx != bucket.last; ++idx)
+      {
+        shader.set("in_mat_model", snapshot.opaqueQueue[idx].matrix * mesh.positionTransform());
+        mesh.draw();
       }
+      mesh.unbind();
 
-      state.state().mesh().bind();
+      shader.set("in_mat_model", glm::mat4(1.0));
+      for(size_t idx = bucket.firstStatic; idx != bucket.lastStatic; ++idx)
+        snapshot.staticMeshes[idx]->draw();
+    }
+
+    glColorMask(true, true, true, true);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::draw(Camera camera, size_t renderMode)
+  {
+    extractSnapshot(camera);
+    drawSnapshot(renderMode);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::drawSnapshot(size_t renderMode)
+  {
+    // without a new snapshot the last one is drawn again
+    if(d_snapshots.fresh())
+    {
+      d_snapshots.front().release();
+      d_snapshots.update();
+    }
+
+    internal::RenderSnapshot &snapshot = d_snapshots.front();
+
+    snapshot.lightGrid.upload();
+    updateBlocks(snapshot);
+
+    // the shading pass relies on the GL_LEQUAL depth test set up by the window
+    if(d_depthPrePass)
+      drawDepth(snapshot, renderMode);
+
+    // opaque nodes front to back within their state
+    GLuint previousShader = 0;
+    for(internal::RenderSnapshot::Bucket const &bucket: snapshot.buckets)
+    {
+      ShaderScene const &state = *bucket.state;
 
-      for(size_t tex = 0; tex != state.state().textures().size(); ++tex)
-        state.shader(renderMode).set(state.state().textures()[tex].second, state.state().textures()[tex].first, tex);
+      prepare(state, snapshot, renderMode, previousShader);
+
+      state.state().mesh().bind();
 
-      element.second->draw(state, renderMode);
+      for(size_t idx = bucket.first; idx != bucket.last; ++idx)
+        drawNode(state, snapshot, snapshot.opaqueQueue[idx].matrix, renderMode);
 
       state.state().mesh().unbind();
+
+      drawStatic(state, snapshot, bucket, renderMode);
+    }
+
+    // the small meshes that were collected during extractSnapshot
+    for(size_t group = 0; group != snapshot.dynamicBatch.size(); ++group)
+    {
+      if(snapshot.dynamicBatch.empty(group))
+        continue;
+
+      prepare(snapshot.dynamicBatch.state(group), snapshot, renderMode, previousShader);
+      snapshot.dynamicBatch.draw(group, renderMode);
+    }
+
+    if(snapshot.transparentQueue.size() == 0)
+      return;
+
+    // transparent nodes back to front, switching state whenever it changes
+    glDepthMask(false);
+
+    ShaderScene const *current = 0;
+    for(size_t idx = 0; idx != snapshot.transparentQueue.size(); ++idx)
+    {
+      internal::DrawQueue::Item const &item = snapshot.transparentQueue[idx];
+
+      if(item.state != current)
+      {
+        if(current != 0)
+          current->state().mesh().unbind();
+
+        current = item.state;
+
+        prepare(*current, snapshot, renderMode, previousShader);
+        current->state().mesh().bind();
+      }
+
+      drawNode(*current, snapshot, item.matrix, renderMode);
     }
+    current->state().mesh().unbind();
+
+    glDepthMask(true);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::setDepthPrePass(bool prePass)
+  {
+    d_depthPrePass = prePass;
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::setDynamicBatching(size_t maxVertices)
+  {
+    for(size_t idx = 0; idx != 3; ++idx)
+      d_snapshots.buffer(idx).dynamicBatch.setMaxVertices(maxVertices);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::setDetailCulling(float pixels)
+  {
+    d_detailPixels = pixels;
+  }
+
+  template<typename... Types>
+  size_t SceneGraph<Types...>::dynamicBatchDrawCalls() const
+  {
+    return d_snapshots.front().dynamicBatch.numOfDrawCalls();
+  }
+
+  template<typename... Types>
+  size_t SceneGraph<Types...>::dynamicBatchNodes() const
+  {
+    return d_snapshots.front().dynamicBatch.numOfNodes();
   }
 
   template<typename... Types>
@@ -370,6 +1143,8 @@ namespace dim
     if(object == end())
       return;
 
+    detachBody(&*object);
+
     object.iterable()->erase();
   }
 
@@ -389,10 +1164,50 @@ namespace dim
   template<typename... Types>
   void SceneGraph<Types...>::clear()
   {
+    {
+      std::lock_guard<std::mutex> lock(d_physicsMutex);
+
+      for(NodeBase &node: *this)
+      {
+        if(node.rigidBody() != 0)
+          d_dynamicsWorld.removeRigidBody(node.rigidBody());
+      }
+
+      ++d_physicsEpoch;
+    }
+
+    d_kinematicNodes.clear();
+
     for(auto &element: d_storagePtrs)
       element->clear();
   }
 
+  template<typename... Types>
+  internal::Journal &SceneGraph<Types...>::journal(std::string const &filename)
+  {
+    std::unique_ptr<internal::Journal> &journal = d_journals[filename];
+    if(not journal)
+      journal.reset(new internal::Journal(filename, d_journalLimit));
+
+    return *journal;
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::setJournalLimit(size_t maxSize)
+  {
+    d_journalLimit = maxSize;
+
+    for(auto &journal : d_journals)
+      journal.second->setMaxSize(maxSize);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::flushJournals()
+  {
+    for(auto &journal : d_journals)
+      journal.second->flush();
+  }
+
   template<typename... Types>
   void SceneGraph<Types...>::updateNode(NodeBase *node, glm::vec3 const &from, glm::vec3 const &to)
   {
@@ -402,11 +1217,26 @@ namespace dim
         return;
     }
 
-    for(auto &storage : d_storagePtrs)
+    // moved to the right cell all at once after the physics state is applied
+    if(d_deferUpdates)
     {
-      if(storage->updateNode(node, from, to))
-        return;
+      d_pendingUpdates.push_back(std::make_pair(node, from));
+      return;
     }
+
+    forEach(d_storages, internal::NodeUpdater{node, from, to, false});
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::changedNode(NodeBase *node)
+  {
+    forEach(d_storages, internal::NodeChanger{node, false});
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::setStaticBatching(bool batching)
+  {
+    forEach(d_storages, internal::StaticBatching{batching});
   }
 
   template<typename... Types>
@@ -434,17 +1264,240 @@ namespace dim
   template<typename... Types>
   typename SceneGraph<Types...>::iterator SceneGraph<Types...>::get(ShaderScene const &state, float x, float z)
   {
-    size_t idx = 0;
+    auto range = d_drawStates.equal_range(state);
 
-    for(auto drawState = d_drawStates.find(state); drawState->first == state; ++drawState, ++idx)
+    for(auto drawState = range.first; drawState != range.second; ++drawState)
     {
-      auto iter = drawState->second->find(state, x, z);
-      if(iter != drawState->second->end())
-        return iterator(CopyPtr<Iterable>(new Iterable(iter, idx, this)));
+      internal::NodeStorageBase *storage = d_storagePtrs[drawState->second];
+
+      auto iter = storage->find(state, x, z);
+      if(iter != storage->end())
+        return iterator(CopyPtr<Iterable>(new Iterable(iter, drawState->second, this)));
     }
 
     return end();
   }
-}
 
+  /* deferred changes */
+  template<typename... Types>
+  SceneGraph<Types...>::CommandBuffer::CommandBuffer()
+  :
+      d_next(0)
+  {
+  }
+
+  template<typename... Types>
+  SceneGraph<Types...>::CommandBuffer::CommandBuffer(CommandBuffer &&tmp)
+  :
+      d_commands(std::move(tmp.d_commands)),
+      d_next(0)
+  {
+    tmp.d_commands.clear();
+  }
+
+  template<typename... Types>
+  SceneGraph<Types...>::CommandBuffer::~CommandBuffer()
+  {
+    for(Command const &command : d_commands)
+    {
+      if(command.type == addNode)
+        delete command.node;
+    }
+  }
+
+  template<typename... Types>
+  typename SceneGraph<Types...>::CommandBuffer::Command &SceneGraph<Types...>::CommandBuffer::record(Type type, NodeBase *node)
+  {
+    d_commands.push_back(Command{type, node, Handle(), glm::vec3(), glm::quat(), false, 0});
+    return d_commands.back();
+  }
+
+  template<typename... Types>
+  template<typename RefType>
+  void SceneGraph<Types...>::CommandBuffer::add(bool saved, RefType *object)
+  {
+    Command &command = record(addNode, object);
+    command.flag = saved;
+    command.apply = &CommandBuffer::template applyAdd<RefType>;
+  }
+
+  template<typename... Types>
+  template<typename RefType>
+  void SceneGraph<Types...>::CommandBuffer::del(Handle handle)
+  {
+    Command &command = record(removeHandle, 0);
+    command.handle = handle;
+    command.apply = &CommandBuffer::template applyDel<RefType>;
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::CommandBuffer::del(NodeBase *node)
+  {
+    record(removeNode, node);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::CommandBuffer::setLocation(NodeBase *node, glm::vec3 const &coor)
+  {
+    record(moveNode, node).value = coor;
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::CommandBuffer::setOrientation(NodeBase *node, glm::quat const &orient)
+  {
+    record(orientNode, node).orient = orient;
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::CommandBuffer::setScaling(NodeBase *node, glm::vec3 const &scale)
+  {
+    record(scaleNode, node).value = scale;
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::CommandBuffer::setStatic(NodeBase *node, bool isStatic)
+  {
+    record(staticNode, node).flag = isStatic;
+  }
+
+  template<typename... Types>
+  size_t SceneGraph<Types...>::CommandBuffer::size() const
+  {
+    return d_commands.size();
+  }
+
+  template<typename... Types>
+  template<typename RefType>
+  void SceneGraph<Types...>::CommandBuffer::applyAdd(SceneGraph &graph, Command const &command)
+  {
+    graph.add(command.flag, static_cast<RefType*>(command.node));
+  }
+
+  template<typename... Types>
+  template<typename RefType>
+  void SceneGraph<Types...>::CommandBuffer::applyDel(SceneGraph &graph, Command const &command)
+  {
+    graph.template del<RefType>(command.handle);
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::submit(CommandBuffer &&buffer)
+  {
+    if(buffer.size() == 0)
+      return;
+
+    CommandBuffer *submitted = new CommandBuffer(std::move(buffer));
+
+    submitted->d_next = d_submitted.load(std::memory_order_relaxed);
+    while(not d_submitted.compare_exchange_weak(submitted->d_next, submitted, std::memory_order_release,
+                                                std::memory_order_relaxed));
+  }
 
+  template<typename... Types>
+  size_t SceneGraph<Types...>::phase(typename CommandBuffer::Command const &command)
+  {
+    switch(command.type)
+    {
+      case CommandBuffer::addNode:
+        return 0;
+      case CommandBuffer::removeNode:
+      case CommandBuffer::removeHandle:
+        return 2;
+      default:
+        return 1;
+    }
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::applyCommands()
+  {
+    CommandBuffer *submitted = d_submitted.exchange(0, std::memory_order_acquire);
+    if(submitted == 0)
+      return;
+
+    // the lists only live until the commands are applied
+    FrameArena::Scope scope;
+
+    // the stack holds the last submitted buffer first
+    FrameVector<CommandBuffer*> buffers;
+    for(; submitted != 0; submitted = submitted->d_next)
+      buffers.push_back(submitted);
+
+    FrameVector<typename CommandBuffer::Command> commands;
+    for(auto buffer = buffers.rbegin(); buffer != buffers.rend(); ++buffer)
+    {
+      commands.insert(commands.end(), (*buffer)->d_commands.begin(), (*buffer)->d_commands.end());
+
+      // the graph owns the added nodes from here on
+      (*buffer)->d_commands.clear();
+      delete *buffer;
+    }
+
+    // the changes to one node end up next to each other, in the order they were recorded.
+    // stable_sort would take its buffer from the heap, so the position
+    // breaks the ties instead
+    FrameVector<size_t> order(commands.size());
+    for(size_t idx = 0; idx != order.size(); ++idx)
+      order[idx] = idx;
+
+    std::sort(order.begin(), order.end(),
+              [&](size_t lhsIdx, size_t rhsIdx)
+              {
+                typename CommandBuffer::Command const &lhs = commands[lhsIdx];
+                typename CommandBuffer::Command const &rhs = commands[rhsIdx];
+
+                size_t lhsPhase = phase(lhs);
+                size_t rhsPhase = phase(rhs);
+
+                if(lhsPhase != rhsPhase)
+                  return lhsPhase < rhsPhase;
+
+                if(lhsPhase == 1 && lhs.node != rhs.node)
+                  return std::less<NodeBase*>()(lhs.node, rhs.node);
+
+                if(lhsPhase == 1 && lhs.type != rhs.type)
+                  return lhs.type < rhs.type;
+
+                return lhsIdx < rhsIdx;
+              });
+
+    for(size_t idx = 0; idx != order.size(); ++idx)
+    {
+      typename CommandBuffer::Command const &command = commands[order[idx]];
+
+      // a later change of the same kind overrides this one
+      if(phase(command) == 1 && idx + 1 != order.size() &&
+         commands[order[idx + 1]].node == command.node && commands[order[idx + 1]].type == command.type)
+        continue;
+
+      apply(command);
+    }
+  }
+
+  template<typename... Types>
+  void SceneGraph<Types...>::apply(typename CommandBuffer::Command const &command)
+  {
+    switch(command.type)
+    {
+      case CommandBuffer::addNode:
+      case CommandBuffer::removeHandle:
+        command.apply(*this, command);
+        break;
+      case CommandBuffer::removeNode:
+        del(get(command.node));
+        break;
+      case CommandBuffer::moveNode:
+        command.node->setLocation(command.value);
+        break;
+      case CommandBuffer::orientNode:
+        command.node->setOrientation(command.orient);
+        break;
+      case CommandBuffer::scaleNode:
+        command.node->setScaling(command.value);
+        break;
+      case CommandBuffer::staticNode:
+        command.node->setStatic(command.flag);
+        break;
+    }
+  }
+}
@@ -0,0 +1,107 @@
+// skeleton.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#ifndef SKELETON_HPP
+#define SKELETON_HPP
+
+#include <string>
+#include <vector>
+
+#include "dim/core/mesh.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+
+namespace dim
+{
+
+/**
+ * The transform of a bone relative to its parent bone, kept apart so poses
+ * can be interpolated
+ */
+struct BoneTransform
+{
+  glm::vec3 translation;
+  glm::quat rotation;
+  glm::vec3 scale;
+
+  glm::mat4 matrix() const;
+  static BoneTransform fromMatrix(glm::mat4 const &matrix); ///< Assumes the matrix has no shear
+};
+
+typedef std::vector<BoneTransform> Pose; ///< Indexed by the bone index
+
+/**
+ * The bone hierarchy of a Bone flattened into an array with the parents
+ * before their children, so the pose of the whole skeleton is computed in
+ * one pass without recursion
+ */
+class Skeleton
+{
+    struct Joint
+    {
+      uint index;    ///< Index of the bone in the palette
+      size_t parent; ///< Position of the parent joint, the root is its own parent
+      glm::mat4 offset;
+      glm::mat4 transform;
+      std::string name;
+    };
+
+    std::vector<Joint> d_joints;
+    size_t d_numOfBones;
+    Pose d_bindPose;
+
+  public:
+    Skeleton();
+    explicit Skeleton(Bone const &root);
+
+    size_t numOfBones() const; ///< The number of matrices in a palette of this skeleton
+    size_t numOfJoints() const;
+
+    uint index(std::string const &name) const;
+    size_t joint(std::string const &name) const;
+    uint index(size_t joint) const;
+    size_t parent(size_t joint) const;
+    std::string const &name(size_t joint) const;
+    glm::mat4 const &bindTransform(size_t joint) const;
+
+    /**
+     * The joints below a joint directly follow it, up to the returned
+     * position
+     */
+    size_t subtreeEnd(size_t joint) const;
+
+    Pose const &bindPose() const;
+
+    /**
+     * Writes the skinning matrix of every bone into palette, computed from
+     * the transforms of the bones relative to their parent bone indexed by
+     * the bone index. Safe to call from several threads at once
+     */
+    void palette(glm::mat4 const *locals, glm::mat4 *palette) const;
+    void palette(Pose const &pose, glm::mat4 *palette) const;
+    void bindPalette(glm::mat4 *palette) const;
+
+  private:
+    void add(Bone const &bone, size_t parent);
+};
+
+}
+
+#endif
@@ -0,0 +1,97 @@
+// staticbatch.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef STATICBATCH_HPP
+#define STATICBATCH_HPP
+
+#include <vector>
+#include <memory>
+
+#include "dim/scene/nodestoragebase.hpp"
+#include "dim/scene/batchgeometry.hpp"
+#include "dim/util/framearena.hpp"
+
+namespace dim
+{
+namespace internal
+{
+  /**
+   * One merged mesh of a StaticBatch. It is built where the snapshot is
+   * extracted and uploaded the first time it is drawn, so only the drawing
+   * thread uses GL
+   */
+  struct StaticMesh
+  {
+    ShaderScene state;
+    std::vector<std::pair<AttributeAccessor, Shader::Format>> formats;
+    std::vector<GLfloat> vertices; ///< Freed once uploaded
+    std::vector<GLushort> indices;
+    size_t numOfVertices;
+    glm::vec4 bounds; ///< In world space
+    std::unique_ptr<Mesh> mesh;
+
+    void draw();
+  };
+
+  /**
+   * Holds the merged geometry of the static nodes in one grid cell. Every
+   * combination of shaders, material and vertex layout gets one or more
+   * pre-transformed meshes, so the whole cell can be drawn with a few draw
+   * calls instead of one per node
+   */
+  class StaticBatch
+  {
+      std::vector<std::shared_ptr<StaticMesh>> d_meshes; ///< Shared with the snapshots that draw them
+      bool d_dirty;
+
+    public:
+      StaticBatch();
+
+      void setDirty(); ///< Makes sure the batch is rebuilt before it is drawn again
+      bool dirty() const;
+
+      void clear();
+
+      /**
+       * Merges the vertices of all the static nodes in the list into one
+       * vertex and index buffer per material, from the copies the draw
+       * states keep in main memory. Doesn't use GL, the previous meshes are
+       * moved to retired so they are deleted where they are drawn
+       */
+      void rebuild(FrameVector<NodeBase*> const &nodes, size_t numOfShaders,
+                   std::vector<std::shared_ptr<StaticMesh>> &retired);
+
+      /**
+       * Adds the visible meshes of the state, already in world space
+       */
+      void collect(ShaderScene const &state, std::vector<std::shared_ptr<StaticMesh>> &meshes,
+                   Visibility const &visibility) const;
+
+      size_t numOfMeshes() const;
+
+      /**
+       * Whether a part of a node ends up in the batch, if not the node has
+       * to be drawn on its own
+       */
+      static bool batchable(DrawState const &drawState, bool isStatic);
+  };
+}
+}
+
+#endif
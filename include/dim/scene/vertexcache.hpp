@@ -0,0 +1,65 @@
+// vertexcache.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef VERTEXCACHE_HPP
+#define VERTEXCACHE_HPP
+
+#include <vector>
+
+#include "dim/core/dim.hpp"
+
+namespace dim
+{
+  struct VertexCacheStats
+  {
+    float acmr; ///< Vertices transformed per triangle, around 0.6 is good for a regular mesh
+    float atvr; ///< Vertices transformed per used vertex, 1 is optimal
+  };
+
+  /**
+   * Simulates a FIFO post-transform cache of cacheSize vertices
+   */
+  VertexCacheStats analyzeVertexCache(std::vector<GLuint> const &indices, size_t numOfVertices, size_t cacheSize = 16);
+
+  /**
+   * Reorders the triangles for the post-transform cache (Tipsify). Returns
+   * the offsets of the indices where the walk had to jump to a vertex
+   * outside the cache, these are free places to cut the order
+   */
+  std::vector<size_t> optimizeVertexCache(std::vector<GLuint> &indices, size_t numOfVertices, size_t cacheSize = 16);
+
+  /**
+   * Splits the cache optimized order into clusters and draws the clusters
+   * facing away from the center of the mesh first, so they occlude the
+   * rest. Clusters end at the given offsets and wherever the cache misses
+   * all vertices of a triangle while the cluster so far is within
+   * threshold times the cache misses of the whole mesh
+   */
+  void optimizeOverdraw(std::vector<GLuint> &indices, std::vector<glm::vec3> const &positions,
+                        std::vector<size_t> const &boundaries, float threshold = 1.05, size_t cacheSize = 16);
+
+  /**
+   * Numbers the vertices in the order the indices use them, unused vertices
+   * last. Returns the new number of every vertex, the vertex data has to be
+   * moved accordingly
+   */
+  std::vector<GLuint> optimizeVertexFetch(std::vector<GLuint> &indices, size_t numOfVertices);
+}
+
+#endif
@@ -0,0 +1,41 @@
+// vertexpacking.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef VERTEXPACKING_HPP
+#define VERTEXPACKING_HPP
+
+#include <vector>
+
+#include "dim/core/mesh.hpp"
+
+namespace dim
+{
+  /**
+   * Builds a packed mesh from interleaved float vertices. Positions become
+   * 16 bit normalized values, or half floats when halfPositions is set,
+   * relative to the bounds of the mesh. Mesh::positionTransform maps them
+   * back. Normals, tangents and binormals become
+   * 2_10_10_10 normalized values, texture coordinates half floats and bone
+   * ids and weights 16 bit integers. Other attributes stay floats
+   */
+  Mesh packMesh(std::vector<GLfloat> const &vertices, size_t numOfVertices,
+                std::vector<std::pair<internal::AttributeAccessor, Shader::Format>> const &formats, bool halfPositions = false);
+}
+
+#endif
@@ -0,0 +1,254 @@
+// framearena.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef FRAMEARENA_HPP
+#define FRAMEARENA_HPP
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+namespace dim
+{
+
+/**
+ * Hands out memory for data that only lives during one frame by moving a
+ * pointer forward through a few large blocks. Every thread has an arena of
+ * its own, which is emptied with reset at the end of the frame. Once the
+ * blocks are big enough for a frame, allocating never touches the heap
+ */
+class FrameArena
+{
+  public:
+    struct Stats
+    {
+      size_t allocations;     ///< Allocations since the last reset
+      size_t bytes;           ///< Bytes in use, including alignment
+      size_t peakBytes;       ///< The most bytes in use at once
+      size_t capacity;        ///< The size of all blocks together
+      size_t heapAllocations; ///< Blocks taken from the heap since the arena was created
+    };
+
+    /**
+     * Gives back everything allocated during its lifetime when it goes out
+     * of scope. Containers created before the Scope must not grow inside it
+     */
+    class Scope
+    {
+      FrameArena &d_arena;
+      size_t d_block;
+      size_t d_offset;
+      size_t d_bytes;
+
+      public:
+        explicit Scope(FrameArena &arena = FrameArena::local());
+        ~Scope();
+
+        Scope(Scope const &other) = delete;
+        Scope &operator=(Scope const &other) = delete;
+    };
+
+  private:
+    static size_t const s_blockSize = 64 * 1024;
+
+    struct Block
+    {
+      std::unique_ptr<char[]> data;
+      size_t size;
+    };
+
+    std::vector<Block> d_blocks;
+    size_t d_block;
+    size_t d_offset;
+    Stats d_stats;
+
+  public:
+    static FrameArena &local(); ///< The arena of the calling thread
+
+    FrameArena(FrameArena const &other) = delete;
+    FrameArena &operator=(FrameArena const &other) = delete;
+
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    void reset(); ///< Call at the end of the frame, invalidates everything allocated
+
+    Stats const &stats() const;
+
+  private:
+    FrameArena();
+
+    void addBlock(size_t size);
+};
+
+/**
+ * Lets the containers of the standard library allocate from the arena of
+ * the calling thread. Deallocating does nothing, the memory comes back with
+ * the next reset
+ */
+template <typename Type>
+class FrameAllocator
+{
+  public:
+    typedef Type value_type;
+    typedef Type *pointer;
+    typedef Type const *const_pointer;
+    typedef Type &reference;
+    typedef Type const &const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename Other>
+    struct rebind
+    {
+      typedef FrameAllocator<Other> other;
+    };
+
+    FrameAllocator()
+    {
+    }
+
+    template <typename Other>
+    FrameAllocator(FrameAllocator<Other> const &other)
+    {
+    }
+
+    Type *allocate(size_t count)
+    {
+      return static_cast<Type*>(FrameArena::local().allocate(count * sizeof(Type), alignof(Type)));
+    }
+
+    void deallocate(Type *ptr, size_t count)
+    {
+    }
+};
+
+template <typename Type, typename Other>
+bool operator==(FrameAllocator<Type> const &lhs, FrameAllocator<Other> const &rhs)
+{
+  return true;
+}
+
+template <typename Type, typename Other>
+bool operator!=(FrameAllocator<Type> const &lhs, FrameAllocator<Other> const &rhs)
+{
+  return false;
+}
+
+template <typename Type>
+using FrameVector = std::vector<Type, FrameAllocator<Type>>;
+
+typedef std::basic_string<char, std::char_traits<char>, FrameAllocator<char>> FrameString;
+
+inline FrameArena::Scope::Scope(FrameArena &arena)
+:
+  d_arena(arena),
+  d_block(arena.d_block),
+  d_offset(arena.d_offset),
+  d_bytes(arena.d_stats.bytes)
+{
+}
+
+inline FrameArena::Scope::~Scope()
+{
+  d_arena.d_block = d_block;
+  d_arena.d_offset = d_offset;
+  d_arena.d_stats.bytes = d_bytes;
+}
+
+inline FrameArena::FrameArena()
+:
+  d_block(0),
+  d_offset(0),
+  d_stats{0, 0, 0, 0, 0}
+{
+}
+
+inline FrameArena &FrameArena::local()
+{
+  static thread_local FrameArena arena;
+  return arena;
+}
+
+inline void *FrameArena::allocate(size_t size, size_t alignment)
+{
+  ++d_stats.allocations;
+
+  while(true)
+  {
+    if(d_block == d_blocks.size())
+      addBlock(size + alignment);
+
+    Block &block = d_blocks[d_block];
+
+    uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+    size_t start = ((base + d_offset + alignment - 1) & ~(alignment - 1)) - base;
+
+    if(start + size <= block.size)
+    {
+      d_stats.bytes += start + size - d_offset;
+      d_stats.peakBytes = std::max(d_stats.peakBytes, d_stats.bytes);
+
+      d_offset = start + size;
+      return block.data.get() + start;
+    }
+
+    // the rest of this block is wasted until the next reset
+    ++d_block;
+    d_offset = 0;
+  }
+}
+
+inline void FrameArena::reset()
+{
+  // one block that fits the whole frame, so the next frames don't need the heap
+  if(d_blocks.size() > 1)
+  {
+    size_t capacity = d_stats.capacity;
+
+    d_blocks.clear();
+    d_stats.capacity = 0;
+    addBlock(capacity);
+  }
+
+  d_block = 0;
+  d_offset = 0;
+  d_stats.allocations = 0;
+  d_stats.bytes = 0;
+}
+
+inline FrameArena::Stats const &FrameArena::stats() const
+{
+  return d_stats;
+}
+
+inline void FrameArena::addBlock(size_t size)
+{
+  size = std::max(size, std::max(s_blockSize, d_stats.capacity));
+
+  d_blocks.push_back(Block{std::unique_ptr<char[]>(new char[size]), size});
+
+  d_stats.capacity += size;
+  ++d_stats.heapAllocations;
+}
+
+}
+
+#endif
@@ -0,0 +1,255 @@
+// pool.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <new>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+namespace dim
+{
+
+/**
+ * Hands out memory for objects of one type from slabs of fixed size
+ * slots. Freed slots go to a small cache of the freeing thread first and
+ * only touch the shared free list in batches. Slabs are never returned, so
+ * the objects keep their address and objects of one type stay close together
+ */
+template <typename Type>
+class Pool
+{
+  union Slot
+  {
+    Slot *next;
+    typename std::aligned_storage<sizeof(Type), alignof(Type)>::type storage;
+  };
+
+  static size_t const s_slabSize = 1024;
+  static size_t const s_cacheSize = 64;
+
+  struct Cache
+  {
+    Slot *slots[s_cacheSize];
+    size_t size = 0;
+
+    ~Cache();
+  };
+
+  std::mutex d_mutex;
+  std::vector<std::unique_ptr<Slot[]>> d_slabs;
+  Slot *d_free;
+
+  public:
+    static Pool &instance();
+
+    Pool(Pool const &other) = delete;
+    Pool &operator=(Pool const &other) = delete;
+
+    void *allocate();
+    void deallocate(void *ptr);
+
+    template <typename ...Args>
+    Type *create(Args &&...args);
+    void destroy(Type *object);
+
+    size_t capacity(); ///< The number of objects that fit in the allocated slabs
+
+  private:
+    Pool();
+
+    static Cache &cache(); ///< The cache of the calling thread
+
+    void refill(Cache &cache);
+    void flush(Cache &cache, size_t count); ///< Moves count slots from the cache to the free list
+};
+
+/**
+ * Derive a node type from PoolAllocated<NodeType> to allocate it from
+ * the Pool of its type with every new and delete, including the copies made
+ * by clone and by the storages of a SceneGraph
+ */
+template <typename Derived>
+class PoolAllocated
+{
+  public:
+    static void *operator new(std::size_t size);
+    static void operator delete(void *ptr, std::size_t size);
+};
+
+template <typename Type>
+Pool<Type>::Cache::~Cache()
+{
+  if(size != 0)
+    Pool<Type>::instance().flush(*this, size);
+}
+
+template <typename Type>
+Pool<Type>::Pool()
+:
+  d_free(0)
+{
+}
+
+template <typename Type>
+Pool<Type> &Pool<Type>::instance()
+{
+  static Pool<Type> pool;
+  return pool;
+}
+
+template <typename Type>
+typename Pool<Type>::Cache &Pool<Type>::cache()
+{
+  static thread_local Cache cache;
+  return cache;
+}
+
+template <typename Type>
+void *Pool<Type>::allocate()
+{
+  Cache &local = cache();
+
+  if(local.size == 0)
+    refill(local);
+
+  return local.slots[--local.size];
+}
+
+template <typename Type>
+void Pool<Type>::deallocate(void *ptr)
+{
+  if(ptr == 0)
+    return;
+
+  Cache &local = cache();
+
+  if(local.size == s_cacheSize)
+    flush(local, s_cacheSize / 2);
+
+  local.slots[local.size++] = static_cast<Slot*>(ptr);
+}
+
+template <typename Type>
+template <typename ...Args>
+Type *Pool<Type>::create(Args &&...args)
+{
+  void *ptr = allocate();
+
+  try
+  {
+    return new(ptr) Type(std::forward<Args>(args)...);
+  }
+  catch(...)
+  {
+    deallocate(ptr);
+    throw;
+  }
+}
+
+template <typename Type>
+void Pool<Type>::destroy(Type *object)
+{
+  if(object == 0)
+    return;
+
+  object->~Type();
+  deallocate(object);
+}
+
+template <typename Type>
+size_t Pool<Type>::capacity()
+{
+  std::lock_guard<std::mutex> lock(d_mutex);
+  return d_slabs.size() * s_slabSize;
+}
+
+template <typename Type>
+void Pool<Type>::refill(Cache &cache)
+{
+  std::lock_guard<std::mutex> lock(d_mutex);
+
+  if(d_free == 0)
+  {
+    d_slabs.emplace_back(new Slot[s_slabSize]);
+    Slot *slab = d_slabs.back().get();
+
+    // linked in order, so consecutive allocations are next to each other
+    for(size_t idx = 0; idx != s_slabSize - 1; ++idx)
+      slab[idx].next = &slab[idx + 1];
+    slab[s_slabSize - 1].next = 0;
+
+    d_free = slab;
+  }
+
+  // the cache is a stack, fill it backwards to hand out the lowest address first
+  size_t count = 0;
+  Slot *taken[s_cacheSize / 2];
+  while(d_free != 0 && count != s_cacheSize / 2)
+  {
+    taken[count++] = d_free;
+    d_free = d_free->next;
+  }
+
+  while(count != 0)
+    cache.slots[cache.size++] = taken[--count];
+}
+
+template <typename Type>
+void Pool<Type>::flush(Cache &cache, size_t count)
+{
+  std::lock_guard<std::mutex> lock(d_mutex);
+
+  for(size_t idx = 0; idx != count; ++idx)
+  {
+    Slot *slot = cache.slots[--cache.size];
+    slot->next = d_free;
+    d_free = slot;
+  }
+}
+
+template <typename Derived>
+void *PoolAllocated<Derived>::operator new(std::size_t size)
+{
+  // classes deriving from the pooled type have a different size
+  if(size != sizeof(Derived))
+    return ::operator new(size);
+
+  return Pool<Derived>::instance().allocate();
+}
+
+template <typename Derived>
+void PoolAllocated<Derived>::operator delete(void *ptr, std::size_t size)
+{
+  if(size != sizeof(Derived))
+  {
+    ::operator delete(ptr);
+    return;
+  }
+
+  Pool<Derived>::instance().deallocate(ptr);
+}
+
+}
+
+#endif
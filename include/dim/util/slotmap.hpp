@@ -0,0 +1,279 @@
+// slotmap.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef SLOTMAP_HPP
+#define SLOTMAP_HPP
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+namespace dim
+{
+
+/**
+ * Refers to a value in a SlotMap. The generation tells apart the values
+ * that used the same slot, so a handle to an erased value stays invalid
+ * when its slot is reused. A default constructed handle never refers to
+ * anything
+ */
+struct Handle
+{
+  uint32_t index;
+  uint32_t generation;
+
+  Handle(uint32_t slot = 0, uint32_t slotGeneration = 0)
+  :
+    index(slot),
+    generation(slotGeneration)
+  {
+  }
+
+  bool operator==(Handle const &other) const
+  {
+    return index == other.index && generation == other.generation;
+  }
+
+  bool operator!=(Handle const &other) const
+  {
+    return not (*this == other);
+  }
+};
+
+struct SlotMapTest; ///< Defined by the tests only, to reach the generations
+
+/**
+ * Stores values next to each other for fast iteration while handing out
+ * handles that stay valid until the value is erased. Inserting, erasing and
+ * looking up are constant time. Erasing moves the last value into the gap,
+ * so the order of the values is not kept
+ */
+template <typename Type>
+class SlotMap
+{
+  static uint32_t const s_none = std::numeric_limits<uint32_t>::max();
+
+  struct Slot
+  {
+    uint32_t index;      ///< The position of the value, or the next free slot
+    uint32_t generation; ///< Odd while the slot is in use
+  };
+
+  std::vector<Type> d_values;
+  std::vector<uint32_t> d_owners; ///< The slot of every value
+  std::vector<Slot> d_slots;
+  uint32_t d_free;
+
+  public:
+    typedef typename std::vector<Type>::iterator iterator;
+    typedef typename std::vector<Type>::const_iterator const_iterator;
+
+    SlotMap();
+
+    Handle insert(Type const &value);
+    Handle insert(Type &&value);
+    bool erase(Handle handle); ///< False when the handle was stale
+    void clear();
+
+    bool contains(Handle handle) const;
+    Type *get(Handle handle); ///< 0 when the handle is stale
+    Type const *get(Handle handle) const;
+
+    Handle handle(size_t idx) const; ///< The handle of the value at position idx
+
+    size_t size() const;
+    bool empty() const;
+
+    Type &operator[](size_t idx);
+    Type const &operator[](size_t idx) const;
+
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+
+  private:
+    friend struct SlotMapTest;
+
+    Handle claim();
+};
+
+template <typename Type>
+SlotMap<Type>::SlotMap()
+:
+  d_free(s_none)
+{
+}
+
+template <typename Type>
+Handle SlotMap<Type>::insert(Type const &value)
+{
+  d_values.push_back(value);
+  return claim();
+}
+
+template <typename Type>
+Handle SlotMap<Type>::insert(Type &&value)
+{
+  d_values.push_back(std::move(value));
+  return claim();
+}
+
+template <typename Type>
+Handle SlotMap<Type>::claim()
+{
+  uint32_t index = d_free;
+
+  if(index == s_none)
+  {
+    index = d_slots.size();
+    d_slots.push_back(Slot{0, 0});
+  }
+  else
+    d_free = d_slots[index].index;
+
+  Slot &slot = d_slots[index];
+  slot.index = d_values.size() - 1;
+  ++slot.generation;
+
+  d_owners.push_back(index);
+
+  return Handle{index, slot.generation};
+}
+
+template <typename Type>
+bool SlotMap<Type>::erase(Handle handle)
+{
+  if(not contains(handle))
+    return false;
+
+  Slot &slot = d_slots[handle.index];
+  uint32_t last = d_values.size() - 1;
+
+  if(slot.index != last)
+  {
+    d_values[slot.index] = std::move(d_values[last]);
+    d_owners[slot.index] = d_owners[last];
+    d_slots[d_owners[last]].index = slot.index;
+  }
+
+  d_values.pop_back();
+  d_owners.pop_back();
+
+  // an even generation marks the slot as free. The largest generation is
+  // odd, so it wraps around to 0, which is even and never handed out
+  ++slot.generation;
+  slot.index = d_free;
+  d_free = handle.index;
+
+  return true;
+}
+
+template <typename Type>
+void SlotMap<Type>::clear()
+{
+  while(not d_values.empty())
+    erase(handle(d_values.size() - 1));
+}
+
+template <typename Type>
+bool SlotMap<Type>::contains(Handle handle) const
+{
+  return handle.index < d_slots.size() && (handle.generation & 1) &&
+         d_slots[handle.index].generation == handle.generation;
+}
+
+template <typename Type>
+Type *SlotMap<Type>::get(Handle handle)
+{
+  if(not contains(handle))
+    return 0;
+
+  return &d_values[d_slots[handle.index].index];
+}
+
+template <typename Type>
+Type const *SlotMap<Type>::get(Handle handle) const
+{
+  if(not contains(handle))
+    return 0;
+
+  return &d_values[d_slots[handle.index].index];
+}
+
+template <typename Type>
+Handle SlotMap<Type>::handle(size_t idx) const
+{
+  uint32_t index = d_owners[idx];
+  return Handle{index, d_slots[index].generation};
+}
+
+template <typename Type>
+size_t SlotMap<Type>::size() const
+{
+  return d_values.size();
+}
+
+template <typename Type>
+bool SlotMap<Type>::empty() const
+{
+  return d_values.empty();
+}
+
+template <typename Type>
+Type &SlotMap<Type>::operator[](size_t idx)
+{
+  return d_values[idx];
+}
+
+template <typename Type>
+Type const &SlotMap<Type>::operator[](size_t idx) const
+{
+  return d_values[idx];
+}
+
+template <typename Type>
+typename SlotMap<Type>::iterator SlotMap<Type>::begin()
+{
+  return d_values.begin();
+}
+
+template <typename Type>
+typename SlotMap<Type>::iterator SlotMap<Type>::end()
+{
+  return d_values.end();
+}
+
+template <typename Type>
+typename SlotMap<Type>::const_iterator SlotMap<Type>::begin() const
+{
+  return d_values.begin();
+}
+
+template <typename Type>
+typename SlotMap<Type>::const_iterator SlotMap<Type>::end() const
+{
+  return d_values.end();
+}
+
+}
+
+#endif
@@ -0,0 +1,124 @@
+// triplebuffer.hpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#ifndef TRIPLEBUFFER_HPP
+#define TRIPLEBUFFER_HPP
+
+#include <atomic>
+#include <cstddef>
+
+namespace dim
+{
+
+/**
+ * Hands values from one writing thread to one reading thread without
+ * locking. The writer fills back() and publishes it, the reader picks up
+ * the latest published value with update() and reads it through front().
+ * Neither side ever waits for the other
+ */
+template <typename Type>
+class TripleBuffer
+{
+  static unsigned char const s_index = 3;
+  static unsigned char const s_fresh = 4; ///< Set when the middle buffer was published but not read yet
+
+  Type d_buffers[3];
+
+  std::atomic<unsigned char> d_middle;
+  unsigned char d_back;
+  unsigned char d_front;
+
+  public:
+    TripleBuffer();
+
+    TripleBuffer(TripleBuffer const &other) = delete;
+    TripleBuffer &operator=(TripleBuffer const &other) = delete;
+
+  // writer
+    Type &back();
+    void publish();
+
+  // reader
+    bool fresh() const; ///< Whether update() will pick up a new value
+    bool update();
+    Type const &front() const;
+    Type &front(); ///< The reader may take the contents, the buffer goes back to the writer with the next update
+
+  // setup
+    Type &buffer(size_t idx); ///< All three, only while neither side uses them
+};
+
+template <typename Type>
+TripleBuffer<Type>::TripleBuffer()
+:
+  d_middle(1),
+  d_back(0),
+  d_front(2)
+{
+}
+
+template <typename Type>
+Type &TripleBuffer<Type>::back()
+{
+  return d_buffers[d_back];
+}
+
+template <typename Type>
+void TripleBuffer<Type>::publish()
+{
+  d_back = d_middle.exchange(d_back | s_fresh, std::memory_order_acq_rel) & s_index;
+}
+
+template <typename Type>
+bool TripleBuffer<Type>::fresh() const
+{
+  return d_middle.load(std::memory_order_acquire) & s_fresh;
+}
+
+template <typename Type>
+bool TripleBuffer<Type>::update()
+{
+  if(not fresh())
+    return false;
+
+  d_front = d_middle.exchange(d_front, std::memory_order_acq_rel) & s_index;
+  return true;
+}
+
+template <typename Type>
+Type const &TripleBuffer<Type>::front() const
+{
+  return d_buffers[d_front];
+}
+
+template <typename Type>
+Type &TripleBuffer<Type>::front()
+{
+  return d_buffers[d_front];
+}
+
+template <typename Type>
+Type &TripleBuffer<Type>::buffer(size_t idx)
+{
+  return d_buffers[idx];
+}
+
+}
+
+#endif
@@ -21,6 +21,7 @@
 #define TUPLEFOREACH_HPP
 
 #include <tuple>
+#include <type_traits>
 
 namespace dim
 {
@@ -48,6 +49,27 @@ struct ForEach<0, FunctionObject, Types...>
     object(std::get<0>(list));
   }
 };
+
+template<size_t Index, typename FunctionObject, typename... Types>
+struct ForIndex
+{
+  static void apply(std::tuple<Types...> &list, size_t idx, FunctionObject &object)
+  {
+    if(idx == Index)
+      object(std::get<Index>(list));
+    else
+      ForIndex<Index - 1, FunctionObject, Types...>::apply(list, idx, object);
+  }
+};
+
+template<typename FunctionObject, typename... Types>
+struct ForIndex<0, FunctionObject, Types...>
+{
+  static void apply(std::tuple<Types...> &list, size_t idx, FunctionObject &object)
+  {
+    object(std::get<0>(list));
+  }
+};
 }
 
 template<typename FunctionObject, typename... Types>
@@ -62,6 +84,17 @@ void forEach(std::tuple<Types...> &list, FunctionObject &&object)
   internal::ForEach<std::tuple_size<std::tuple<Types...>>::value - 1, FunctionObject, Types...>{list, object};
 }
 
+/**
+ * Calls the object with element idx of the list, which is picked by
+ * comparing indices, so the object sees the exact type of the element
+ */
+template<typename FunctionObject, typename... Types>
+void forIndex(std::tuple<Types...> &list, size_t idx, FunctionObject &&object)
+{
+  internal::ForIndex<std::tuple_size<std::tuple<Types...>>::value - 1, typename std::remove_reference<FunctionObject>::type,
+                     Types...>::apply(list, idx, object);
+}
+
 namespace internal
 {
   template<size_t Index, typename Type, typename... Types>
@@ -0,0 +1,105 @@
+// bonepalette.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#include "dim/core/bonepalette.hpp"
+#include "dim/core/shader.hpp"
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+
+BonePalette::BonePalette()
+:
+  d_buffer({}),
+  d_texture(new GLuint(0), [](GLuint *ptr)
+  { glDeleteTextures(1, ptr);
+    delete ptr;}),
+  d_uploaded(0)
+{
+  glGenTextures(1, d_texture.get());
+}
+
+void BonePalette::clear()
+{
+  d_matrices.clear();
+}
+
+size_t BonePalette::reserve(size_t numOfBones)
+{
+  size_t offset = d_matrices.size();
+  d_matrices.resize(offset + numOfBones, mat4(1.0));
+  return offset;
+}
+
+size_t BonePalette::add(mat4 const *palette, size_t numOfBones)
+{
+  size_t offset = d_matrices.size();
+  d_matrices.insert(d_matrices.end(), palette, palette + numOfBones);
+  return offset;
+}
+
+mat4 *BonePalette::data(size_t offset)
+{
+  return d_matrices.data() + offset;
+}
+
+size_t BonePalette::size() const
+{
+  return d_matrices.size();
+}
+
+void BonePalette::upload()
+{
+  if(d_matrices.empty())
+    return;
+
+  d_buffer.update({d_matrices.size() * 16, &d_matrices.front()[0][0]});
+
+  // the storage of the buffer is replaced every frame, so the texture has to be pointed at it again
+  glBindTexture(GL_TEXTURE_BUFFER, *d_texture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, d_buffer.id());
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+  d_uploaded = d_matrices.size();
+}
+
+void BonePalette::bind(string const &variable, uint unit) const
+{
+  if(d_uploaded == 0)
+    log(__FILE__, __LINE__, LogType::warning, "Binding a bone palette that has not been uploaded");
+
+  glActiveTexture(GL_TEXTURE0 + unit);
+  Shader::set(variable, static_cast<int>(unit));
+  glBindTexture(GL_TEXTURE_BUFFER, *d_texture);
+}
+
+void BonePalette::setOffset(size_t offset, string const &variable)
+{
+  Shader::set(variable, static_cast<int>(offset));
+}
+
+GLuint BonePalette::texture() const
+{
+  return *d_texture;
+}
+
+}
@@ -133,8 +133,21 @@ namespace dim
     return d_width;
   }
 
+  float Camera::zNear() const
+  {
+    return d_zNear;
+  }
+
+  float Camera::zFar() const
+  {
+    return d_zFar;
+  }
+
   mat4 const &Camera::viewMatrix() const
   {
+    if(d_changed == true)
+      const_cast<Camera*>(this)->setView();
+
     return d_view;
   }
 
@@ -187,6 +200,15 @@ namespace dim
     Shader::set(projectionMatrix, d_projection);
   }
 
+  void Camera::setAtShader(char const *viewMatrix, char const *projectionMatrix) const
+  {
+    if(d_changed == true)
+      const_cast<Camera*>(this)->setView();
+
+    Shader::set(viewMatrix, d_view);
+    Shader::set(projectionMatrix, d_projection);
+  }
+
   bool Camera::frustum(float ox, float oz) const
   {
     return A1 * ox + B1 * oz + D1 < 0 && A2 * ox + B2 * oz + D2 > 0;
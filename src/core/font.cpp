@@ -135,13 +135,16 @@ Texture<> Font::generateTexture(string const &text, bool centered, uint textureW
   uint textWidth = 0;
   uint unscaledTextureWidth = textureWidth * (static_cast<float>(textHeight) / textureHeight);
 
+  // the bitmaps are gone once the texture is uploaded
+  FrameArena::Scope scope;
+
   for(uint letter = 0; letter != text.length(); ++letter)
   {
   	uint ch = text[letter];
     textWidth += d_glyphs[ch].width;
   }
 
-  vector<GLubyte> textMap(textHeight * unscaledTextureWidth);
+  FrameVector<GLubyte> textMap(textHeight * unscaledTextureWidth);
 
   uint xStart = 0;
   if(centered && textWidth < unscaledTextureWidth)
@@ -167,7 +170,7 @@ Texture<> Font::generateTexture(string const &text, bool centered, uint textureW
     }
   }
 
-  vector<GLubyte> texture = scale(textMap, unscaledTextureWidth, textHeight, textureWidth, textureHeight);
+  FrameVector<GLubyte> texture = scale(textMap, unscaledTextureWidth, textHeight, textureWidth, textureHeight);
 
   Texture<> textTexture(texture.data(), filter, NormalizedFormat::R8, textureWidth, textureHeight, false);
 
@@ -214,10 +217,10 @@ uint Font::nextPowerOf2(uint number) const
   return number;
 }
 
-vector<GLubyte> Font::scale(vector<GLubyte> const &textMap, uint oldWidth, uint oldHeight, uint newWidth, uint newHeight) const
+FrameVector<GLubyte> Font::scale(FrameVector<GLubyte> const &textMap, uint oldWidth, uint oldHeight, uint newWidth, uint newHeight) const
 {
 
-  vector<GLubyte> texture(newHeight * newWidth);
+  FrameVector<GLubyte> texture(newHeight * newWidth);
   float horScale = static_cast<float>(newWidth) / oldWidth;
   float verScale = static_cast<float>(newHeight) / oldHeight;
 
@@ -0,0 +1,115 @@
+// frustum.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#include "dim/core/frustum.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+  Frustum::Frustum()
+  {
+    for(vec4 &plane : d_planes)
+      plane = vec4(0.0);
+  }
+
+  Frustum::Frustum(mat4 const &clip)
+  {
+    vec4 rows[4];
+    for(size_t row = 0; row != 4; ++row)
+      rows[row] = vec4(clip[0][row], clip[1][row], clip[2][row], clip[3][row]);
+
+    // left, right, bottom, top, near and far
+    for(size_t axis = 0; axis != 3; ++axis)
+    {
+      d_planes[2 * axis] = rows[3] + rows[axis];
+      d_planes[2 * axis + 1] = rows[3] - rows[axis];
+    }
+
+    for(vec4 &plane : d_planes)
+      plane /= length(vec3(plane));
+  }
+
+  bool Frustum::visible(vec4 const &sphere) const
+  {
+    if(std::isinf(sphere.w))
+      return true;
+
+    for(vec4 const &plane : d_planes)
+    {
+      if(dot(vec3(plane), vec3(sphere)) + plane.w < -sphere.w)
+        return false;
+    }
+
+    return true;
+  }
+
+  vec4 boundingSphere(vector<vec3> const &points)
+  {
+    if(points.empty())
+      return vec4(0.0);
+
+    // sphere around the center of the bounding box
+    vec3 minimum = points.front();
+    vec3 maximum = minimum;
+    for(vec3 const &point : points)
+    {
+      minimum = glm::min(minimum, point);
+      maximum = glm::max(maximum, point);
+    }
+
+    vec3 center = (minimum + maximum) * 0.5f;
+
+    float radius = 0;
+    for(vec3 const &point : points)
+      radius = std::max(radius, length(point - center));
+
+    return vec4(center, radius);
+  }
+
+  vec4 transformSphere(vec4 const &sphere, mat4 const &matrix)
+  {
+    float scale = std::max(length(vec3(matrix[0])), std::max(length(vec3(matrix[1])), length(vec3(matrix[2]))));
+
+    return vec4(vec3(matrix * vec4(vec3(sphere), 1.0)), sphere.w * scale);
+  }
+
+  vec4 mergeSpheres(vec4 const &lhs, vec4 const &rhs)
+  {
+    if(std::isinf(lhs.w) || std::isinf(rhs.w))
+      return vec4(vec3(lhs), numeric_limits<float>::infinity());
+
+    vec3 offset = vec3(rhs) - vec3(lhs);
+    float distance = length(offset);
+
+    // one contains the other
+    if(distance + rhs.w <= lhs.w)
+      return lhs;
+    if(distance + lhs.w <= rhs.w)
+      return rhs;
+
+    float radius = (distance + lhs.w + rhs.w) * 0.5f;
+    return vec4(vec3(lhs) + offset * ((radius - lhs.w) / distance), radius);
+  }
+}
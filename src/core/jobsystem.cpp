@@ -0,0 +1,342 @@
+// jobsystem.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#include "dim/core/jobsystem.hpp"
+#include "dim/core/dim.hpp"
+
+#include <limits>
+
+using namespace std;
+
+namespace dim
+{
+  namespace
+  {
+    size_t const s_noWorker = numeric_limits<size_t>::max();
+
+    thread_local size_t s_worker = s_noWorker; ///< The queue of the calling worker thread
+  }
+
+  JobSystem::Counter::Counter()
+  :
+    d_count(0)
+  {
+  }
+
+  bool JobSystem::Counter::done() const
+  {
+    return d_count.load(memory_order_acquire) == 0;
+  }
+
+  JobSystem &JobSystem::instance()
+  {
+    static JobSystem jobSystem;
+    return jobSystem;
+  }
+
+  JobSystem::JobSystem()
+  :
+    d_pending(0),
+    d_next(0),
+    d_running(false),
+    d_mainThread(this_thread::get_id())
+  {
+    // the main thread makes up for the last core
+    setNumOfThreads(max(thread::hardware_concurrency(), 2u) - 1);
+  }
+
+  JobSystem::~JobSystem()
+  {
+    stop();
+  }
+
+  void JobSystem::setNumOfThreads(size_t numOfThreads)
+  {
+    stop();
+
+    d_queues.clear();
+    for(size_t idx = 0; idx != numOfThreads; ++idx)
+      d_queues.emplace_back(new Queue);
+
+    d_running = true;
+    for(size_t idx = 0; idx != numOfThreads; ++idx)
+      d_threads.emplace_back(&JobSystem::work, this, idx);
+  }
+
+  size_t JobSystem::numOfThreads() const
+  {
+    return d_threads.size();
+  }
+
+  void JobSystem::run(Job const &job, Counter *counter)
+  {
+    if(counter != 0)
+      ++counter->d_count;
+
+    submit(Entry{job, counter}, false);
+  }
+
+  void JobSystem::run(Job const &job, Counter *counter, Counter &dependency)
+  {
+    if(counter != 0)
+      ++counter->d_count;
+
+    {
+      lock_guard<mutex> lock(d_waitingMutex);
+
+      if(not dependency.done())
+      {
+        d_waiting.push_back(Waiting{Entry{job, counter}, &dependency});
+        return;
+      }
+    }
+
+    submit(Entry{job, counter}, false);
+  }
+
+  void JobSystem::runOnMainThread(Job const &job, Counter *counter)
+  {
+    if(counter != 0)
+      ++counter->d_count;
+
+    submit(Entry{job, counter}, true);
+  }
+
+  void JobSystem::wait(Counter const &counter)
+  {
+    while(not counter.done())
+    {
+      if(not executeOne())
+        this_thread::yield();
+    }
+  }
+
+  void JobSystem::executeMainThreadJobs()
+  {
+    if(not mainThread())
+    {
+      log(__FILE__, __LINE__, LogType::warning, "Main thread jobs can only be executed by the main thread");
+      return;
+    }
+
+    deque<Entry> entries;
+    {
+      lock_guard<mutex> lock(d_mainQueue.mutex);
+      entries.swap(d_mainQueue.entries);
+    }
+
+    // jobs added by these jobs wait for the next call
+    for(Entry &entry : entries)
+      execute(entry);
+  }
+
+  bool JobSystem::mainThread() const
+  {
+    return this_thread::get_id() == d_mainThread;
+  }
+
+  void JobSystem::submit(Entry const &entry, bool mainThread)
+  {
+    if(mainThread)
+    {
+      lock_guard<mutex> lock(d_mainQueue.mutex);
+      d_mainQueue.entries.push_back(entry);
+      return;
+    }
+
+    if(d_queues.empty())
+    {
+      Entry now(entry);
+      execute(now);
+      return;
+    }
+
+    // workers keep their own jobs, so related work stays on one core
+    size_t index = s_worker < d_queues.size() ? s_worker : d_next++ % d_queues.size();
+
+    ++d_pending;
+    {
+      lock_guard<mutex> lock(d_queues[index]->mutex);
+      d_queues[index]->entries.push_back(entry);
+    }
+
+    {
+      lock_guard<mutex> lock(d_sleepMutex);
+    }
+    d_wake.notify_one();
+  }
+
+  bool JobSystem::executeOne()
+  {
+    Entry entry;
+
+    if(mainThread())
+    {
+      unique_lock<mutex> lock(d_mainQueue.mutex);
+      if(not d_mainQueue.entries.empty())
+      {
+        entry = d_mainQueue.entries.front();
+        d_mainQueue.entries.pop_front();
+        lock.unlock();
+
+        execute(entry);
+        return true;
+      }
+    }
+
+    if(not pop(entry))
+      return false;
+
+    execute(entry);
+    return true;
+  }
+
+  bool JobSystem::pop(Entry &entry)
+  {
+    if(d_pending == 0)
+      return false;
+
+    size_t numOfQueues = d_queues.size();
+    size_t own = s_worker < numOfQueues ? s_worker : 0;
+
+    for(size_t offset = 0; offset != numOfQueues; ++offset)
+    {
+      Queue &queue = *d_queues[(own + offset) % numOfQueues];
+      lock_guard<mutex> lock(queue.mutex);
+
+      if(queue.entries.empty())
+        continue;
+
+      // the newest job of our own queue is still warm in the cache, steal the oldest of others
+      if(offset == 0 && s_worker == own)
+      {
+        entry = queue.entries.back();
+        queue.entries.pop_back();
+      }
+      else
+      {
+        entry = queue.entries.front();
+        queue.entries.pop_front();
+      }
+
+      --d_pending;
+      return true;
+    }
+
+    return false;
+  }
+
+  void JobSystem::execute(Entry &entry)
+  {
+    try
+    {
+      entry.job();
+    }
+    catch(exception const &error)
+    {
+      log(__FILE__, __LINE__, LogType::error, string("A job threw: ") + error.what());
+    }
+
+    finish(entry.counter);
+  }
+
+  void JobSystem::finish(Counter *counter)
+  {
+    if(counter == 0)
+      return;
+
+    vector<Waiting> ready;
+    size_t count = counter->d_count.load(memory_order_relaxed);
+
+    while(true)
+    {
+      if(count > 1)
+      {
+        if(counter->d_count.compare_exchange_weak(count, count - 1, memory_order_acq_rel, memory_order_relaxed))
+          return;
+        continue;
+      }
+
+      lock_guard<mutex> lock(d_waitingMutex);
+
+      // a job may have been added to the counter in the meantime
+      if(not counter->d_count.compare_exchange_strong(count, 0, memory_order_acq_rel, memory_order_relaxed))
+        continue;
+
+      // whoever waits for the counter may destroy it from here on, so only
+      // its address is compared. While the lock is held no job can start
+      // waiting on a new counter at the same address
+      auto waiting = d_waiting.begin();
+      while(waiting != d_waiting.end())
+      {
+        if(waiting->dependency == counter)
+        {
+          ready.push_back(*waiting);
+          waiting = d_waiting.erase(waiting);
+        }
+        else
+          ++waiting;
+      }
+
+      break;
+    }
+
+    for(Waiting const &waiting : ready)
+      submit(waiting.entry, false);
+  }
+
+  void JobSystem::work(size_t index)
+  {
+    s_worker = index;
+
+    while(true)
+    {
+      if(executeOne())
+        continue;
+
+      unique_lock<mutex> lock(d_sleepMutex);
+      d_wake.wait(lock, [this]()
+                  {
+                    return d_pending != 0 || not d_running;
+                  });
+
+      if(not d_running && d_pending == 0)
+        return;
+    }
+  }
+
+  void JobSystem::stop()
+  {
+    {
+      lock_guard<mutex> lock(d_sleepMutex);
+      d_running = false;
+    }
+    d_wake.notify_all();
+
+    // the workers leave once the queues are empty
+    for(thread &worker : d_threads)
+      worker.join();
+    d_threads.clear();
+
+    // jobs released by the last jobs of the workers
+    Entry entry;
+    while(pop(entry))
+      execute(entry);
+  }
+}
@@ -18,6 +18,7 @@
 // MA 02110-1301, USA.
 
 #include <iostream>
+#include <algorithm>
 
 #include "dim/core/light.hpp"
 #include "dim/core/shader.hpp"
@@ -40,6 +41,10 @@ Light::Light()
 	d_lightColor(0.0),
 	d_position(0.0),
 	d_transformedPosition(0.0),
+	d_direction(0.0, 0.0, -1.0),
+	d_range(10),
+	d_cosInner(1),
+	d_cosOuter(1),
 	d_mode(Light::directional)
 
 {
@@ -53,6 +58,10 @@ Light::Light(vec4 const &position, vec4 const &lightColor, vec4 const &highlight
 	d_lightColor(lightColor),
 	d_position(position),
 	d_transformedPosition(position),
+	d_direction(0.0, 0.0, -1.0),
+	d_range(10),
+	d_cosInner(cos(0.5f)),
+	d_cosOuter(cos(0.6f)),
 	d_mode(mode)
 {
 }
@@ -123,6 +132,67 @@ void Light::setPosition(vec4 const &position)
 	d_position = position;
 }
 
+void Light::setDirection(vec3 const &direction)
+{
+	d_direction = normalize(direction);
+}
+
+void Light::setRange(float range)
+{
+	d_range = range;
+}
+
+void Light::setSpotAngles(float inner, float outer)
+{
+	d_cosInner = cos(inner);
+	d_cosOuter = cos(std::max(inner, outer));
+}
+
+vec4 const &Light::lightColor() const
+{
+	return d_lightColor;
+}
+
+vec4 const &Light::lightIntensity() const
+{
+	return d_lightIntensity;
+}
+
+vec4 const &Light::highlightColor() const
+{
+	return d_highlightColor;
+}
+
+vec4 const &Light::ambientIntensity() const
+{
+	return d_ambientIntensity;
+}
+
+vec3 const &Light::direction() const
+{
+	return d_direction;
+}
+
+float Light::range() const
+{
+	return d_range;
+}
+
+float Light::cosInner() const
+{
+	return d_cosInner;
+}
+
+float Light::cosOuter() const
+{
+	return d_cosOuter;
+}
+
+Light::type Light::mode() const
+{
+	return d_mode;
+}
+
 /* Transforms the light to camera space */
 void Light::transform()
 {
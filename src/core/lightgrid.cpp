@@ -0,0 +1,281 @@
+// lightgrid.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#include "dim/core/lightgrid.hpp"
+#include "dim/core/jobsystem.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+
+namespace
+{
+  int limit(int value, int min, int max)
+  {
+    return value < min ? min : (value > max ? max : value);
+  }
+
+  int tile(float ndc, size_t numOfTiles)
+  {
+    return limit(static_cast<int>(floor((ndc * 0.5f + 0.5f) * numOfTiles)), 0, numOfTiles - 1);
+  }
+}
+
+LightGrid::LightGrid(size_t numOfX, size_t numOfY, size_t numOfZ)
+:
+  d_numOfX(numOfX),
+  d_numOfY(numOfY),
+  d_numOfZ(numOfZ),
+  d_depthScale(0),
+  d_depthBias(0),
+  d_slices(numOfZ, vector<vector<GLuint>>(numOfX * numOfY)),
+  d_changed(false)
+{
+}
+
+void LightGrid::build(Camera const &camera, vector<Light> const &lights)
+{
+  mat4 const &view = camera.viewMatrix();
+  mat4 const &projection = camera.projectionMatrix();
+  float zNear = camera.zNear();
+  float zFar = camera.zFar();
+
+  d_depthScale = d_numOfZ / std::log(zFar / zNear);
+  d_depthBias = -std::log(zNear) * d_depthScale;
+
+  d_x.clear();
+  d_y.clear();
+  d_depth.clear();
+  d_radius.clear();
+  d_lights.clear();
+
+  for(Light const &light : lights)
+  {
+    if(light.mode() == Light::directional)
+      continue;
+
+    vec3 position(view * vec4(vec3(light.position()), 1.0));
+    vec3 direction(mat3(view) * light.direction());
+
+    // narrow cones fit in a smaller sphere in front of the light
+    vec3 center = position;
+    float radius = light.range();
+    if(light.mode() == Light::spot && light.cosOuter() > 0.7071f)
+    {
+      radius = light.range() / (2 * light.cosOuter() * light.cosOuter());
+      center = position + direction * radius;
+    }
+
+    d_x.push_back(center.x);
+    d_y.push_back(center.y);
+    d_depth.push_back(-center.z);
+    d_radius.push_back(radius);
+
+    vec3 color = vec3(light.lightColor()) * vec3(light.lightIntensity());
+    d_lights.push_back(vec4(position, light.range()));
+    d_lights.push_back(vec4(color, light.mode() == Light::spot ? 1 : 0));
+    d_lights.push_back(vec4(direction, light.cosOuter()));
+    d_lights.push_back(vec4(light.cosInner(), 0, 0, 0));
+  }
+
+  size_t numOfLights = d_x.size();
+  d_bounds.resize(6 * numOfLights);
+
+  bool orthographic = projection[3][3] == 1;
+  float scaleX = projection[0][0];
+  float scaleY = projection[1][1];
+
+  for(size_t idx = 0; idx != numOfLights; ++idx)
+  {
+    float nearDepth = std::max(d_depth[idx] - d_radius[idx], zNear);
+    float farDepth = std::max(d_depth[idx] + d_radius[idx], zNear);
+
+    float minX = d_x[idx] - d_radius[idx];
+    float maxX = d_x[idx] + d_radius[idx];
+    float minY = d_y[idx] - d_radius[idx];
+    float maxY = d_y[idx] + d_radius[idx];
+
+    // the box around the sphere projects widest at its near or its far side
+    if(orthographic)
+    {
+      minX = minX * scaleX + projection[3][0];
+      maxX = maxX * scaleX + projection[3][0];
+      minY = minY * scaleY + projection[3][1];
+      maxY = maxY * scaleY + projection[3][1];
+    }
+    else
+    {
+      minX = scaleX * std::min(minX / nearDepth, minX / farDepth);
+      maxX = scaleX * std::max(maxX / nearDepth, maxX / farDepth);
+      minY = scaleY * std::min(minY / nearDepth, minY / farDepth);
+      maxY = scaleY * std::max(maxY / nearDepth, maxY / farDepth);
+    }
+
+    int *bounds = &d_bounds[6 * idx];
+    bounds[0] = tile(minX, d_numOfX);
+    bounds[1] = tile(maxX, d_numOfX);
+    bounds[2] = tile(minY, d_numOfY);
+    bounds[3] = tile(maxY, d_numOfY);
+    bounds[4] = limit(static_cast<int>(floor(std::log(nearDepth) * d_depthScale + d_depthBias)), 0, d_numOfZ - 1);
+    bounds[5] = limit(static_cast<int>(floor(std::log(farDepth) * d_depthScale + d_depthBias)), 0, d_numOfZ - 1);
+
+    // outside the frustum in depth or on the screen
+    if(d_depth[idx] + d_radius[idx] < zNear || d_depth[idx] - d_radius[idx] > zFar || maxX < -1 || minX > 1 || maxY < -1 || minY > 1)
+      bounds[4] = bounds[5] + 1;
+  }
+
+  JobSystem::instance().parallelFor(d_numOfZ, [this](size_t slice)
+                                    {
+                                      assign(slice);
+                                    }, 1);
+
+  // the slices are appended in order, so the result doesn't depend on the number of threads
+  size_t numOfTiles = d_numOfX * d_numOfY;
+  d_clusters.resize(2 * numOfTiles * d_numOfZ);
+  d_indices.clear();
+
+  for(size_t slice = 0; slice != d_numOfZ; ++slice)
+  {
+    for(size_t idx = 0; idx != numOfTiles; ++idx)
+    {
+      vector<GLuint> const &tileLights = d_slices[slice][idx];
+      size_t cluster = slice * numOfTiles + idx;
+
+      d_clusters[2 * cluster] = d_indices.size();
+      d_clusters[2 * cluster + 1] = tileLights.size();
+      d_indices.insert(d_indices.end(), tileLights.begin(), tileLights.end());
+    }
+  }
+
+  d_changed = true;
+}
+
+void LightGrid::assign(size_t slice)
+{
+  vector<vector<GLuint>> &tiles = d_slices[slice];
+  for(vector<GLuint> &tileLights : tiles)
+    tileLights.clear();
+
+  int sliceIdx = slice;
+  for(size_t light = 0; light != d_x.size(); ++light)
+  {
+    int const *bounds = &d_bounds[6 * light];
+    if(sliceIdx < bounds[4] || sliceIdx > bounds[5])
+      continue;
+
+    for(int y = bounds[2]; y <= bounds[3]; ++y)
+    {
+      for(int x = bounds[0]; x <= bounds[1]; ++x)
+        tiles[y * d_numOfX + x].push_back(light);
+    }
+  }
+}
+
+void LightGrid::upload()
+{
+  if(not d_changed)
+    return;
+
+  d_changed = false;
+
+  if(not d_objects)
+  {
+    d_objects.reset(new array<GLuint, 6>(), [](array<GLuint, 6> *objects)
+                    {
+                      glDeleteBuffers(3, objects->data());
+                      glDeleteTextures(3, objects->data() + 3);
+                      delete objects;
+                    });
+
+    glGenBuffers(3, d_objects->data());
+    glGenTextures(3, d_objects->data() + 3);
+  }
+
+  // a buffer texture can't be empty
+  vec4 const noLight(0.0);
+  GLuint const noIndex = 0;
+
+  glBindBuffer(GL_TEXTURE_BUFFER, (*d_objects)[0]);
+  if(d_lights.empty())
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(vec4), &noLight, GL_STREAM_DRAW);
+  else
+    glBufferData(GL_TEXTURE_BUFFER, d_lights.size() * sizeof(vec4), d_lights.data(), GL_STREAM_DRAW);
+
+  glBindBuffer(GL_TEXTURE_BUFFER, (*d_objects)[1]);
+  glBufferData(GL_TEXTURE_BUFFER, d_clusters.size() * sizeof(GLuint), d_clusters.data(), GL_STREAM_DRAW);
+
+  glBindBuffer(GL_TEXTURE_BUFFER, (*d_objects)[2]);
+  if(d_indices.empty())
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(GLuint), &noIndex, GL_STREAM_DRAW);
+  else
+    glBufferData(GL_TEXTURE_BUFFER, d_indices.size() * sizeof(GLuint), d_indices.data(), GL_STREAM_DRAW);
+
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  GLenum const formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+  for(size_t idx = 0; idx != 3; ++idx)
+  {
+    glBindTexture(GL_TEXTURE_BUFFER, (*d_objects)[3 + idx]);
+    glTexBuffer(GL_TEXTURE_BUFFER, formats[idx], (*d_objects)[idx]);
+  }
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightGrid::bind(uint firstUnit) const
+{
+  if(not d_objects)
+  {
+    log(__FILE__, __LINE__, LogType::warning, "Binding a light grid that has never been uploaded");
+    return;
+  }
+
+  char const *names[3] = {"in_lights", "in_light_clusters", "in_light_indices"};
+  for(size_t idx = 0; idx != 3; ++idx)
+  {
+    glActiveTexture(GL_TEXTURE0 + firstUnit + idx);
+    Shader::set(names[idx], static_cast<int>(firstUnit + idx));
+    glBindTexture(GL_TEXTURE_BUFFER, (*d_objects)[3 + idx]);
+  }
+
+  Shader::set("in_light_grid_size", uvec3(d_numOfX, d_numOfY, d_numOfZ));
+  Shader::set("in_light_grid_depth", vec2(d_depthScale, d_depthBias));
+}
+
+size_t LightGrid::numOfLights() const
+{
+  return d_x.size();
+}
+
+size_t LightGrid::numOfClusters() const
+{
+  return d_numOfX * d_numOfY * d_numOfZ;
+}
+
+size_t LightGrid::numOfIndices() const
+{
+  return d_indices.size();
+}
+
+}
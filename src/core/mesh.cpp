@@ -20,6 +20,7 @@
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
+#include <algorithm>
 
 #include "dim/core/mesh.hpp"
 #include "dim/core/shader.hpp"
@@ -29,13 +30,74 @@ using namespace std;
 
 namespace dim
 {
+  namespace
+  {
+    vector<pair<internal::AttributeAccessor, Shader::Format>> formatsOf(vector<internal::VertexAttribute> const &layout)
+    {
+      vector<pair<internal::AttributeAccessor, Shader::Format>> formats;
+      for(auto const &attribute : layout)
+        formats.push_back({attribute.attribute, attribute.format});
+
+      return formats;
+    }
+
+    size_t sizeOf(vector<internal::VertexAttribute> const &layout)
+    {
+      size_t size = 0;
+      for(auto const &attribute : layout)
+        size += internal::attributeSize(attribute.format, attribute.component);
+
+      return size;
+    }
+
+    bool fitsShort(GLuint const *indices, size_t numOfIndices)
+    {
+      return all_of(indices, indices + numOfIndices, [](GLuint index)
+                    {
+                      return index <= numeric_limits<GLushort>::max();
+                    });
+    }
+  }
+
+  // --- VertexArrayCache ---
+
+  namespace internal
+  {
+    VertexArrayCache::~VertexArrayCache()
+    {
+      for(auto const &array : d_arrays)
+        glDeleteVertexArrays(1, &array.second);
+    }
+
+    GLuint VertexArrayCache::find(vector<GLint> const &layout) const
+    {
+      for(auto const &array : d_arrays)
+      {
+        if(array.first == layout)
+          return array.second;
+      }
+      return 0;
+    }
+
+    GLuint VertexArrayCache::add(vector<GLint> const &layout)
+    {
+      GLuint array;
+      glGenVertexArrays(1, &array);
+      d_arrays.emplace_back(layout, array);
+      return array;
+    }
+  }
+
   // --- Mesh ---
 
   bool Mesh::s_bindless = false;
   bool Mesh::s_instanced = false;
+  bool Mesh::s_vertexArrays = false;
 
   GLuint Mesh::s_bound = 0;
+  GLuint Mesh::s_boundArray = 0;
   GLuint Mesh::s_boundElem = 0;
+  GLuint Mesh::s_streamArray = 0;
 
   bool Mesh::s_initialized = false;
 
@@ -44,6 +106,7 @@ namespace dim
     s_initialized = true;
 
     s_bound = false;
+    s_boundArray = 0;
     s_boundElem = false;
     s_bindless = false;
     if(GLEW_NV_shader_buffer_load && GLEW_NV_vertex_buffer_unified_memory )
@@ -58,6 +121,8 @@ namespace dim
       /* It is safe to use instancing. */
       s_instanced = true;
     }
+
+    s_vertexArrays = GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object;
   }
 
   Mesh::Mesh(GLfloat const *buffer, size_t numOfVertices, internal::AttributeAccessor attribute, Shader::Format format)
@@ -66,10 +131,15 @@ namespace dim
       d_instanceFormat(Shader::vec1),
       d_interleavedVBO({numOfVertices * numOfElements(), buffer}),
       d_indexVBO({}),
+      d_wideIndexVBO({}),
+      d_indexType(GL_UNSIGNED_SHORT),
       d_numOfVertices(numOfVertices),
       d_numOfTriangles(0),
       d_instancingVBO({}),
-      d_maxLocations(0)
+      d_maxLocations(0),
+      d_vertexArrays(new internal::VertexArrayCache),
+      d_packedVBO({}),
+      d_positionTransform(1.0)
   {
     // static initialize
     if(s_initialized == false)
@@ -82,11 +152,38 @@ namespace dim
       d_instanceFormat(Shader::vec1),
       d_interleavedVBO({numOfVertices * numOfElements(), buffer}),
       d_indexVBO({}),
+      d_wideIndexVBO({}),
+      d_indexType(GL_UNSIGNED_SHORT),
       d_numOfVertices(numOfVertices),
       d_numOfTriangles(0),
       d_instancingVBO({}),
-      d_maxLocations(0)
+      d_maxLocations(0),
+      d_vertexArrays(new internal::VertexArrayCache),
+      d_packedVBO({}),
+      d_positionTransform(1.0)
+
+  {
+    // static initialize
+    if(s_initialized == false)
+      initialize();
+  }
 
+  Mesh::Mesh(GLubyte const *buffer, size_t numOfVertices, vector<internal::VertexAttribute> const &layout, mat4 const &positionTransform)
+    :
+      d_formats(formatsOf(layout)),
+      d_instanceFormat(Shader::vec1),
+      d_interleavedVBO({}),
+      d_indexVBO({}),
+      d_wideIndexVBO({}),
+      d_indexType(GL_UNSIGNED_SHORT),
+      d_numOfVertices(numOfVertices),
+      d_numOfTriangles(0),
+      d_instancingVBO({}),
+      d_maxLocations(0),
+      d_vertexArrays(new internal::VertexArrayCache),
+      d_packedVBO({numOfVertices * sizeOf(layout), buffer}),
+      d_layout(layout),
+      d_positionTransform(positionTransform)
   {
     // static initialize
     if(s_initialized == false)
@@ -95,11 +192,15 @@ namespace dim
 
   void Mesh::addBuffer(GLfloat const *buffer, internal::AttributeAccessor attribute, Shader::Format format)
   {
+    if(packed())
+      throw log(__FILE__, __LINE__, LogType::error, "Can't add a buffer to a packed mesh");
+
     if(attributeIndex(attribute) != -1)
       throw log(__FILE__, __LINE__, LogType::error, "Trying to add a buffer to a mesh that is already added");
 
     d_additionalVBOs.emplace_back(ListAccessor<GLfloat>{d_numOfVertices * internal::formatSize(format), buffer});
     d_formats.push_back({attribute, format});
+    resetVertexArrays();
   }
 
   void Mesh::updateBuffer(GLfloat const *buffer)
@@ -129,10 +230,35 @@ namespace dim
   {
     d_numOfTriangles = numOfTriangles;
 
-    if(d_indexVBO.size() != 0)
+    if(hasElements())
       throw log(__FILE__, __LINE__, LogType::error, "Can't add an element buffer, it's has already been added");
 
+    d_indexType = GL_UNSIGNED_SHORT;
     d_indexVBO = Buffer<GLushort>({d_numOfTriangles * 3, buffer});
+    resetVertexArrays();
+  }
+
+  void Mesh::addElementBuffer(GLuint const *buffer, size_t numOfTriangles)
+  {
+    d_numOfTriangles = numOfTriangles;
+
+    if(hasElements())
+      throw log(__FILE__, __LINE__, LogType::error, "Can't add an element buffer, it's has already been added");
+
+    size_t numOfIndices = d_numOfTriangles * 3;
+
+    if(fitsShort(buffer, numOfIndices))
+    {
+      d_indexType = GL_UNSIGNED_SHORT;
+      d_indexVBO = Buffer<GLushort>(vector<GLushort>(buffer, buffer + numOfIndices));
+    }
+    else
+    {
+      d_indexType = GL_UNSIGNED_INT;
+      d_wideIndexVBO = Buffer<GLuint>({numOfIndices, buffer});
+    }
+
+    resetVertexArrays();
   }
 
   void Mesh::addInstanceBuffer(GLfloat const *buffer, size_t locations, Shader::Format format)
@@ -148,12 +274,27 @@ namespace dim
 
   void Mesh::updateElementBuffer(GLushort const *buffer)
   {
-    if(d_indexVBO.size() == 0)
+    if(not hasElements())
       throw log(__FILE__, __LINE__, LogType::error, "Can't update a element buffer if no element buffers have been added yet");
 
+    if(d_indexType == GL_UNSIGNED_INT)
+    {
+      d_wideIndexVBO.update({});
+      d_indexType = GL_UNSIGNED_SHORT;
+      resetVertexArrays();
+    }
+
     d_indexVBO.update({d_numOfTriangles * 3, buffer});
   }
 
+  void Mesh::updateElementBuffer(GLuint const *buffer)
+  {
+    if(not hasElements())
+      throw log(__FILE__, __LINE__, LogType::error, "Can't update a element buffer if no element buffers have been added yet");
+
+    storeElements(buffer, d_numOfTriangles);
+  }
+
   void Mesh::updateInstanceBuffer(GLfloat const *buffer, size_t locations)
   {
     if(d_instancingVBO.size() == 0)
@@ -163,21 +304,162 @@ namespace dim
     d_instancingVBO.update({d_maxLocations * internal::formatSize(d_instanceFormat), buffer});
   }
 
-  Buffer<GLfloat> const &Mesh::buffer()
+  void Mesh::streamBuffer(GLfloat const *buffer, size_t numOfVertices)
+  {
+    if(packed())
+      throw log(__FILE__, __LINE__, LogType::error, "Unable to call Mesh::streamBuffer(buffer, numOfVertices) on a packed mesh");
+
+    if(d_additionalVBOs.size() != 0)
+      throw log(__FILE__, __LINE__, LogType::error, "Unable to call Mesh::streamBuffer(buffer, numOfVertices) on a mesh that is not interleaved");
+
+    d_numOfVertices = numOfVertices;
+    d_interleavedVBO.update({d_numOfVertices * numOfElements(), buffer});
+  }
+
+  void Mesh::streamElementBuffer(GLushort const *buffer, size_t numOfTriangles)
+  {
+    if(not hasElements())
+      throw log(__FILE__, __LINE__, LogType::error, "Can't stream a element buffer if no element buffers have been added yet");
+
+    if(d_indexType == GL_UNSIGNED_INT)
+    {
+      d_wideIndexVBO.update({});
+      d_indexType = GL_UNSIGNED_SHORT;
+      resetVertexArrays();
+    }
+
+    d_numOfTriangles = numOfTriangles;
+    d_indexVBO.update({d_numOfTriangles * 3, buffer});
+  }
+
+  void Mesh::streamElementBuffer(GLuint const *buffer, size_t numOfTriangles)
+  {
+    if(not hasElements())
+      throw log(__FILE__, __LINE__, LogType::error, "Can't stream a element buffer if no element buffers have been added yet");
+
+    storeElements(buffer, numOfTriangles);
+  }
+
+  void Mesh::storeElements(GLuint const *buffer, size_t numOfTriangles)
+  {
+    size_t numOfIndices = numOfTriangles * 3;
+    d_numOfTriangles = numOfTriangles;
+
+    // the width may change, the unused buffer is emptied
+    if(fitsShort(buffer, numOfIndices))
+    {
+      if(d_indexType == GL_UNSIGNED_INT)
+      {
+        d_wideIndexVBO.update({});
+        resetVertexArrays();
+      }
+
+      d_indexType = GL_UNSIGNED_SHORT;
+      d_indexVBO.update(vector<GLushort>(buffer, buffer + numOfIndices));
+    }
+    else
+    {
+      if(d_indexType == GL_UNSIGNED_SHORT)
+      {
+        d_indexVBO.update({});
+        resetVertexArrays();
+      }
+
+      d_indexType = GL_UNSIGNED_INT;
+      d_wideIndexVBO.update({numOfIndices, buffer});
+    }
+  }
+
+  Buffer<GLfloat> const &Mesh::buffer() const
   {
     return d_interleavedVBO;
   }
 
-  Buffer<GLushort> const &Mesh::elementBuffer()
+  Buffer<GLushort> const &Mesh::elementBuffer() const
   {
     return d_indexVBO;
   }
 
-  Buffer<GLfloat> const &Mesh::instanceBuffer()
+  Buffer<GLuint> const &Mesh::wideElementBuffer() const
+  {
+    return d_wideIndexVBO;
+  }
+
+  GLenum Mesh::indexType() const
+  {
+    return d_indexType;
+  }
+
+  vector<GLuint> Mesh::indices() const
+  {
+    if(not hasElements())
+      return vector<GLuint>();
+
+    if(d_indexType == GL_UNSIGNED_INT)
+      return d_wideIndexVBO.contents();
+
+    vector<GLushort> indices = d_indexVBO.contents();
+    return vector<GLuint>(indices.begin(), indices.end());
+  }
+
+  Buffer<GLfloat> const &Mesh::instanceBuffer() const
   {
     return d_instancingVBO;
   }
 
+  vector<pair<internal::AttributeAccessor, Shader::Format>> const &Mesh::formats() const
+  {
+    return d_formats;
+  }
+
+  size_t Mesh::numOfVertices() const
+  {
+    return d_numOfVertices;
+  }
+
+  size_t Mesh::numOfTriangles() const
+  {
+    return d_numOfTriangles;
+  }
+
+  bool Mesh::interleaved() const
+  {
+    return d_additionalVBOs.size() == 0;
+  }
+
+  bool Mesh::hasAttribute(internal::AttributeAccessor attribute) const
+  {
+    return attributeIndex(attribute) != -1;
+  }
+
+  bool Mesh::packed() const
+  {
+    return not d_layout.empty();
+  }
+
+  vector<internal::VertexAttribute> const &Mesh::layout() const
+  {
+    return d_layout;
+  }
+
+  mat4 const &Mesh::positionTransform() const
+  {
+    return d_positionTransform;
+  }
+
+  size_t Mesh::vertexSize() const
+  {
+    if(packed())
+      return sizeOf(d_layout);
+
+    return numOfElements() * sizeof(GLfloat);
+  }
+
+  bool Mesh::hasElements() const
+  {
+    return d_indexVBO.size() != 0 || d_wideIndexVBO.size() != 0;
+  }
+
   uint Mesh::numOfElements() const
   {
     uint varNumOfElements = 0;
@@ -197,16 +479,69 @@ namespace dim
     return -1;
   }
 
+  bool Mesh::bound() const
+  {
+    if(s_bound == 0 || s_bound != d_interleavedVBO.id())
+      return false;
+
+    // copies share the vertex buffer, but their arrays may hold another element buffer or layout
+    return not s_vertexArrays || (s_boundArray != 0 && s_boundArray == d_vertexArrays->find(locations()));
+  }
+
   void Mesh::bind() const
   {
-    if(s_bound == d_interleavedVBO.id())
+    if(bound())
       return;
 
     s_bound = d_interleavedVBO.id();
 
+    if(s_vertexArrays)
+    {
+      bindVertexArray();
+      return;
+    }
+
+    setAttributes();
+
+    //bindElement();
+  }
+
+  void Mesh::unbind() const
+  {
+    s_bound = 0;
+    s_boundArray = 0;
+
+    if(s_vertexArrays)
+    {
+      glBindVertexArray(0);
+      return;
+    }
+
     for(auto format : d_formats)
+      format.first.disable(format.second);
+
+    //unbindElement();
+  }
+
+  void Mesh::setAttributes() const
+  {
+    for(auto const &format : d_formats)
       format.first.enable(format.second);
 
+    if(packed())
+    {
+      size_t stride = sizeOf(d_layout);
+      size_t offset = 0;
+      d_packedVBO.bind(Buffer<GLubyte>::data);
+
+      for(auto const &attribute : d_layout)
+      {
+        attribute.attribute.setPacked(attribute.format, attribute.component, attribute.normalized, offset, stride);
+        offset += internal::attributeSize(attribute.format, attribute.component);
+      }
+      return;
+    }
+
     // set pointers when we're dealing with an interleaved
     if(d_additionalVBOs.size() == 0)
     {
@@ -214,7 +549,7 @@ namespace dim
       size_t offset = 0;
       d_interleavedVBO.bind(Buffer<GLfloat>::data);
 
-      for(auto format : d_formats)
+      for(auto const &format : d_formats)
       {
         format.first.set(d_interleavedVBO, format.second, offset, varNumOfElements);
         offset += internal::formatSize(format.second);
@@ -232,27 +567,61 @@ namespace dim
         d_formats[idx + 1].first.set(d_additionalVBOs[idx], d_formats[idx + 1].second);
       }
     }
+  }
 
-    //bindElement();
+  vector<GLint> const &Mesh::locations() const
+  {
+    // the locations depend on the active shader, each layout gets its own
+    // array. Meshes are drawn on one thread, so the storage is reused
+    static vector<GLint> buffer;
+
+    buffer.clear();
+    for(auto const &format : d_formats)
+      buffer.push_back(format.first.location());
+
+    return buffer;
   }
 
-  void Mesh::unbind() const
+  void Mesh::bindVertexArray() const
   {
-    s_bound = 0;
-    for(auto format : d_formats)
-      format.first.disable(format.second);
+    GLuint array = d_vertexArrays->find(locations());
+    if(array != 0)
+    {
+      s_boundArray = array;
+      glBindVertexArray(array);
+      return;
+    }
 
-    //unbindElement();
+    // record the attributes and the element buffer once
+    s_boundArray = d_vertexArrays->add(locations());
+    glBindVertexArray(s_boundArray);
+    setAttributes();
+
+    bindElement();
+    s_boundElem = 0;
+  }
+
+  void Mesh::resetVertexArrays()
+  {
+    // copies made earlier keep the arrays matching their buffers
+    d_vertexArrays.reset(new internal::VertexArrayCache);
   }
 
   void Mesh::bindElement() const
   {
-    if(d_indexVBO.size() == 0)
+    if(not hasElements())
       return;
 
-    s_boundElem = d_indexVBO.id();
-
-    d_indexVBO.bind(Buffer<GLushort>::element);
+    if(d_indexType == GL_UNSIGNED_INT)
+    {
+      s_boundElem = d_wideIndexVBO.id();
+      d_wideIndexVBO.bind(Buffer<GLuint>::element);
+    }
+    else
+    {
+      s_boundElem = d_indexVBO.id();
+      d_indexVBO.bind(Buffer<GLushort>::element);
+    }
   }
 
   void Mesh::unbindElement() const
@@ -263,21 +632,21 @@ namespace dim
   void Mesh::draw(Shape shape) const
   {
 
-    if(s_bound == 0 || s_bound != d_interleavedVBO.id())
+    if(not bound())
     {
       bind();
       s_bound = 0;
     }
 
-    if(d_indexVBO.size() != 0)
+    if(hasElements())
     {
-      if(s_boundElem == 0)
+      if(s_boundElem == 0 && not s_vertexArrays)
       {
 
         bindElement();
         s_boundElem = 0;
       }
-      glDrawElements(shape, d_numOfTriangles * 3, GL_UNSIGNED_SHORT, 0);
+      glDrawElements(shape, d_numOfTriangles * 3, d_indexType, 0);
     }
     else
     {
@@ -294,7 +663,7 @@ namespace dim
   void Mesh::drawInstanced(size_t numOfPolygons, Shape shape) const
   {
 
-    if(s_bound == 0 || s_bound != d_interleavedVBO.id())
+    if(not bound())
     {
       bind();
       s_bound = 0;
@@ -306,21 +675,84 @@ namespace dim
     Shader::set(Shader::instance, d_instancingVBO, d_instanceFormat);
     Shader::advanceAttributePerInstance(Shader::instance, d_instanceFormat, true);
 
-    if(d_indexVBO.size() != 0)
+    drawInstances(numOfPolygons, shape);
+
+    // the divisor would stay in the vertex array of the mesh
+    Shader::advanceAttributePerInstance(Shader::instance, d_instanceFormat, false);
+    Shader::disableAttribute(Shader::instance, d_instanceFormat);
+
+    if(s_bound == 0)
     {
-      if(s_boundElem == 0)
+      unbind();
+    }
+  }
+
+  void Mesh::drawInstanced(StreamBuffer const &instances, size_t offset, size_t numOfPolygons, Shader::Format format, Shape shape) const
+  {
+    if(not bound())
+    {
+      bind();
+      s_bound = 0;
+    }
+
+    Shader::enableAttribute(Shader::instance, format);
+
+    instances.bind(GL_ARRAY_BUFFER);
+    Shader::setPacked(Shader::location(Shader::instance), format, Shader::float32, false, offset,
+                      internal::attributeSize(format, Shader::float32));
+    Shader::advanceAttributePerInstance(Shader::instance, format, true);
+
+    drawInstances(numOfPolygons, shape);
+
+    Shader::advanceAttributePerInstance(Shader::instance, format, false);
+    Shader::disableAttribute(Shader::instance, format);
+
+    if(s_bound == 0)
+    {
+      unbind();
+    }
+  }
+
+  void Mesh::drawInstances(size_t numOfPolygons, Shape shape) const
+  {
+    if(hasElements())
+    {
+      if(s_boundElem == 0 && not s_vertexArrays)
       {
         bindElement();
         s_boundElem = 0;
       }
-      glDrawElementsInstanced(shape, d_numOfTriangles * 3, GL_UNSIGNED_SHORT, NULL, numOfPolygons);
+      glDrawElementsInstanced(shape, d_numOfTriangles * 3, d_indexType, NULL, numOfPolygons);
     }
     else
     {
       glDrawArraysInstanced(shape, 0, d_numOfVertices, numOfPolygons);
     }
+  }
 
-    Shader::disableAttribute(Shader::instance, d_instanceFormat);
+  void Mesh::drawRange(size_t firstIndex, size_t numOfIndices, Shape shape) const
+  {
+    if(not bound())
+    {
+      bind();
+      s_bound = 0;
+    }
+
+    if(hasElements())
+    {
+      if(s_boundElem == 0 && not s_vertexArrays)
+      {
+        bindElement();
+        s_boundElem = 0;
+      }
+
+      size_t indexSize = d_indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+      glDrawElements(shape, numOfIndices, d_indexType, reinterpret_cast<GLvoid const*>(firstIndex * indexSize));
+    }
+    else
+    {
+      glDrawArrays(shape, firstIndex, numOfIndices);
+    }
 
     if(s_bound == 0)
     {
@@ -328,6 +760,42 @@ namespace dim
     }
   }
 
+  void Mesh::drawStreamed(StreamBuffer const &stream, size_t vertexOffset, size_t indexOffset, size_t numOfIndices, Shape shape) const
+  {
+    // the arrays of the meshes record their own buffers, the stream gets one of its own
+    if(s_vertexArrays)
+    {
+      if(s_streamArray == 0)
+        glGenVertexArrays(1, &s_streamArray);
+      glBindVertexArray(s_streamArray);
+    }
+
+    size_t stride = numOfElements() * sizeof(GLfloat);
+    size_t offset = vertexOffset;
+
+    stream.bind(GL_ARRAY_BUFFER);
+    for(auto const &format : d_formats)
+    {
+      format.first.enable(format.second);
+      format.first.setPacked(format.second, Shader::float32, false, offset, stride);
+      offset += internal::attributeSize(format.second, Shader::float32);
+    }
+
+    stream.bind(GL_ELEMENT_ARRAY_BUFFER);
+    glDrawElements(shape, numOfIndices, GL_UNSIGNED_SHORT, reinterpret_cast<GLvoid const*>(indexOffset));
+
+    for(auto const &format : d_formats)
+      format.first.disable(format.second);
+
+    if(s_vertexArrays)
+      glBindVertexArray(0);
+
+    // whatever was bound before has to be bound again
+    s_bound = 0;
+    s_boundArray = 0;
+    s_boundElem = 0;
+  }
+
   GLuint Mesh::id() const
   {
     return d_interleavedVBO.id();
@@ -99,6 +99,44 @@ namespace dim
     return shader;
   }
 
+  Shader const &Shader::depthShader()
+  {
+    static Shader shader{fromString, "val_depthShader", R"foo(
+                   #version 140
+                   layout(std140) uniform ViewBlock
+                   {
+                     mat4 view;
+                     mat4 projection;
+                     mat4 viewProjection;
+                     mat4 inverseProjection;
+                     vec4 depthRange;
+                   };
+                   uniform mat4 in_mat_model;
+
+                   in vec3 in_position;
+
+                   void main()
+                   {
+                     gl_Position = viewProjection * in_mat_model * vec4(in_position, 1);
+                   }
+                         )foo",
+                         R"foo(
+                   #version 140
+                   void main()
+                   {
+                   }
+                         )foo"};
+    static bool shaderInitialized = false;
+    if(not shaderInitialized)
+    {
+      shader.bind("in_mat_model", modelMatrix);
+      shader.bind("in_position", vertex);
+      shaderInitialized = true;
+    }
+
+    return shader;
+  }
+
   void Shader::bind(string const &variable, Uniform uniform)
   {
     if(d_uniformArray[uniform] > 0)
@@ -157,6 +195,15 @@ namespace dim
     return it->second;
   }
 
+  GLint Shader::findUniform(char const *variable) const
+  {
+    // the buffer keeps its capacity, so only a name longer than any before allocates
+    static thread_local string name;
+    name.assign(variable);
+
+    return findUniform(name);
+  }
+
   void Shader::checkCompile(GLuint shader, string const &filename, string const &stage) const
   {
     int const buffer_size = 512;
@@ -254,6 +301,36 @@ namespace dim
     advanceAttributePerInstance(loc, format, advance);
   }
 
+  void Shader::setPacked(GLint attribute, Format format, Component component, bool normalized, size_t byteOffset, size_t byteStride)
+  {
+    uint rows = format % 10;
+    uint columns = format / 10;
+    uint size = internal::columnSize(format, component);
+
+    // packed components always come in fours
+    if(component == int2_10_10_10)
+      rows = 4;
+
+    for(uint idx = 0; idx != columns; ++idx)
+      glVertexAttribPointer(attribute + idx, rows, component, normalized, byteStride, reinterpret_cast<void*>(byteOffset + idx * size));
+  }
+
+  GLint Shader::location(Attribute attribute)
+  {
+    if(active().d_attributeArray[attribute] == static_cast<GLint>(UniformStatus::notInitialised))
+    {
+      activePrivate().d_attributeArray[attribute] = static_cast<GLint>(UniformStatus::notFound);
+      log(active().d_filename, 0, LogType::warning, "Attribute " + to_string(attribute) + " has not been bound yet");
+    }
+
+    return active().d_attributeArray[attribute];
+  }
+
+  GLint Shader::location(string const &attribute)
+  {
+    return active().findAttribute(attribute);
+  }
+
   void Shader::enableAttribute(GLint attribute, Format format)
   {
     uint columns = format / 10;
@@ -436,6 +513,27 @@ namespace dim
   {
     glLinkProgram(*d_id);
     checkProgram(*d_id);
+
+    d_blocks = 0;
+    d_blocks |= bind("FrameBlock", frameBlock) << frameBlock;
+    d_blocks |= bind("ViewBlock", viewBlock) << viewBlock;
+    d_blocks |= bind("LightBlock", lightBlock) << lightBlock;
+    d_blocks |= bind("MaterialBlock", materialBlock) << materialBlock;
+  }
+
+  bool Shader::bind(string const &block, GLuint binding) const
+  {
+    GLuint index = glGetUniformBlockIndex(*d_id, block.c_str());
+    if(index == GL_INVALID_INDEX)
+      return false;
+
+    glUniformBlockBinding(*d_id, index, binding);
+    return true;
+  }
+
+  bool Shader::hasBlock(Block block) const
+  {
+    return d_blocks & (1u << block);
   }
 
   void Shader::parseGLSLfiles(string const &vertexFile, string const &fragmentFile,
@@ -0,0 +1,197 @@
+// streambuffer.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#include "dim/core/streambuffer.hpp"
+
+#include <cstring>
+
+using namespace std;
+
+namespace dim
+{
+  namespace
+  {
+    // the largest alignment uniform block ranges need in practice
+    size_t const s_regionAlignment = 256;
+  }
+
+  StreamBuffer::StreamBuffer(size_t frameSize, size_t numOfFrames)
+  :
+    d_data(0),
+    d_frameSize((frameSize + s_regionAlignment - 1) / s_regionAlignment * s_regionAlignment),
+    d_numOfFrames(numOfFrames == 0 ? 1 : numOfFrames),
+    d_frame(0),
+    d_offset(0),
+    d_fences(d_numOfFrames, 0)
+  {
+  }
+
+  StreamBuffer::~StreamBuffer()
+  {
+    for(GLsync fence : d_fences)
+    {
+      if(fence != 0)
+        glDeleteSync(fence);
+    }
+  }
+
+  void StreamBuffer::initialize()
+  {
+    d_id.reset(new GLuint(0), [](GLuint *ptr)
+               { glDeleteBuffers(1, ptr);
+                 delete ptr;});
+
+    size_t size = d_frameSize * d_numOfFrames;
+
+    glGenBuffers(1, d_id.get());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, *d_id);
+
+    if(GLEW_ARB_buffer_storage)
+    {
+      GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_COPY_WRITE_BUFFER, size, 0, flags);
+      d_data = static_cast<GLubyte*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+
+      if(d_data == 0)
+        log(__FILE__, __LINE__, LogType::warning, "OpenGL failed to map the stream buffer persistently, mapping every write instead");
+    }
+    else
+      glBufferData(GL_COPY_WRITE_BUFFER, size, 0, GL_STREAM_DRAW);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  void StreamBuffer::wait(size_t frame)
+  {
+    GLsync &fence = d_fences[frame];
+    if(fence == 0)
+      return;
+
+    // only flush when the fence isn't signaled yet, so it can't wait forever
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    while(result == GL_TIMEOUT_EXPIRED)
+      result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+
+    if(result == GL_WAIT_FAILED)
+      log(__FILE__, __LINE__, LogType::warning, "Waiting for a stream buffer region failed");
+
+    glDeleteSync(fence);
+    fence = 0;
+  }
+
+  void StreamBuffer::nextFrame()
+  {
+    if(not d_id)
+      return;
+
+    if(d_fences[d_frame] != 0)
+      glDeleteSync(d_fences[d_frame]);
+    d_fences[d_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    d_frame = (d_frame + 1) % d_numOfFrames;
+    d_offset = 0;
+
+    wait(d_frame);
+  }
+
+  size_t StreamBuffer::write(void const *data, size_t size, size_t alignment)
+  {
+    if(not d_id)
+      initialize();
+
+    size_t base = d_frame * d_frameSize;
+    size_t offset = (base + d_offset + alignment - 1) / alignment * alignment;
+
+    if(offset + size > base + d_frameSize)
+      throw log(__FILE__, __LINE__, LogType::error, "Writing " + to_string(size) + " bytes to a full stream buffer region of " +
+                                                    to_string(d_frameSize) + " bytes");
+
+    if(d_data != 0)
+      memcpy(d_data + offset, data, size);
+    else
+    {
+      // the fences keep the GPU out of this range
+      glBindBuffer(GL_COPY_WRITE_BUFFER, *d_id);
+      void *range = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+                                     GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+      if(range == 0)
+        log(__FILE__, __LINE__, LogType::warning, "OpenGL failed to map a stream buffer range");
+      else
+      {
+        memcpy(range, data, size);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+      }
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    d_offset = offset + size - base;
+    return offset;
+  }
+
+  void StreamBuffer::bind(GLenum target) const
+  {
+    if(not d_id)
+    {
+      log(__FILE__, __LINE__, LogType::warning, "Binding a stream buffer that has never been written to");
+      return;
+    }
+
+    glBindBuffer(target, *d_id);
+  }
+
+  void StreamBuffer::bindRange(GLenum target, GLuint binding, size_t offset, size_t size) const
+  {
+    if(not d_id)
+    {
+      log(__FILE__, __LINE__, LogType::warning, "Binding a stream buffer that has never been written to");
+      return;
+    }
+
+    glBindBufferRange(target, binding, *d_id, offset, size);
+  }
+
+  GLuint StreamBuffer::id() const
+  {
+    return d_id ? *d_id : 0;
+  }
+
+  size_t StreamBuffer::frameSize() const
+  {
+    return d_frameSize;
+  }
+
+  size_t StreamBuffer::remaining() const
+  {
+    return d_frameSize - d_offset;
+  }
+
+  bool StreamBuffer::persistent() const
+  {
+    return d_data != 0;
+  }
+
+  size_t StreamBuffer::uniformAlignment()
+  {
+    static GLint alignment = 0;
+    if(alignment == 0)
+      glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+    return alignment;
+  }
+}
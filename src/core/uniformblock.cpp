@@ -0,0 +1,70 @@
+// uniformblock.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#include "dim/core/uniformblock.hpp"
+
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+
+ViewBlock ViewBlock::fromCamera(Camera const &camera)
+{
+  ViewBlock block;
+  block.view = camera.viewMatrix();
+  block.projection = camera.projectionMatrix();
+  block.viewProjection = block.projection * block.view;
+  block.inverseProjection = inverse(block.projection);
+  block.depthRange = vec4(camera.zNear(), camera.zFar(), 0, 0);
+  return block;
+}
+
+LightBlock LightBlock::fromLights(vector<Light> const &lights)
+{
+  LightBlock block;
+  size_t count = 0;
+
+  for(Light const &light : lights)
+  {
+    if(light.mode() != Light::directional)
+      continue;
+
+    if(count == s_maxLights)
+    {
+      log(__FILE__, __LINE__, LogType::warning, "Only " + to_string(s_maxLights) + " directional lights fit in a LightBlock");
+      break;
+    }
+
+    Directional &directional = block.lights[count++];
+    directional.lightColor = light.lightColor();
+    directional.highlightColor = light.highlightColor();
+    directional.lightIntensity = light.lightIntensity();
+    directional.ambientIntensity = light.ambientIntensity();
+    directional.position = light.position();
+    directional.lightMatrix = light.lightMatrix();
+  }
+
+  block.numOfLights = uvec4(count, 0, 0, 0);
+  return block;
+}
+
+}
@@ -0,0 +1,226 @@
+// animationclip.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#include "dim/scene/animationclip.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+  namespace
+  {
+    vec3 interpolate(vec3 const &from, vec3 const &to, float weight)
+    {
+      return mix(from, to, weight);
+    }
+
+    quat interpolate(quat const &from, quat const &to, float weight)
+    {
+      // nlerp along the shortest path, close enough to slerp between key frames
+      quat target = dot(from, to) < 0 ? -to : to;
+      return normalize(from * (1 - weight) + target * weight);
+    }
+
+    float difference(vec3 const &first, vec3 const &second)
+    {
+      return length(first - second);
+    }
+
+    float difference(quat const &first, quat const &second)
+    {
+      return 2 * acos(std::min(1.0f, abs(dot(first, second)))); // angle between the rotations
+    }
+
+    /*
+     * Drops every key that the line between the previous kept key and the
+     * next key passes within tolerance, together with the keys dropped before
+     * it. A track that doesn't change ends up with a single key
+     */
+    template <typename Value>
+    vector<pair<float, Value>> reduce(vector<pair<float, Value>> const &keys, float tolerance)
+    {
+      if(keys.size() < 2)
+        return keys;
+
+      vector<pair<float, Value>> kept(1, keys.front());
+      size_t from = 0;
+
+      for(size_t idx = 1; idx + 1 < keys.size(); ++idx)
+      {
+        pair<float, Value> const &first = keys[from];
+        pair<float, Value> const &last = keys[idx + 1];
+
+        bool needed = false;
+        for(size_t between = from + 1; between <= idx && not needed; ++between)
+        {
+          float weight = (keys[between].first - first.first) / (last.first - first.first);
+          needed = difference(interpolate(first.second, last.second, weight), keys[between].second) > tolerance;
+        }
+
+        if(needed)
+        {
+          kept.push_back(keys[idx]);
+          from = idx;
+        }
+      }
+
+      kept.push_back(keys.back());
+
+      if(kept.size() == 2 && difference(kept.front().second, kept.back().second) <= tolerance)
+        kept.pop_back();
+
+      return kept;
+    }
+
+    /*
+     * The key before time and the weight of the key after it
+     */
+    pair<size_t, float> locate(float const *times, size_t count, float time)
+    {
+      if(count == 1 || time <= times[0])
+        return {0, 0};
+
+      float const *next = upper_bound(times, times + count, time);
+      if(next == times + count)
+        return {count - 1, 0};
+
+      size_t idx = next - times - 1;
+      return {idx, (time - times[idx]) / (times[idx + 1] - times[idx])};
+    }
+  }
+
+  AnimationClip::AnimationClip(string const &name, float duration, vector<Channel> const &channels, float tolerance)
+  :
+    d_name(name),
+    d_duration(duration)
+  {
+    d_tracks.reserve(channels.size());
+
+    for(Channel const &channel : channels)
+    {
+      Track track{channel.bone, {0, 0}, {0, 0}, {0, 0}};
+
+      vector<pair<float, vec3>> positions = reduce(channel.positions, tolerance);
+      track.positions = Range{static_cast<uint32_t>(d_positions.size()), static_cast<uint32_t>(positions.size())};
+      for(pair<float, vec3> const &key : positions)
+      {
+        d_positionTimes.push_back(key.first);
+        d_positions.push_back(key.second);
+      }
+
+      vector<pair<float, quat>> rotations = reduce(channel.rotations, tolerance);
+      track.rotations = Range{static_cast<uint32_t>(d_rotations.size()), static_cast<uint32_t>(rotations.size())};
+      for(pair<float, quat> const &key : rotations)
+      {
+        d_rotationTimes.push_back(key.first);
+        d_rotations.push_back(quantize(key.second));
+      }
+
+      vector<pair<float, vec3>> scalings = reduce(channel.scalings, tolerance);
+      track.scalings = Range{static_cast<uint32_t>(d_scalings.size()), static_cast<uint32_t>(scalings.size())};
+      for(pair<float, vec3> const &key : scalings)
+      {
+        d_scalingTimes.push_back(key.first);
+        d_scalings.push_back(key.second);
+      }
+
+      d_tracks.push_back(track);
+    }
+
+    // sampling walks the bones in order
+    sort(d_tracks.begin(), d_tracks.end(), [](Track const &first, Track const &second)
+         {
+           return first.bone < second.bone;
+         });
+  }
+
+  string const &AnimationClip::name() const
+  {
+    return d_name;
+  }
+
+  float AnimationClip::duration() const
+  {
+    return d_duration;
+  }
+
+  size_t AnimationClip::numOfKeys() const
+  {
+    return d_positions.size() + d_rotations.size() + d_scalings.size();
+  }
+
+  void AnimationClip::sample(float time, Pose &pose) const
+  {
+    for(Track const &track : d_tracks)
+    {
+      if(track.bone >= pose.size())
+        continue;
+
+      BoneTransform &transform = pose[track.bone];
+
+      if(track.positions.count != 0)
+      {
+        pair<size_t, float> key = locate(&d_positionTimes[track.positions.first], track.positions.count, time);
+        vec3 const *values = &d_positions[track.positions.first];
+
+        transform.translation = key.second == 0 ? values[key.first] : interpolate(values[key.first], values[key.first + 1], key.second);
+      }
+
+      if(track.rotations.count != 0)
+      {
+        pair<size_t, float> key = locate(&d_rotationTimes[track.rotations.first], track.rotations.count, time);
+        QuantizedQuat const *values = &d_rotations[track.rotations.first];
+
+        if(key.second == 0)
+          transform.rotation = dequantize(values[key.first]);
+        else
+          transform.rotation = interpolate(dequantize(values[key.first]), dequantize(values[key.first + 1]), key.second);
+      }
+
+      if(track.scalings.count != 0)
+      {
+        pair<size_t, float> key = locate(&d_scalingTimes[track.scalings.first], track.scalings.count, time);
+        vec3 const *values = &d_scalings[track.scalings.first];
+
+        transform.scale = key.second == 0 ? values[key.first] : interpolate(values[key.first], values[key.first + 1], key.second);
+      }
+    }
+  }
+
+  AnimationClip::QuantizedQuat AnimationClip::quantize(quat const &rotation)
+  {
+    // q and -q are the same rotation, a positive w leaves the sign bit of w unused
+    quat unit = normalize(rotation);
+    if(unit.w < 0)
+      unit = -unit;
+
+    return QuantizedQuat{static_cast<int16_t>(round(unit.x * 32767)), static_cast<int16_t>(round(unit.y * 32767)),
+                         static_cast<int16_t>(round(unit.z * 32767)), static_cast<int16_t>(round(unit.w * 32767))};
+  }
+
+  quat AnimationClip::dequantize(QuantizedQuat const &rotation)
+  {
+    return normalize(quat(rotation.w / 32767.0f, rotation.x / 32767.0f, rotation.y / 32767.0f, rotation.z / 32767.0f));
+  }
+}
@@ -0,0 +1,268 @@
+// animator.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#include "dim/scene/animator.hpp"
+#include "dim/core/jobsystem.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+  namespace
+  {
+    size_t const s_minAnimatorsPerJob = 16;
+
+    quat nlerp(quat const &from, quat const &to, float weight)
+    {
+      quat target = dot(from, to) < 0 ? -to : to;
+      return normalize(from * (1 - weight) + target * weight);
+    }
+
+    float maskWeight(BoneMask const *mask, size_t bone, float weight)
+    {
+      return mask == 0 ? weight : weight * (*mask)[bone];
+    }
+  }
+
+  BoneMask::BoneMask(Skeleton const &skeleton, float weight)
+  :
+    d_weights(skeleton.numOfBones(), weight)
+  {
+  }
+
+  void BoneMask::set(Skeleton const &skeleton, string const &bone, float weight)
+  {
+    size_t joint = skeleton.joint(bone);
+    size_t end = skeleton.subtreeEnd(joint);
+
+    for(; joint != end; ++joint)
+      d_weights[skeleton.index(joint)] = weight;
+  }
+
+  float BoneMask::operator[](size_t bone) const
+  {
+    return bone < d_weights.size() ? d_weights[bone] : 0;
+  }
+
+  void blend(Pose const &from, Pose const &to, float weight, BoneMask const *mask, Pose &result)
+  {
+    result.resize(from.size());
+
+    for(size_t bone = 0; bone != from.size(); ++bone)
+    {
+      float boneWeight = maskWeight(mask, bone, weight);
+
+      result[bone].translation = mix(from[bone].translation, to[bone].translation, boneWeight);
+      result[bone].rotation = nlerp(from[bone].rotation, to[bone].rotation, boneWeight);
+      result[bone].scale = mix(from[bone].scale, to[bone].scale, boneWeight);
+    }
+  }
+
+  void addPose(Pose const &additive, Pose const &reference, float weight, BoneMask const *mask, Pose &result)
+  {
+    for(size_t bone = 0; bone != result.size(); ++bone)
+    {
+      float boneWeight = maskWeight(mask, bone, weight);
+      if(boneWeight == 0)
+        continue;
+
+      quat difference = additive[bone].rotation * inverse(reference[bone].rotation);
+
+      result[bone].translation += (additive[bone].translation - reference[bone].translation) * boneWeight;
+      result[bone].rotation = normalize(nlerp(quat(), difference, boneWeight) * result[bone].rotation);
+      result[bone].scale *= mix(vec3(1.0), additive[bone].scale / reference[bone].scale, boneWeight);
+    }
+  }
+
+  Animator::Animator(Skeleton const &skeleton)
+  :
+    d_skeleton(&skeleton),
+    d_current{0, 0, 1, replace, 0, true},
+    d_previous{0, 0, 1, replace, 0, true},
+    d_fade(0),
+    d_fadeDuration(0),
+    d_paletteOffset(0)
+  {
+  }
+
+  Skeleton const &Animator::skeleton() const
+  {
+    return *d_skeleton;
+  }
+
+  void Animator::play(AnimationClip const &clip, float fadeDuration, bool loop)
+  {
+    if(fadeDuration > 0 && d_current.clip != 0)
+    {
+      d_previous = d_current;
+      d_fade = 0;
+      d_fadeDuration = fadeDuration;
+    }
+    else
+    {
+      d_previous.clip = 0;
+    }
+
+    d_current = Layer{&clip, 0, 1, replace, 0, loop};
+  }
+
+  size_t Animator::addLayer(AnimationClip const &clip, float weight, Mode mode, BoneMask const *mask, bool loop)
+  {
+    d_layers.push_back(Layer{&clip, 0, weight, mode, mask, loop});
+    return d_layers.size() - 1;
+  }
+
+  Animator::Layer &Animator::layer(size_t idx)
+  {
+    return d_layers[idx];
+  }
+
+  void Animator::clearLayers()
+  {
+    d_layers.clear();
+  }
+
+  void Animator::advance(Layer &layer, float time)
+  {
+    if(layer.clip == 0)
+      return;
+
+    layer.time += time;
+
+    float duration = layer.clip->duration();
+    if(duration <= 0)
+      layer.time = 0;
+    else if(layer.loop)
+      layer.time = fmod(layer.time, duration);
+    else
+      layer.time = std::min(layer.time, duration);
+  }
+
+  void Animator::update(float time)
+  {
+    advance(d_current, time);
+
+    if(d_previous.clip != 0)
+    {
+      advance(d_previous, time);
+
+      d_fade += time;
+      if(d_fade >= d_fadeDuration)
+        d_previous.clip = 0;
+    }
+
+    for(Layer &layer : d_layers)
+      advance(layer, time);
+  }
+
+  void Animator::evaluate(mat4 *palette) const
+  {
+    // reused by the jobs of a thread, so evaluating doesn't allocate
+    static thread_local Pose pose;
+    static thread_local Pose other;
+
+    Pose const &bindPose = d_skeleton->bindPose();
+
+    pose = bindPose;
+    if(d_current.clip != 0)
+      d_current.clip->sample(d_current.time, pose);
+
+    if(d_previous.clip != 0)
+    {
+      other = bindPose;
+      d_previous.clip->sample(d_previous.time, other);
+      blend(other, pose, d_fade / d_fadeDuration, 0, pose);
+    }
+
+    for(Layer const &layer : d_layers)
+    {
+      if(layer.clip == 0 || layer.weight == 0)
+        continue;
+
+      if(layer.mode == additive)
+      {
+        other = bindPose;
+        layer.clip->sample(layer.time, other);
+        addPose(other, bindPose, layer.weight, layer.mask, pose);
+      }
+      else
+      {
+        other = pose;
+        layer.clip->sample(layer.time, other);
+        blend(pose, other, layer.weight, layer.mask, pose);
+      }
+    }
+
+    d_skeleton->palette(pose, palette);
+  }
+
+  size_t Animator::paletteOffset() const
+  {
+    return d_paletteOffset;
+  }
+
+  void Animator::setPaletteOffset(size_t offset)
+  {
+    d_paletteOffset = offset;
+  }
+
+  void AnimationSystem::add(Animator &animator)
+  {
+    d_animators.push_back(&animator);
+  }
+
+  void AnimationSystem::remove(Animator &animator)
+  {
+    auto iter = find(d_animators.begin(), d_animators.end(), &animator);
+
+    if(iter == d_animators.end())
+    {
+      log(__FILE__, __LINE__, LogType::warning, "Couldn't remove an animator that was never added");
+      return;
+    }
+
+    *iter = d_animators.back();
+    d_animators.pop_back();
+  }
+
+  size_t AnimationSystem::size() const
+  {
+    return d_animators.size();
+  }
+
+  void AnimationSystem::update(float time, BonePalette &palette)
+  {
+    // reserving moves the palettes, so it's done before the jobs write them
+    palette.clear();
+    for(Animator *animator : d_animators)
+      animator->setPaletteOffset(palette.reserve(animator->skeleton().numOfBones()));
+
+    JobSystem::instance().parallelFor(d_animators.size(), [&](size_t idx)
+                                      {
+                                        Animator &animator = *d_animators[idx];
+                                        animator.update(time);
+                                        animator.evaluate(palette.data(animator.paletteOffset()));
+                                      }, s_minAnimatorsPerJob);
+  }
+}
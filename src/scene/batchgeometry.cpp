@@ -0,0 +1,208 @@
+// batchgeometry.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#include "dim/scene/batchgeometry.hpp"
+
+#include <algorithm>
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+namespace internal
+{
+  namespace
+  {
+    template<typename Function>
+    void transformAttribute(GLfloat *first, GLfloat *last, size_t stride, uint size, Function const &function)
+    {
+      uint components = std::min(size, 3u);
+
+      for(GLfloat *ptr = first; ptr < last; ptr += stride)
+      {
+        vec3 value(0.0);
+
+        for(uint comp = 0; comp != components; ++comp)
+          value[comp] = ptr[comp];
+
+        value = function(value);
+
+        for(uint comp = 0; comp != components; ++comp)
+          ptr[comp] = value[comp];
+      }
+    }
+  }
+
+  size_t const BatchGeometry::maxVertices;
+
+  BatchGeometry::BatchGeometry()
+  :
+    d_stride(0)
+  {
+  }
+
+  BatchGeometry::BatchGeometry(Mesh const &mesh)
+  :
+    d_vertices(mesh.buffer().contents()),
+    d_stride(0)
+  {
+    for(auto const &format : mesh.formats())
+      d_stride += formatSize(format.second);
+
+    d_indices = mesh.indices();
+
+    if(d_indices.empty())
+    {
+      d_indices.resize(mesh.numOfVertices());
+      for(size_t idx = 0; idx != d_indices.size(); ++idx)
+        d_indices[idx] = idx;
+    }
+  }
+
+  BatchGeometry::BatchGeometry(vector<GLfloat> &&vertices, vector<GLuint> &&indices,
+                               vector<pair<AttributeAccessor, Shader::Format>> const &formats)
+  :
+    d_vertices(move(vertices)),
+    d_indices(move(indices)),
+    d_stride(0)
+  {
+    for(auto const &format : formats)
+      d_stride += formatSize(format.second);
+
+    if(d_indices.empty() && d_stride != 0)
+    {
+      d_indices.resize(d_vertices.size() / d_stride);
+      for(size_t idx = 0; idx != d_indices.size(); ++idx)
+        d_indices[idx] = idx;
+    }
+  }
+
+  bool BatchGeometry::mergeable(Mesh const &mesh)
+  {
+    return mesh.interleaved() && not mesh.packed() && mesh.hasAttribute(Shader::vertex) && mesh.numOfVertices() <= maxVertices;
+  }
+
+  size_t BatchGeometry::numOfVertices() const
+  {
+    if(d_stride == 0)
+      return 0;
+
+    return d_vertices.size() / d_stride;
+  }
+
+  size_t BatchGeometry::numOfIndices() const
+  {
+    return d_indices.size();
+  }
+
+  size_t BatchGeometry::stride() const
+  {
+    return d_stride;
+  }
+
+  vector<GLuint> const &BatchGeometry::indices() const
+  {
+    return d_indices;
+  }
+
+  vector<vec3> BatchGeometry::positions(vector<pair<AttributeAccessor, Shader::Format>> const &formats) const
+  {
+    vector<vec3> positions;
+
+    size_t offset = 0;
+    for(auto const &format : formats)
+    {
+      uint size = formatSize(format.second);
+
+      if(format.first == AttributeAccessor(Shader::vertex))
+      {
+        positions.reserve(numOfVertices());
+
+        for(size_t idx = offset; idx < d_vertices.size(); idx += d_stride)
+        {
+          vec3 value(0.0);
+          for(uint comp = 0; comp != std::min(size, 3u); ++comp)
+            value[comp] = d_vertices[idx + comp];
+
+          positions.push_back(value);
+        }
+
+        break;
+      }
+
+      offset += size;
+    }
+
+    return positions;
+  }
+
+  void BatchGeometry::appendTo(vector<GLfloat> &vertices, vector<GLushort> &indices,
+                               vector<pair<AttributeAccessor, Shader::Format>> const &formats,
+                               mat4 const &model, mat3 const &normalMatrix) const
+  {
+    GLushort base = vertices.size() / d_stride;
+
+    size_t firstVertex = vertices.size();
+    size_t firstIndex = indices.size();
+    vertices.resize(firstVertex + d_vertices.size());
+    indices.resize(firstIndex + d_indices.size());
+
+    transformTo(vertices.data() + firstVertex, indices.data() + firstIndex, base, formats, model, normalMatrix);
+  }
+
+  void BatchGeometry::transformTo(GLfloat *vertices, GLushort *indices, GLushort base,
+                                  vector<pair<AttributeAccessor, Shader::Format>> const &formats,
+                                  mat4 const &model, mat3 const &normalMatrix) const
+  {
+    copy(d_vertices.begin(), d_vertices.end(), vertices);
+
+    // pre-transform everything that lives in model space
+    size_t offset = 0;
+    for(auto const &format : formats)
+    {
+      uint size = formatSize(format.second);
+      GLfloat *begin = vertices + offset;
+      GLfloat *end = vertices + d_vertices.size();
+
+      if(format.first == AttributeAccessor(Shader::vertex))
+      {
+        transformAttribute(begin, end, d_stride, size, [&](vec3 const &value)
+                           {
+                             return vec3(model * vec4(value, 1.0));
+                           });
+      }
+      else if(format.first == AttributeAccessor(Shader::normal) ||
+              format.first == AttributeAccessor(Shader::binormal) ||
+              format.first == AttributeAccessor(Shader::tangent))
+      {
+        transformAttribute(begin, end, d_stride, size, [&](vec3 const &value)
+                           {
+                             return normalize(normalMatrix * value);
+                           });
+      }
+
+      offset += size;
+    }
+
+    for(GLuint index : d_indices)
+      *indices++ = base + index;
+  }
+}
+}
@@ -0,0 +1,245 @@
+// bulletmanager.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#include "dim/scene/bulletmanager.hpp"
+#include "dim/scene/batchgeometry.hpp"
+
+#include <fstream>
+
+#include <BulletCollision/CollisionShapes/btShapeHull.h>
+#include <BulletWorldImporter/btBulletWorldImporter.h>
+#include <LinearMath/btSerializer.h>
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+  namespace
+  {
+    bool readable(Mesh const &mesh)
+    {
+      if(mesh.interleaved() && not mesh.packed() && mesh.hasAttribute(Shader::vertex))
+        return true;
+
+      log(__FILE__, __LINE__, LogType::warning, "Only interleaved float meshes with positions can be turned into a collision shape");
+      return false;
+    }
+
+    btVector3 toBullet(vec3 const &value)
+    {
+      return btVector3(value.x, value.y, value.z);
+    }
+
+    shared_ptr<btCollisionShape> hullShape(vector<vec3> const &positions)
+    {
+      btConvexHullShape hull;
+      for(vec3 const &position : positions)
+        hull.addPoint(toBullet(position), false);
+      hull.recalcLocalAabb();
+
+      // only keep the vertices on the outline of the hull
+      btShapeHull reduced(&hull);
+      reduced.buildHull(hull.getMargin());
+
+      return shared_ptr<btCollisionShape>(new btConvexHullShape(reinterpret_cast<btScalar const*>(reduced.getVertexPointer()),
+                                                                reduced.numVertices()));
+    }
+
+    shared_ptr<btCollisionShape> triangleMeshShape(Scene const &scene)
+    {
+      btTriangleMesh *triangles = new btTriangleMesh;
+
+      for(size_t idx = 0; idx != scene.size(); ++idx)
+      {
+        Mesh const &mesh = scene[idx].mesh();
+        if(not readable(mesh))
+          continue;
+
+        internal::BatchGeometry const &geometry = scene[idx].geometry();
+        vector<vec3> positions = geometry.positions(mesh.formats());
+        vector<GLuint> const &indices = geometry.indices();
+
+        for(size_t index = 0; index + 2 < indices.size(); index += 3)
+        {
+          triangles->addTriangle(toBullet(positions[indices[index]]),
+                                 toBullet(positions[indices[index + 1]]),
+                                 toBullet(positions[indices[index + 2]]));
+        }
+      }
+
+      if(triangles->getNumTriangles() == 0)
+      {
+        delete triangles;
+        throw log(__FILE__, __LINE__, LogType::error, "Can't build a triangle mesh shape without triangles");
+      }
+
+      return shared_ptr<btCollisionShape>(new btBvhTriangleMeshShape(triangles, true), [triangles](btCollisionShape *shape)
+                                          {
+                                            delete shape;
+                                            delete triangles;
+                                          });
+    }
+
+    shared_ptr<btCollisionShape> convexHullShape(Scene const &scene)
+    {
+      vector<vec3> positions;
+
+      for(size_t idx = 0; idx != scene.size(); ++idx)
+      {
+        Mesh const &mesh = scene[idx].mesh();
+        if(not readable(mesh))
+          continue;
+
+        vector<vec3> meshPositions = scene[idx].geometry().positions(mesh.formats());
+        positions.insert(positions.end(), meshPositions.begin(), meshPositions.end());
+      }
+
+      if(positions.empty())
+        throw log(__FILE__, __LINE__, LogType::error, "Can't build a convex hull shape without vertices");
+
+      return hullShape(positions);
+    }
+
+    shared_ptr<btCollisionShape> convexDecompositionShape(Scene const &scene)
+    {
+      vector<shared_ptr<btCollisionShape>> children;
+      btCompoundShape *compound = new btCompoundShape;
+
+      for(size_t idx = 0; idx != scene.size(); ++idx)
+      {
+        Mesh const &mesh = scene[idx].mesh();
+        if(not readable(mesh))
+          continue;
+
+        vector<vec3> positions = scene[idx].geometry().positions(mesh.formats());
+        if(positions.empty())
+          continue;
+
+        children.push_back(hullShape(positions));
+        compound->addChildShape(btTransform::getIdentity(), children.back().get());
+      }
+
+      if(children.empty())
+      {
+        delete compound;
+        throw log(__FILE__, __LINE__, LogType::error, "Can't build a convex decomposition without vertices");
+      }
+
+      // the children are released after the compound
+      return shared_ptr<btCollisionShape>(compound, [children](btCollisionShape *shape)
+                                          {
+                                            delete shape;
+                                          });
+    }
+  }
+
+  shared_ptr<btCollisionShape> BulletManager::request(string const &filename)
+  {
+    auto iter = d_shapeMap.find(filename);
+    if(iter != d_shapeMap.end())
+      return iter->second;
+
+    shared_ptr<btBulletWorldImporter> importer = make_shared<btBulletWorldImporter>();
+    if(importer->loadFile(filename.c_str()) == false)
+      throw log(__FILE__, __LINE__, LogType::error, "Failed to load bullet file: " + filename);
+
+    if(importer->getNumCollisionShapes() == 0)
+      throw log(__FILE__, __LINE__, LogType::error, "The bullet file " + filename + " does not contain a collision shape");
+
+    // child shapes are stored before the shapes containing them
+    btCollisionShape *shape = importer->getCollisionShapeByIndex(importer->getNumCollisionShapes() - 1);
+
+    return d_shapeMap[filename] = shared_ptr<btCollisionShape>(shape, [importer](btCollisionShape *shape)
+                                                               {
+                                                                 importer->deleteAllData();
+                                                               });
+  }
+
+  shared_ptr<btCollisionShape> BulletManager::request(string const &name, Scene const &scene, ShapeType type)
+  {
+    auto iter = d_shapeMap.find(name);
+    if(iter != d_shapeMap.end())
+      return iter->second;
+
+    switch(type)
+    {
+      case triangleMesh:
+        return d_shapeMap[name] = triangleMeshShape(scene);
+      case convexHull:
+        return d_shapeMap[name] = convexHullShape(scene);
+      case convexDecomposition:
+        return d_shapeMap[name] = convexDecompositionShape(scene);
+    }
+
+    throw log(__FILE__, __LINE__, LogType::error, "Unknown shape type requested for " + name);
+  }
+
+  void BulletManager::bake(string const &name, string const &filename) const
+  {
+    auto iter = d_shapeMap.find(name);
+
+    if(iter == d_shapeMap.end())
+      throw log(__FILE__, __LINE__, LogType::error, "Couldn't bake " + name + " because it has never been loaded");
+
+    btDefaultSerializer serializer;
+    serializer.startSerialization();
+    iter->second->serializeSingleShape(&serializer);
+    serializer.finishSerialization();
+
+    ofstream file(filename, ios::binary);
+    if(not file.is_open())
+      throw log(__FILE__, __LINE__, LogType::error, "Can't open file " + filename + " for writing");
+
+    file.write(reinterpret_cast<char const*>(serializer.getBufferPointer()), serializer.getCurrentBufferSize());
+  }
+
+  void BulletManager::remove(string const &name)
+  {
+    auto iter = d_shapeMap.find(name);
+
+    if(iter == d_shapeMap.end())
+    {
+      log(__FILE__, __LINE__, LogType::warning, "Couldn't delete " + name + " because it has never been loaded");
+      return;
+    }
+
+    d_shapeMap.erase(iter);
+  }
+
+  shared_ptr<btRigidBody> BulletManager::createBody(shared_ptr<btCollisionShape> const &shape, float mass, btMotionState *motionState)
+  {
+    if(mass != 0 && shape->isConcave())
+    {
+      log(__FILE__, __LINE__, LogType::warning, "Concave shapes can only be used by static bodies");
+      mass = 0;
+    }
+
+    btVector3 inertia(0, 0, 0);
+    if(mass != 0)
+      shape->calculateLocalInertia(mass, inertia);
+
+    btRigidBody::btRigidBodyConstructionInfo info(mass, motionState, shape.get(), inertia);
+
+    return shared_ptr<btRigidBody>(new btRigidBody(info), [shape](btRigidBody *body)
+                                   {
+                                     delete body;
+                                   });
+  }
+}
@@ -0,0 +1,123 @@
+// drawqueue.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#include "dim/scene/drawqueue.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+namespace internal
+{
+  DrawQueue::DrawQueue(Order order)
+  :
+    d_order(order),
+    d_view(1.0)
+  {
+  }
+
+  void DrawQueue::setView(mat4 const &view)
+  {
+    d_view = view;
+  }
+
+  GLuint DrawQueue::depthKey(float depth) const
+  {
+    static_assert(sizeof(GLuint) == sizeof(float), "The depth key needs to be as large as a float");
+
+    GLuint bits;
+    memcpy(&bits, &depth, sizeof(bits));
+
+    // flip the bits so the floats sort as unsigned integers
+    if(bits & 0x80000000u)
+      bits = ~bits;
+    else
+      bits |= 0x80000000u;
+
+    if(d_order == backToFront)
+      bits = ~bits;
+
+    return bits;
+  }
+
+  void DrawQueue::add(mat4 const &matrix, ShaderScene const &state)
+  {
+    float depth = -(d_view * matrix[3]).z;
+
+    d_keys.push_back(Key{depthKey(depth), static_cast<GLuint>(d_items.size())});
+    d_items.push_back(Item{matrix, &state});
+  }
+
+  void DrawQueue::sort(size_t first, size_t last)
+  {
+    size_t count = last - first;
+    if(count < 2)
+      return;
+
+    if(d_buffer.size() < last)
+      reserveSort();
+
+    // every range has its own part of the buffer
+    Key *source = d_keys.data() + first;
+    Key *target = d_buffer.data() + first;
+
+    // least significant byte first, after four passes the keys are back in d_keys
+    for(uint shift = 0; shift != 32; shift += 8)
+    {
+      size_t offsets[257] = {0};
+
+      for(size_t idx = 0; idx != count; ++idx)
+        ++offsets[((source[idx].key >> shift) & 0xff) + 1];
+
+      for(size_t bucket = 0; bucket != 256; ++bucket)
+        offsets[bucket + 1] += offsets[bucket];
+
+      for(size_t idx = 0; idx != count; ++idx)
+        target[offsets[(source[idx].key >> shift) & 0xff]++] = source[idx];
+
+      std::swap(source, target);
+    }
+  }
+
+  void DrawQueue::reserveSort()
+  {
+    d_buffer.resize(d_keys.size());
+  }
+
+  void DrawQueue::clear()
+  {
+    d_items.clear();
+    d_keys.clear();
+  }
+
+  size_t DrawQueue::size() const
+  {
+    return d_items.size();
+  }
+
+  DrawQueue::Item const &DrawQueue::operator[](size_t idx) const
+  {
+    return d_items[d_keys[idx].item];
+  }
+}
+}
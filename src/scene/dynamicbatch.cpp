@@ -0,0 +1,268 @@
+// dynamicbatch.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#include "dim/scene/dynamicbatch.hpp"
+
+#include <algorithm>
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include "dim/core/jobsystem.hpp"
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+namespace internal
+{
+  namespace
+  {
+    size_t chunkBytes(size_t numOfVertices, size_t numOfIndices, size_t stride)
+    {
+      return numOfVertices * stride * sizeof(GLfloat) + numOfIndices * sizeof(GLushort);
+    }
+  }
+
+  size_t const DynamicBatch::streamSize;
+
+  DynamicBatch::DynamicBatch(size_t maxVertices)
+  :
+    d_geometry(make_shared<GeometryCache>()),
+    d_maxVertices(std::min(maxVertices, BatchGeometry::maxVertices)),
+    d_stream(streamSize),
+    d_transformed(false),
+    d_streaming(false),
+    d_numOfDrawCalls(0),
+    d_numOfNodes(0)
+  {
+  }
+
+  void DynamicBatch::setMaxVertices(size_t maxVertices)
+  {
+    d_maxVertices = std::min(maxVertices, BatchGeometry::maxVertices);
+  }
+
+  size_t DynamicBatch::maxVertices() const
+  {
+    return d_maxVertices;
+  }
+
+  bool DynamicBatch::batchable(DrawState const &drawState) const
+  {
+    if(d_maxVertices == 0)
+      return false;
+
+    Mesh const &mesh = drawState.mesh();
+
+    // a chunk has to fit in half of a frame of the stream
+    return mesh.numOfVertices() <= d_maxVertices && BatchGeometry::mergeable(mesh) &&
+           chunkBytes(mesh.numOfVertices(), 3 * mesh.numOfTriangles(), mesh.vertexSize() / sizeof(GLfloat)) <= streamSize / 2;
+  }
+
+  void DynamicBatch::add(ShaderScene const &state, DrawState const &drawState, mat4 const &matrix)
+  {
+    auto group = find_if(d_groups.begin(), d_groups.end(), [&](Group const &element)
+                         {
+                           return element.state.sameMaterial(state) &&
+                                  element.state.state().mesh().formats() == state.state().mesh().formats();
+                         });
+
+    if(group == d_groups.end())
+    {
+      d_groups.push_back(Group{state, {}, {}, {}, {}});
+      group = d_groups.end() - 1;
+    }
+
+    group->parts.push_back(Part{&geometry(drawState), matrix, 0, 0, 0});
+    ++d_numOfNodes;
+    d_transformed = false;
+  }
+
+  void DynamicBatch::layout(Group &group)
+  {
+    group.chunks.clear();
+
+    size_t numOfVertices = 0;
+    size_t numOfIndices = 0;
+
+    for(Part &part : group.parts)
+    {
+      BatchGeometry const &source = *part.geometry;
+      size_t stride = source.stride();
+
+      // the indices are 16 bit and a chunk is written to the stream at once
+      if(group.chunks.empty() ||
+         group.chunks.back().numOfVertices + source.numOfVertices() > BatchGeometry::maxVertices ||
+         chunkBytes(group.chunks.back().numOfVertices + source.numOfVertices(),
+                    group.chunks.back().numOfIndices + source.numOfIndices(), stride) > streamSize / 2)
+        group.chunks.push_back(Chunk{numOfVertices, 0, numOfIndices, 0});
+
+      Chunk &chunk = group.chunks.back();
+
+      part.firstVertex = numOfVertices;
+      part.firstIndex = numOfIndices;
+      part.base = chunk.numOfVertices;
+
+      chunk.numOfVertices += source.numOfVertices();
+      chunk.numOfIndices += source.numOfIndices();
+
+      numOfVertices += source.numOfVertices();
+      numOfIndices += source.numOfIndices();
+    }
+
+    size_t stride = group.state.state().mesh().vertexSize() / sizeof(GLfloat);
+    group.vertices.resize(numOfVertices * stride);
+    group.indices.resize(numOfIndices);
+  }
+
+  void DynamicBatch::transform()
+  {
+    if(d_transformed)
+      return;
+
+    // the parts of all groups are transformed together, so small groups don't leave threads idle
+    d_work.clear();
+    for(Group &group : d_groups)
+    {
+      layout(group);
+
+      for(Part const &part : group.parts)
+        d_work.push_back(make_pair(&group, &part));
+    }
+
+    JobSystem::instance().parallelFor(d_work.size(), [&](size_t idx)
+                                      {
+                                        Group &group = *d_work[idx].first;
+                                        Part const &part = *d_work[idx].second;
+                                        size_t stride = part.geometry->stride();
+
+                                        part.geometry->transformTo(group.vertices.data() + part.firstVertex * stride,
+                                                                   group.indices.data() + part.firstIndex, part.base,
+                                                                   group.state.state().mesh().formats(), part.matrix,
+                                                                   mat3(inverseTranspose(mat3(part.matrix))));
+                                      }, 16);
+
+    d_transformed = true;
+  }
+
+  size_t DynamicBatch::size() const
+  {
+    return d_groups.size();
+  }
+
+  bool DynamicBatch::empty(size_t group) const
+  {
+    return d_groups[group].parts.size() == 0;
+  }
+
+  ShaderScene const &DynamicBatch::state(size_t group) const
+  {
+    return d_groups[group].state;
+  }
+
+  void DynamicBatch::draw(size_t idx, size_t renderMode)
+  {
+    transform();
+
+    // the regions of the stream are fenced per frame
+    if(not d_streaming)
+    {
+      d_stream.nextFrame();
+      d_streaming = true;
+    }
+
+    Group &group = d_groups[idx];
+    Mesh const &mesh = group.state.state().mesh();
+    size_t stride = mesh.vertexSize() / sizeof(GLfloat);
+
+    // the vertices are already in world space
+    group.state.shader(renderMode).set("in_mat_model", mat4(1.0));
+    group.state.shader(renderMode).set("in_mat_normal", mat3(1.0));
+
+    for(Chunk const &chunk : group.chunks)
+    {
+      size_t vertexBytes = chunk.numOfVertices * stride * sizeof(GLfloat);
+      size_t indexBytes = chunk.numOfIndices * sizeof(GLushort);
+
+      // a frame that doesn't fit moves on to the next region, which waits when the GPU still reads it
+      if(vertexBytes + indexBytes + 32 > d_stream.remaining())
+        d_stream.nextFrame();
+
+      size_t vertexOffset = d_stream.write(group.vertices.data() + chunk.firstVertex * stride, vertexBytes);
+      size_t indexOffset = d_stream.write(group.indices.data() + chunk.firstIndex, indexBytes);
+
+      mesh.drawStreamed(d_stream, vertexOffset, indexOffset, chunk.numOfIndices);
+      ++d_numOfDrawCalls;
+    }
+  }
+
+  void DynamicBatch::clear()
+  {
+    // forget the materials that were not used last frame
+    d_groups.erase(remove_if(d_groups.begin(), d_groups.end(), [](Group const &group)
+                             {
+                               return group.parts.size() == 0;
+                             }), d_groups.end());
+
+    for(Group &group : d_groups)
+    {
+      group.parts.clear();
+      group.chunks.clear();
+    }
+
+    d_transformed = false;
+    d_streaming = false;
+    d_numOfDrawCalls = 0;
+    d_numOfNodes = 0;
+  }
+
+  void DynamicBatch::clearCache()
+  {
+    d_geometry->clear();
+  }
+
+  void DynamicBatch::shareCache(DynamicBatch &other) const
+  {
+    other.d_geometry = d_geometry;
+  }
+
+  size_t DynamicBatch::numOfDrawCalls() const
+  {
+    return d_numOfDrawCalls;
+  }
+
+  size_t DynamicBatch::numOfNodes() const
+  {
+    return d_numOfNodes;
+  }
+
+  BatchGeometry const &DynamicBatch::geometry(DrawState const &drawState)
+  {
+    Mesh const &mesh = drawState.mesh();
+    auto iter = d_geometry->find(mesh.id());
+
+    // the copy of the mesh keeps its id from being reused
+    if(iter == d_geometry->end())
+      iter = d_geometry->insert(make_pair(mesh.id(), make_pair(mesh, drawState.geometry()))).first;
+
+    return iter->second.second;
+  }
+}
+}
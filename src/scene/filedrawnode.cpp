@@ -73,6 +73,59 @@ namespace dim
 
     if(not present)
       throw log(__FILE__, __LINE__, LogType::error, "The file " + filename + " needs to be loaded first with the static 'load' member");
+
+    createBody();
+  }
+
+  FileDrawNode::FileDrawNode(FileDrawNode const &other)
+  :
+      NodeBase(other),
+      d_index(other.d_index),
+      d_sceneIdx(other.d_sceneIdx)
+  {
+    createBody();
+  }
+
+  FileDrawNode &FileDrawNode::operator=(FileDrawNode const &other)
+  {
+    // the old body has to leave the world of the graph before it is freed
+    if(parent() != 0)
+      parent()->detachBody(this);
+
+    NodeBase::operator=(other);
+    d_index = other.d_index;
+    d_sceneIdx = other.d_sceneIdx;
+
+    createBody();
+
+    if(parent() != 0)
+      parent()->attachBody(this);
+
+    return *this;
+  }
+
+  void FileDrawNode::createBody()
+  {
+    d_rigidBody.reset();
+
+    if(d_index >= objects().size())
+      return;
+
+    Object const &object = objects()[d_index];
+
+    if(object.shapes[d_sceneIdx] != 0)
+      d_rigidBody = BulletManager::createBody(object.shapes[d_sceneIdx], object.masses[d_sceneIdx], motionState());
+  }
+
+  void FileDrawNode::replaceBody()
+  {
+    if(parent() != 0)
+      parent()->detachBody(this);
+
+    createBody();
+
+    if(parent() != 0)
+      parent()->attachBody(this);
   }
 
   vector<Scene> parseScenes(YAML::Node const *node, string const &filename, string const &directory, TextureManager &texRes, SceneManager &sceneRes, BulletManager &bulletRes)
@@ -98,6 +151,60 @@ namespace dim
     return scenes;
   }
 
+  BulletManager::ShapeType parseShapeType(string const &type, string const &filename)
+  {
+    if(type == "triangleMesh")
+      return BulletManager::triangleMesh;
+    if(type == "convexHull")
+      return BulletManager::convexHull;
+    if(type == "convexDecomposition")
+      return BulletManager::convexDecomposition;
+
+    throw log(__FILE__, __LINE__, LogType::error, "Unknown shape " + type + " in " + filename);
+  }
+
+  void parseShapes(YAML::Node const *node, string const &filename, string const &directory, vector<Scene> const &scenes,
+                   BulletManager &bulletRes, vector<shared_ptr<btCollisionShape>> &shapes, vector<float> &masses)
+  {
+    size_t sceneIdx = 0;
+    for(YAML::Iterator it = node->begin(); it != node->end(); ++it, ++sceneIdx)
+    {
+      float mass = 0;
+      if(YAML::Node const *massNode = it->FindValue("mass"))
+        *massNode >> mass;
+
+      shared_ptr<btCollisionShape> shape;
+
+      YAML::Node const *shapeNode = it->FindValue("shape");
+      YAML::Node const *shapeFileNode = it->FindValue("shapeFile");
+
+      string shapeFile;
+      if(shapeFileNode != 0)
+        *shapeFileNode >> shapeFile;
+
+      // a baked shape loads a lot faster than building it from the scene
+      if(shapeFileNode != 0 && ifstream(directory + shapeFile).is_open())
+        shape = bulletRes.request(directory + shapeFile);
+      else if(shapeNode != 0)
+      {
+        string sceneFile;
+        string type;
+        (*it)["modelFile"] >> sceneFile;
+        *shapeNode >> type;
+
+        // all objects using the same model share the shape
+        string name = directory + sceneFile + ':' + type;
+        shape = bulletRes.request(name, scenes[sceneIdx], parseShapeType(type, filename));
+
+        if(shapeFileNode != 0)
+          bulletRes.bake(name, directory + shapeFile);
+      }
+
+      shapes.push_back(shape);
+      masses.push_back(mass);
+    }
+  }
+
   vector<Shader> parseShaders(YAML::Node const *node, vector<Shader> &defaultShaders, string const &directory, ShaderManager &shaderRes)
   {
     if(node == 0)
@@ -149,7 +256,11 @@ namespace dim
       vector<Scene> scenes = parseScenes(document.FindValue("Scenes"), filename, directory, texRes, sceneRes, bulletRes);
       vector<Shader> shaders = parseShaders(document.FindValue("Shaders"), defaultShaders(), directory, shaderRes);
 
-      objects().push_back({filename, shaders, scenes});
+      vector<shared_ptr<btCollisionShape>> shapes;
+      vector<float> masses;
+      parseShapes(document.FindValue("Scenes"), filename, directory, scenes, bulletRes, shapes, masses);
+
+      objects().push_back({filename, shaders, scenes, shapes, masses});
     }
     catch(exception &except)
     {
@@ -165,6 +276,8 @@ namespace dim
   void FileDrawNode::setSceneNumber(uint index)
   {
     d_sceneIdx = index;
+    replaceBody();
+    setModified();
   }
 
   uint FileDrawNode::numberOfScenes() const
@@ -189,8 +302,7 @@ namespace dim
 
   btRigidBody *FileDrawNode::rigidBody()
   {
-    return 0;
-    //return &objects()[d_index].rigidBody;
+    return d_rigidBody.get();
   }
 
   NodeBase *FileDrawNode::clone() const
@@ -233,5 +345,7 @@ namespace dim
 
     setLocation(l_coor);
     setOrientation(l_rotation);
+
+    replaceBody();
   }
 }
@@ -0,0 +1,340 @@
+// journal.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#include "dim/scene/journal.hpp"
+#include "dim/core/dim.hpp"
+
+#include <sstream>
+#include <cstdio>
+#include <iterator>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace dim
+{
+namespace internal
+{
+  namespace
+  {
+    char const header[] = "#dim base 1"; ///< The first line of a base, records never start with #
+
+    bool sync(string const &path, int flags)
+    {
+      int fd = open(path.c_str(), flags);
+      if(fd == -1)
+        return false;
+
+      bool synced = fsync(fd) == 0;
+      close(fd);
+
+      return synced;
+    }
+
+    string directory(string const &filename)
+    {
+      size_t slash = filename.find_last_of('/');
+      if(slash == string::npos)
+        return ".";
+
+      return slash == 0 ? "/" : filename.substr(0, slash);
+    }
+  }
+
+  Journal::Journal(string const &filename, size_t maxSize)
+  :
+    d_filename(filename),
+    d_maxSize(maxSize),
+    d_size(0),
+    d_writing(false),
+    d_running(true)
+  {
+    // records appended behind a torn one would never be read back
+    map<uint64_t, string> journal;
+    if(apply(journalName(d_filename), journal))
+    {
+      d_journal.open(journalName(d_filename), ios::binary | ios::app);
+
+      ifstream existing(journalName(d_filename), ios::binary | ios::ate);
+      if(existing.is_open())
+        d_size = existing.tellg();
+    }
+    else
+      compact();
+
+    if(not d_journal.is_open())
+      throw log(__FILE__, __LINE__, LogType::error, "Can't open the journal of " + d_filename + " for writing");
+
+    d_writer = thread(&Journal::run, this);
+  }
+
+  Journal::~Journal()
+  {
+    {
+      lock_guard<mutex> lock(d_mutex);
+      d_running = false;
+    }
+
+    d_condition.notify_all();
+    d_writer.join();
+  }
+
+  void Journal::append(vector<Record> &&records)
+  {
+    if(records.empty())
+      return;
+
+    {
+      lock_guard<mutex> lock(d_mutex);
+      d_queue.insert(d_queue.end(), make_move_iterator(records.begin()), make_move_iterator(records.end()));
+    }
+
+    records.clear();
+    d_condition.notify_all();
+  }
+
+  void Journal::flush()
+  {
+    unique_lock<mutex> lock(d_mutex);
+    d_condition.wait(lock, [this]()
+                     {
+                       return d_queue.empty() && not d_writing;
+                     });
+  }
+
+  void Journal::setMaxSize(size_t maxSize)
+  {
+    lock_guard<mutex> lock(d_mutex);
+    d_maxSize = maxSize;
+  }
+
+  string Journal::journalName(string const &filename)
+  {
+    return filename + ".journal";
+  }
+
+  bool Journal::plain(string const &filename)
+  {
+    ifstream file(filename, ios::binary);
+
+    string line;
+    return not getline(file, line) || line != header;
+  }
+
+  map<uint64_t, string> Journal::replay(string const &filename)
+  {
+    map<uint64_t, string> nodes;
+
+    ifstream base(filename, ios::binary);
+    if(base.is_open() && plain(filename))
+      log(__FILE__, __LINE__, LogType::warning, filename + " was written by save, open it with loadJournal first, its nodes were skipped");
+    else if(not apply(filename, nodes))
+      log(__FILE__, __LINE__, LogType::warning, "The base file " + filename + " ends in a damaged record, which was skipped");
+
+    if(not apply(journalName(filename), nodes))
+      log(__FILE__, __LINE__, LogType::warning, "Skipped the record torn at the end of the journal of " + filename);
+
+    return nodes;
+  }
+
+  void Journal::run()
+  {
+    unique_lock<mutex> lock(d_mutex);
+
+    while(true)
+    {
+      d_condition.wait(lock, [this]()
+                       {
+                         return not d_queue.empty() || not d_running;
+                       });
+
+      // everything appended before stopping is still written
+      if(d_queue.empty())
+        return;
+
+      vector<Record> records;
+      records.swap(d_queue);
+      d_writing = true;
+      size_t maxSize = d_maxSize;
+
+      lock.unlock();
+
+      write(records);
+      if(d_size > maxSize)
+        compact();
+
+      lock.lock();
+
+      d_writing = false;
+      d_condition.notify_all();
+    }
+  }
+
+  void Journal::write(vector<Record> const &records)
+  {
+    // one write per batch, so a crash tears at most the last record
+    ostringstream buffer;
+    for(Record const &record : records)
+      write(buffer, record);
+
+    string const &data = buffer.str();
+    d_journal.write(data.data(), data.size());
+    d_journal.flush();
+
+    if(not d_journal)
+      log(__FILE__, __LINE__, LogType::warning, "Failed to append to the journal of " + d_filename);
+
+    d_size += data.size();
+  }
+
+  void Journal::compact()
+  {
+    d_journal.flush();
+
+    map<uint64_t, string> nodes = replay(d_filename);
+
+    if(not writeBase(d_filename, nodes))
+    {
+      log(__FILE__, __LINE__, LogType::warning, "The journal of " + d_filename + " is kept");
+      return;
+    }
+
+    // replaying the old journal once more on the new base gives the same nodes, so a crash before this is harmless
+    d_journal.close();
+    d_journal.clear();
+    d_journal.open(journalName(d_filename), ios::binary | ios::trunc);
+    d_size = 0;
+  }
+
+  bool Journal::writeBase(string const &filename, map<uint64_t, string> const &nodes)
+  {
+    string temporary = filename + ".tmp";
+    {
+      ofstream base(temporary, ios::binary | ios::trunc);
+      base << header << '\n';
+      for(auto const &node : nodes)
+        write(base, Record{Record::put, node.first, node.second});
+
+      base.flush();
+      if(not base)
+      {
+        log(__FILE__, __LINE__, LogType::warning, "Failed to write " + temporary);
+        return false;
+      }
+    }
+
+    // the new base has to be on disk before it replaces the old one, or a
+    // crash could leave an empty file under the name of the base
+    if(not sync(temporary, O_WRONLY))
+    {
+      log(__FILE__, __LINE__, LogType::warning, "Failed to sync " + temporary);
+      return false;
+    }
+
+    // the old base stays complete until the rename replaces it at once
+    if(rename(temporary.c_str(), filename.c_str()) != 0)
+    {
+      log(__FILE__, __LINE__, LogType::warning, "Failed to replace " + filename);
+      return false;
+    }
+
+    // and the rename has to be on disk before the journal is emptied
+    if(not sync(directory(filename), O_RDONLY | O_DIRECTORY))
+    {
+      log(__FILE__, __LINE__, LogType::warning, "Failed to sync the directory of " + filename);
+      return false;
+    }
+
+    return true;
+  }
+
+  bool Journal::read(istream &in, Record &record)
+  {
+    char type;
+    uint64_t id;
+    size_t length;
+
+    if(not (in >> type >> id >> length) || in.get() != '\n')
+      return false;
+
+    if(type != Record::put && type != Record::remove && type != Record::clear)
+      return false;
+
+    record.data.resize(length);
+    if(length != 0 && not in.read(&record.data[0], length))
+      return false;
+
+    if(in.get() != '\n')
+      return false;
+
+    record.type = static_cast<Record::Type>(type);
+    record.id = id;
+    return true;
+  }
+
+  void Journal::write(ostream &out, Record const &record)
+  {
+    out << static_cast<char>(record.type) << ' ' << record.id << ' ' << record.data.size() << '\n';
+    out.write(record.data.data(), record.data.size());
+    out << '\n';
+  }
+
+  bool Journal::apply(string const &filename, map<uint64_t, string> &nodes)
+  {
+    ifstream file(filename, ios::binary);
+    if(not file.is_open())
+      return true;
+
+    // a base starts with its header, a journal doesn't
+    string line;
+    if(file.peek() == header[0] && not (getline(file, line) && line == header))
+      return false;
+
+    Record record;
+    while(true)
+    {
+      streampos start = file.tellg();
+
+      if(not read(file, record))
+      {
+        // anything but the end of the file behind the last record is a torn record
+        file.clear();
+        file.seekg(start);
+        return file.peek() == ifstream::traits_type::eof();
+      }
+
+      switch(record.type)
+      {
+        case Record::put:
+          nodes[record.id].swap(record.data);
+          break;
+        case Record::remove:
+          nodes.erase(record.id);
+          break;
+        case Record::clear:
+          nodes.clear();
+          break;
+      }
+    }
+  }
+}
+}
@@ -0,0 +1,177 @@
+// material.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#include "dim/scene/material.hpp"
+
+#include <deque>
+#include <mutex>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+using namespace std;
+using namespace glm;
+
+namespace dim
+{
+  namespace
+  {
+    struct Table
+    {
+      mutex lock;
+      deque<Material> materials;                   ///< A deque, so the materials never move
+      unordered_multimap<size_t, uint32_t> index; ///< The ids of the materials by hash
+    };
+
+    Table &table()
+    {
+      static Table materials;
+      return materials;
+    }
+
+    void combine(size_t &seed, size_t value)
+    {
+      seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+
+    void combine(size_t &seed, vec3 const &value)
+    {
+      for(size_t idx = 0; idx != 3; ++idx)
+        combine(seed, std::hash<float>()(value[idx]));
+    }
+  }
+
+  Material::Material(vector<pair<Texture<GLubyte>, string>> const &textures, vec3 const &ambient, vec3 const &diffuse,
+                     vec3 const &specular, float shininess, bool transparent)
+  :
+      d_textures(textures),
+      d_ambient(ambient),
+      d_diffuse(diffuse),
+      d_specular(specular),
+      d_shininess(shininess),
+      d_transparent(transparent),
+      d_hash(0)
+  {
+    sort(d_textures.begin(), d_textures.end(), [](pair<Texture<GLubyte>, string> const &lhs, pair<Texture<GLubyte>, string> const &rhs)
+    {
+      return lhs.first.id() < rhs.first.id();
+    });
+
+    for(auto const &texture : d_textures)
+    {
+      combine(d_hash, texture.first.id());
+      combine(d_hash, std::hash<string>()(texture.second));
+    }
+
+    combine(d_hash, d_ambient);
+    combine(d_hash, d_diffuse);
+    combine(d_hash, d_specular);
+    combine(d_hash, std::hash<float>()(d_shininess));
+    combine(d_hash, d_transparent);
+  }
+
+  vector<pair<Texture<GLubyte>, string>> const &Material::textures() const
+  {
+    return d_textures;
+  }
+
+  vec3 const &Material::ambientIntensity() const
+  {
+    return d_ambient;
+  }
+
+  vec3 const &Material::diffuseIntensity() const
+  {
+    return d_diffuse;
+  }
+
+  vec3 const &Material::specularIntensity() const
+  {
+    return d_specular;
+  }
+
+  float Material::shininess() const
+  {
+    return d_shininess;
+  }
+
+  bool Material::transparent() const
+  {
+    return d_transparent;
+  }
+
+  size_t Material::hash() const
+  {
+    return d_hash;
+  }
+
+  bool Material::operator==(Material const &other) const
+  {
+    if(d_hash != other.d_hash || d_textures.size() != other.d_textures.size())
+      return false;
+
+    for(size_t idx = 0; idx != d_textures.size(); ++idx)
+    {
+      if(d_textures[idx].first.id() != other.d_textures[idx].first.id() || d_textures[idx].second != other.d_textures[idx].second)
+        return false;
+    }
+
+    return d_ambient == other.d_ambient && d_diffuse == other.d_diffuse && d_specular == other.d_specular &&
+           d_shininess == other.d_shininess && d_transparent == other.d_transparent;
+  }
+
+  uint32_t Material::intern(Material const &material)
+  {
+    Table &materials = table();
+    lock_guard<mutex> guard(materials.lock);
+
+    auto range = materials.index.equal_range(material.d_hash);
+    for(auto iter = range.first; iter != range.second; ++iter)
+    {
+      if(materials.materials[iter->second] == material)
+        return iter->second;
+    }
+
+    uint32_t id = materials.materials.size();
+    materials.materials.push_back(material);
+    materials.index.insert(make_pair(material.d_hash, id));
+
+    return id;
+  }
+
+  Material const &Material::get(uint32_t id)
+  {
+    Table &materials = table();
+    lock_guard<mutex> guard(materials.lock);
+
+    if(id >= materials.materials.size())
+      throw log(__FILE__, __LINE__, LogType::error, "No material was interned with id " + to_string(id));
+
+    return materials.materials[id];
+  }
+
+  size_t Material::numOfMaterials()
+  {
+    Table &materials = table();
+    lock_guard<mutex> guard(materials.lock);
+
+    return materials.materials.size();
+  }
+}
@@ -0,0 +1,144 @@
+// meshlet.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#include "dim/scene/meshlet.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+  namespace
+  {
+    Meshlet bounds(vector<vec3> const &positions, vector<GLuint> const &indices, size_t first, size_t last,
+                   vector<GLuint> const &vertices)
+    {
+      Meshlet meshlet{first, last - first, vec3(0.0), 0, vec3(0.0, 0.0, 1.0), float(M_PI)};
+
+      // sphere around the center of the bounding box
+      vec3 minimum = positions[vertices.front()];
+      vec3 maximum = minimum;
+      for(GLuint vertex : vertices)
+      {
+        minimum = glm::min(minimum, positions[vertex]);
+        maximum = glm::max(maximum, positions[vertex]);
+      }
+
+      meshlet.center = (minimum + maximum) * 0.5f;
+      for(GLuint vertex : vertices)
+        meshlet.radius = std::max(meshlet.radius, length(positions[vertex] - meshlet.center));
+
+      // normal cone, degenerate triangles don't face anywhere
+      vector<vec3> normals;
+      vec3 axis(0.0);
+      for(size_t idx = first; idx != last; idx += 3)
+      {
+        vec3 const &corner = positions[indices[idx]];
+        vec3 normal = cross(positions[indices[idx + 1]] - corner, positions[indices[idx + 2]] - corner);
+
+        float area = length(normal);
+        if(area == 0)
+          continue;
+
+        normals.push_back(normal / area);
+        axis += normals.back();
+      }
+
+      float axisLength = length(axis);
+      if(axisLength == 0)
+        return meshlet;
+
+      meshlet.coneAxis = axis / axisLength;
+
+      float minDot = 1;
+      for(vec3 const &normal : normals)
+        minDot = std::min(minDot, dot(normal, meshlet.coneAxis));
+
+      meshlet.coneAngle = acos(std::max(-1.0f, minDot));
+
+      return meshlet;
+    }
+  }
+
+  bool Meshlet::backFacing(vec3 const &eye) const
+  {
+    if(coneAngle >= M_PI / 2)
+      return false;
+
+    vec3 view = center - eye;
+    float distance = length(view);
+    if(distance <= radius)
+      return false;
+
+    // the directions to the triangles deviate at most spread from view
+    float spread = asin(radius / distance);
+    float angle = acos(std::max(-1.0f, std::min(1.0f, dot(view / distance, coneAxis))));
+
+    return angle + coneAngle + spread < M_PI / 2;
+  }
+
+  vector<Meshlet> buildMeshlets(vector<vec3> const &positions, vector<GLuint> const &indices,
+                                size_t maxVertices, size_t maxTriangles)
+  {
+    vector<Meshlet> meshlets;
+
+    // the meshlet that last took a vertex, so a vertex is counted once per meshlet
+    vector<size_t> owner(positions.size(), numeric_limits<size_t>::max());
+    vector<GLuint> vertices;
+
+    size_t end = indices.size() - indices.size() % 3;
+    size_t first = 0;
+
+    for(size_t idx = 0; idx != end; idx += 3)
+    {
+      size_t added = 0;
+      for(size_t corner = 0; corner != 3; ++corner)
+      {
+        if(owner[indices[idx + corner]] != meshlets.size())
+          ++added;
+      }
+
+      if(vertices.size() + added > maxVertices || (idx - first) / 3 == maxTriangles)
+      {
+        meshlets.push_back(bounds(positions, indices, first, idx, vertices));
+        vertices.clear();
+        first = idx;
+      }
+
+      for(size_t corner = 0; corner != 3; ++corner)
+      {
+        GLuint vertex = indices[idx + corner];
+        if(owner[vertex] == meshlets.size())
+          continue;
+
+        owner[vertex] = meshlets.size();
+        vertices.push_back(vertex);
+      }
+    }
+
+    if(first != end)
+      meshlets.push_back(bounds(positions, indices, first, end, vertices));
+
+    return meshlets;
+  }
+}
@@ -34,7 +34,9 @@ namespace dim
       d_parent(0),
       d_scale(vec3(1.0)),
       d_modelMatrix(mat4(1.0)),
-      d_changed(true)
+      d_changed(true),
+      d_static(false),
+      d_modified(true)
   {
   }
 
@@ -46,8 +48,43 @@ namespace dim
       d_orient(orient),
       d_scale(scale),
       d_modelMatrix(mat4(1.0)),
-      d_changed(true)
+      d_changed(true),
+      d_static(false),
+      d_modified(true)
   {
+    d_motionState.setTransform(bodyTransform());
+  }
+
+  NodeBase::NodeBase(NodeBase const &other)
+  :
+      d_motionState(this),
+      d_parent(other.d_parent),
+      d_coor(other.d_coor),
+      d_orient(other.d_orient),
+      d_scale(other.d_scale),
+      d_modelMatrix(other.d_modelMatrix),
+      d_changed(other.d_changed),
+      d_static(other.d_static),
+      d_modified(other.d_modified)
+  {
+    d_motionState.setTransform(bodyTransform());
+  }
+
+  NodeBase &NodeBase::operator=(NodeBase const &other)
+  {
+    d_parent = other.d_parent;
+    d_coor = other.d_coor;
+    d_orient = other.d_orient;
+    d_scale = other.d_scale;
+    d_modelMatrix = other.d_modelMatrix;
+    d_changed = other.d_changed;
+    d_static = other.d_static;
+    d_modified = true;
+
+    if(d_parent == 0)
+      d_motionState.setTransform(bodyTransform());
+
+    return *this;
   }
 
   glm::vec3 NodeBase::location() const
@@ -60,9 +97,19 @@ namespace dim
     vec3 oldCoor(d_coor);
     d_coor = coor;
     d_changed = true;
+    d_modified = true;
+
+    // a SceneGraph hands the transform to its physics thread
+    if(d_parent == 0)
+      d_motionState.setTransform(bodyTransform());
 
     if(d_parent != 0)
+    {
       d_parent->updateNode(this, oldCoor, coor);
+
+      if(d_static)
+        d_parent->changedNode(this);
+    }
   }
 
   glm::quat const &NodeBase::orientation() const
@@ -74,6 +121,13 @@ namespace dim
   {
     d_orient = orient;
     d_changed = true;
+    d_modified = true;
+
+    if(d_parent == 0)
+      d_motionState.setTransform(bodyTransform());
+
+    if(d_static && d_parent != 0)
+      d_parent->changedNode(this);
   }
 
   glm::vec3 const &NodeBase::scaling() const
@@ -85,6 +139,10 @@ namespace dim
   {
     d_scale = scale;
     d_changed = true;
+    d_modified = true;
+
+    if(d_static && d_parent != 0)
+      d_parent->changedNode(this);
   }
 
   void NodeBase::setChanged()
@@ -92,6 +150,33 @@ namespace dim
     d_changed = true;
   }
 
+  bool NodeBase::isStatic() const
+  {
+    return d_static;
+  }
+
+  void NodeBase::setStatic(bool isStatic)
+  {
+    if(d_static == isStatic)
+      return;
+
+    d_static = isStatic;
+    d_modified = true;
+
+    if(d_parent != 0)
+      d_parent->changedNode(this);
+  }
+
+  bool NodeBase::modified() const
+  {
+    return d_modified;
+  }
+
+  void NodeBase::setModified(bool modified)
+  {
+    d_modified = modified;
+  }
+
   mat4 const &NodeBase::matrix()
   {
     if(d_changed)
@@ -136,10 +221,10 @@ namespace dim
   {
     shader(0).use();
 
-    shader(0).set("in_mat_model", matrix());
-
     for(size_t mesh = 0; mesh != scene().size(); ++mesh)
     {
+      shader(0).set("in_mat_model", matrix() * scene()[mesh].mesh().positionTransform());
+
       for(size_t idx = 0; idx != scene()[mesh].textures().size(); ++idx)
         shader(0).set(scene()[mesh].textures()[idx].second, scene()[mesh].textures()[idx].first, idx);
 
@@ -192,27 +277,37 @@ namespace dim
     return &d_motionState;
   }
 
+  btTransform NodeBase::bodyTransform() const
+  {
+    return btTransform(btQuaternion(d_orient.x, d_orient.y, d_orient.z, d_orient.w), btVector3(d_coor.x, d_coor.y, d_coor.z));
+  }
+
   MotionState::MotionState(NodeBase *node)
   :
-      d_node(node)
+      d_node(node),
+      d_transform(btTransform::getIdentity())
   {
   }
 
   void MotionState::getWorldTransform(btTransform &worldTransform) const
   {
-    glm::quat const &orient = d_node->orientation();
-    glm::vec3 const &coor = d_node->location();
+    worldTransform = d_transform;
+  }
 
-    worldTransform = btTransform(btQuaternion(orient.x, orient.y, orient.z, orient.w), btVector3(coor.x, coor.y, coor.z));
+  void MotionState::setTransform(btTransform const &transform)
+  {
+    d_transform = transform;
+  }
+
+  NodeBase *MotionState::node() const
+  {
+    return d_node;
   }
 
   void MotionState::setWorldTransform(btTransform const &worldTransform)
   {
-    btQuaternion orient = worldTransform.getRotation();
-    btVector3 coor = worldTransform.getOrigin();
-    d_node->setOrientation(glm::quat(orient.w(), orient.x(), orient.y(), orient.z()));
-    d_node->setLocation(glm::vec3(coor.x(), coor.y(), coor.z()));
-    d_node->setChanged();
+    // the SceneGraph publishes the transforms of its bodies after every step
+    // and moves the nodes on the render thread
   }
 
 }
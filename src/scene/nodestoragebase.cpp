@@ -19,10 +19,114 @@
 
 #include "dim/scene/nodestoragebase.hpp"
 
+#include <map>
+#include <mutex>
+
 using namespace std;
 
 namespace dim
 {
+  struct ShaderScene::StateTable
+  {
+    struct Entry
+    {
+      weak_ptr<DrawState const> state;
+      uint32_t id;
+    };
+
+    mutex lock; ///< Nodes are added on any thread that applies commands or rebuilds batches
+    map<pair<uint32_t, uint64_t>, Entry> states; ///< By the id of the material and the serial of the state
+    vector<uint32_t> freeIds;
+    uint32_t numOfIds = 0;
+
+    unordered_map<GLuint, Shader> shaders;
+  };
+
+  // the last ShaderScene of a state takes it out of the table
+  struct ShaderScene::Release
+  {
+    pair<uint32_t, uint64_t> key;
+    uint32_t id;
+
+    void operator()(DrawState const *state) const
+    {
+      StateTable &table = stateTable();
+      {
+        lock_guard<mutex> guard(table.lock);
+
+        // a state made in the meantime for the same key has another id
+        auto iter = table.states.find(key);
+        if(iter != table.states.end() && iter->second.id == id)
+          table.states.erase(iter);
+
+        table.freeIds.push_back(id);
+      }
+
+      delete state;
+    }
+  };
+
+  ShaderScene::StateTable &ShaderScene::stateTable()
+  {
+    // never destroyed, ShaderScenes in static objects may outlive it
+    static StateTable *table = new StateTable;
+    return *table;
+  }
+
+  ShaderScene::ShaderScene(NodeBase const &node, size_t sceneIdx, size_t numOfShaders)
+  {
+    DrawState const &state = node.scene()[sceneIdx];
+    pair<uint32_t, uint64_t> key(state.materialId(), state.serial());
+
+    StateTable &table = stateTable();
+    lock_guard<mutex> guard(table.lock);
+
+    auto iter = table.states.find(key);
+    if(iter != table.states.end())
+      d_state = iter->second.state.lock();
+
+    if(d_state)
+      d_stateId = iter->second.id;
+    else
+    {
+      if(table.freeIds.empty())
+        d_stateId = table.numOfIds++;
+      else
+      {
+        d_stateId = table.freeIds.back();
+        table.freeIds.pop_back();
+      }
+
+      d_state.reset(new DrawState(state), Release{key, d_stateId});
+      table.states[key] = StateTable::Entry{d_state, d_stateId};
+    }
+
+    for(size_t shader = 0; shader != numOfShaders; ++shader)
+    {
+      GLuint shaderId = node.shader(shader).id();
+
+      d_shaderIds.push_back(shaderId);
+      if(table.shaders.find(shaderId) == table.shaders.end())
+        table.shaders.insert(make_pair(shaderId, node.shader(shader)));
+    }
+  }
+
+  Shader &ShaderScene::shader(size_t idx)
+  {
+    StateTable &table = stateTable();
+    lock_guard<mutex> guard(table.lock);
+
+    auto iter = table.shaders.find(d_shaderIds.at(idx));
+    if(iter == table.shaders.end())
+      throw log(__FILE__, __LINE__, LogType::error, "This should never throw, bug in the ShaderScene code");
+
+    return iter->second;
+  }
+
+  Shader const &ShaderScene::shader(size_t idx) const
+  {
+    return const_cast<ShaderScene*>(this)->shader(idx);
+  }
 
 namespace internal
 {
@@ -38,9 +142,25 @@ namespace internal
     v_clear();
   }
 
-  void NodeStorageBase::draw(ShaderScene const &state, size_t renderMode)
+  void NodeStorageBase::cull(Visibility const &visibility)
+  {
+    v_cull(visibility);
+  }
+
+  void NodeStorageBase::collect(ShaderScene const &state, DrawQueue &queue, DynamicBatch &dynamicBatch)
+  {
+    v_collect(state, queue, dynamicBatch);
+  }
+
+  void NodeStorageBase::rebuildStatic(vector<shared_ptr<StaticMesh>> &retired)
   {
-    v_draw(state, renderMode);
+    v_rebuildStatic(retired);
+  }
+
+  void NodeStorageBase::collectStatic(ShaderScene const &state, vector<shared_ptr<StaticMesh>> &meshes,
+                                      Visibility const &visibility)
+  {
+    v_collectStatic(state, meshes, visibility);
   }
 
   NodeStorageBase::iterator NodeStorageBase::find(NodeBase* node)
@@ -68,6 +188,16 @@ namespace internal
     return v_updateNode(node, from, to);
   }
 
+  bool NodeStorageBase::changedNode(NodeBase *node)
+  {
+    return v_changedNode(node);
+  }
+
+  void NodeStorageBase::setStaticBatching(bool batching)
+  {
+    v_setStaticBatching(batching);
+  }
+
   /* iterators */
   void NodeStorageBase::Iterable::increment()
   {
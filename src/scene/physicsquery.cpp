@@ -0,0 +1,285 @@
+// physicsquery.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#include "dim/scene/physicsquery.hpp"
+#include "dim/core/jobsystem.hpp"
+
+#include <algorithm>
+
+#include <BulletCollision/NarrowPhaseCollision/btGjkEpa2.h>
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+namespace internal
+{
+  namespace
+  {
+    size_t const s_minQueriesPerJob = 64;
+
+    btVector3 toBullet(vec3 const &value)
+    {
+      return btVector3(value.x, value.y, value.z);
+    }
+
+    vec3 toGlm(btVector3 const &value)
+    {
+      return vec3(value.x(), value.y(), value.z());
+    }
+
+    // the nodes tag the bodies they own with their MotionState, the user
+    // pointer of other bodies can be anything
+    NodeBase *nodeOf(btCollisionObject const *object)
+    {
+      btRigidBody const *body = btRigidBody::upcast(object);
+      if(body == 0)
+        return 0;
+
+      MotionState const *motionState = dynamic_cast<MotionState const*>(body->getMotionState());
+      return motionState == 0 ? 0 : motionState->node();
+    }
+
+    template <typename Body>
+    Body const &bodyOf(btDbvtNode const *leaf)
+    {
+      return *static_cast<Body const*>(leaf->data);
+    }
+
+    template <typename Body>
+    struct Cloner : public btDbvt::IClone
+    {
+      vector<Body> &bodies;
+
+      Cloner(vector<Body> &result)
+      :
+        bodies(result)
+      {
+      }
+
+      void CloneLeaf(btDbvtNode *leaf) override
+      {
+        btBroadphaseProxy const *proxy = static_cast<btBroadphaseProxy*>(leaf->data);
+        btCollisionObject *object = static_cast<btCollisionObject*>(proxy->m_clientObject);
+
+        Body body;
+        body.object = object;
+        body.transform = object->getWorldTransform();
+        body.proxy.m_clientObject = object;
+        body.proxy.m_collisionFilterGroup = proxy->m_collisionFilterGroup;
+        body.proxy.m_collisionFilterMask = proxy->m_collisionFilterMask;
+        body.node = nodeOf(object);
+
+        // capture reserved room for every leaf, so this never reallocates
+        bodies.push_back(body);
+        leaf->data = &bodies.back();
+      }
+    };
+
+    template <typename Body>
+    struct RayCollector : public btDbvt::ICollide
+    {
+      btTransform from;
+      btTransform to;
+      btCollisionWorld::ClosestRayResultCallback &callback;
+
+      RayCollector(btVector3 const &rayFrom, btVector3 const &rayTo, btCollisionWorld::ClosestRayResultCallback &result)
+      :
+        from(btQuaternion::getIdentity(), rayFrom),
+        to(btQuaternion::getIdentity(), rayTo),
+        callback(result)
+      {
+      }
+
+      void Process(btDbvtNode const *leaf) override
+      {
+        Body const &body = bodyOf<Body>(leaf);
+
+        if(callback.needsCollision(const_cast<btBroadphaseProxy*>(&body.proxy)))
+          btCollisionWorld::rayTestSingle(from, to, body.object, body.object->getCollisionShape(), body.transform, callback);
+      }
+    };
+
+    template <typename Body>
+    struct SweepCollector : public btDbvt::ICollide
+    {
+      btConvexShape const &shape;
+      btTransform from;
+      btTransform to;
+      btCollisionWorld::ClosestConvexResultCallback &callback;
+
+      SweepCollector(btConvexShape const &castShape, btVector3 const &sweepFrom, btVector3 const &sweepTo,
+                     btCollisionWorld::ClosestConvexResultCallback &result)
+      :
+        shape(castShape),
+        from(btQuaternion::getIdentity(), sweepFrom),
+        to(btQuaternion::getIdentity(), sweepTo),
+        callback(result)
+      {
+      }
+
+      void Process(btDbvtNode const *leaf) override
+      {
+        Body const &body = bodyOf<Body>(leaf);
+
+        if(callback.needsCollision(const_cast<btBroadphaseProxy*>(&body.proxy)))
+        {
+          btCollisionWorld::objectQuerySingle(&shape, from, to, body.object, body.object->getCollisionShape(),
+                                              body.transform, callback, 0);
+        }
+      }
+    };
+
+    template <typename Body>
+    struct OverlapCollector : public btDbvt::ICollide
+    {
+      btVector3 center;
+      btScalar radius;
+      vector<NodeBase*> &nodes;
+
+      OverlapCollector(btVector3 const &sphereCenter, btScalar sphereRadius, vector<NodeBase*> &result)
+      :
+        center(sphereCenter),
+        radius(sphereRadius),
+        nodes(result)
+      {
+      }
+
+      void Process(btDbvtNode const *leaf) override
+      {
+        Body const &body = bodyOf<Body>(leaf);
+
+        if(body.node == 0)
+          return;
+
+        btCollisionShape const *shape = body.object->getCollisionShape();
+        if(shape->isConvex())
+        {
+          btGjkEpaSolver2::sResults results;
+          if(btGjkEpaSolver2::SignedDistance(center, radius, static_cast<btConvexShape const*>(shape),
+                                             body.transform, results) > 0)
+            return;
+        }
+
+        nodes.push_back(body.node);
+      }
+    };
+  }
+
+  void PhysicsQuery::capture(btDbvtBroadphase const &broadphase)
+  {
+    d_bodies.clear();
+    d_bodies.reserve(broadphase.m_sets[0].m_leaves + broadphase.m_sets[1].m_leaves);
+
+    // cloning keeps the tree structure, so nothing has to be rebuilt
+    Cloner<Body> cloner(d_bodies);
+    for(size_t idx = 0; idx != 2; ++idx)
+      broadphase.m_sets[idx].clone(d_trees[idx], &cloner);
+  }
+
+  void PhysicsQuery::rayTest(vector<Ray> const &rays, vector<QueryHit> &hits) const
+  {
+    hits.resize(rays.size());
+
+    JobSystem::instance().parallelFor(rays.size(), [&](size_t idx)
+                                      {
+                                        hits[idx] = ray(rays[idx]);
+                                      }, s_minQueriesPerJob);
+  }
+
+  void PhysicsQuery::sweepTest(vector<Sweep> const &sweeps, vector<QueryHit> &hits) const
+  {
+    hits.resize(sweeps.size());
+
+    JobSystem::instance().parallelFor(sweeps.size(), [&](size_t idx)
+                                      {
+                                        hits[idx] = sweep(sweeps[idx]);
+                                      }, s_minQueriesPerJob);
+  }
+
+  void PhysicsQuery::overlapTest(vector<Overlap> const &overlaps, vector<vector<NodeBase*>> &nodes) const
+  {
+    nodes.resize(overlaps.size());
+
+    JobSystem::instance().parallelFor(overlaps.size(), [&](size_t idx)
+                                      {
+                                        nodes[idx].clear();
+                                        overlap(overlaps[idx], nodes[idx]);
+                                      }, s_minQueriesPerJob);
+  }
+
+  QueryHit PhysicsQuery::ray(Ray const &query) const
+  {
+    btVector3 from = toBullet(query.from);
+    btVector3 to = toBullet(query.to);
+
+    btCollisionWorld::ClosestRayResultCallback callback(from, to);
+    RayCollector<Body> collector(from, to, callback);
+
+    // the static and the moving objects live in different trees
+    for(btDbvt const &tree : d_trees)
+      btDbvt::rayTest(tree.m_root, from, to, collector);
+
+    if(not callback.hasHit())
+      return QueryHit{0, 0, query.to, vec3(0.0), 1};
+
+    return QueryHit{callback.m_collisionObject, nodeOf(callback.m_collisionObject),
+                    toGlm(callback.m_hitPointWorld), toGlm(callback.m_hitNormalWorld), callback.m_closestHitFraction};
+  }
+
+  QueryHit PhysicsQuery::sweep(Sweep const &query) const
+  {
+    btVector3 from = toBullet(query.from);
+    btVector3 to = toBullet(query.to);
+
+    btSphereShape sphere(query.radius);
+    btCollisionWorld::ClosestConvexResultCallback callback(from, to);
+    SweepCollector<Body> collector(sphere, from, to, callback);
+
+    btVector3 extent(query.radius, query.radius, query.radius);
+    btVector3 min = from;
+    btVector3 max = from;
+    min.setMin(to);
+    max.setMax(to);
+
+    btDbvtVolume volume = btDbvtVolume::FromMM(min - extent, max + extent);
+
+    for(btDbvt const &tree : d_trees)
+      tree.collideTV(tree.m_root, volume, collector);
+
+    if(not callback.hasHit())
+      return QueryHit{0, 0, query.to, vec3(0.0), 1};
+
+    return QueryHit{callback.m_hitCollisionObject, nodeOf(callback.m_hitCollisionObject),
+                    toGlm(callback.m_hitPointWorld), toGlm(callback.m_hitNormalWorld), callback.m_closestHitFraction};
+  }
+
+  void PhysicsQuery::overlap(Overlap const &query, vector<NodeBase*> &nodes) const
+  {
+    btVector3 center = toBullet(query.center);
+
+    OverlapCollector<Body> collector(center, query.radius, nodes);
+    btDbvtVolume volume = btDbvtVolume::FromCR(center, query.radius);
+
+    for(btDbvt const &tree : d_trees)
+      tree.collideTV(tree.m_root, volume, collector);
+  }
+}
+}
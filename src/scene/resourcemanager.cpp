@@ -18,7 +18,6 @@
 //      MA 02110-1301, USA.
 
 #include "dim/scene/scenemanager.hpp"
-//#include "dim/scene/bulletmanager.hpp"
 #include "dim/scene/shadermanager.hpp"
 
 using namespace std;
@@ -42,22 +41,6 @@ namespace dim
     d_defaultWrap = wrap;
   }
 
-  /*btBulletWorldImporter &BulletManager::request(string const &filename)
-  {
-    if(d_bulletMap.find(filename) == d_bulletMap.end())
-    {
-      auto keyPair = d_bulletMap.emplace(filename, nullptr);
-      if(keyPair.first->second.loadFile(filename.c_str()) == false)
-      {
-        throw log(__FILE__, __LINE__, LogType::error, "Failed to load bullet file: " + filename);
-      }
-
-      return keyPair.first->second;
-    }
-
-    return d_bulletMap.at(filename);
-  }*/
-
   Texture<GLubyte> &TextureManager::request(string const &filename)
   {
     return request(filename, d_defaultFilter, false, d_defaultWrap);
@@ -98,19 +81,6 @@ namespace dim
     return d_sceneMap[filename];
   }
 
-  /*void BulletManager::remove(string const &filename)
-  {
-    auto iter = d_bulletMap.find(filename);
-
-    if(iter == d_bulletMap.end())
-    {
-      log(__FILE__, __LINE__, LogType::warning, "Couldn't delete " + filename + " because it has never been loaded");
-      return;
-    }
-
-    d_bulletMap.erase(iter);
-  }*/
-
   void TextureManager::remove(string const &filename)
   {
     auto iter = d_textureMap.find(filename);
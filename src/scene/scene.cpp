@@ -18,8 +18,13 @@
 // MA 02110-1301, USA.
 
 #include "dim/scene/scene.hpp"
+#include "dim/scene/vertexcache.hpp"
+#include "dim/scene/vertexpacking.hpp"
 #include "dim/core/shader.hpp"
 #include <algorithm>
+#include <unordered_map>
+#include <limits>
+#include <atomic>
 
 #include "assimp/Importer.hpp"
 #include "assimp/scene.h"
@@ -30,42 +35,58 @@ using namespace glm;
 
 namespace dim
 {
-  DrawState::DrawState(Mesh const &mesh, std::vector<std::pair<Texture<GLubyte>, std::string>> const &textures)
+  DrawState::DrawState(Mesh const &mesh, std::vector<std::pair<Texture<GLubyte>, std::string>> const &textures,
+                       internal::BatchGeometry &&geometry)
   :
       d_mesh(mesh),
-      d_textures(textures),
-      d_ambient(1.0, 1.0, 1.0),
-      d_diffuse(1.0, 1.0, 1.0),
-      d_specular(1.0, 1.0, 1.0),
-      d_shininess(0)
+      d_geometry(make_shared<internal::BatchGeometry>(move(geometry))),
+      d_bounds(vec3(0.0), numeric_limits<float>::infinity())
   {
-    sort(d_textures.begin(), d_textures.end(), [](pair<Texture<GLubyte>, string> const &lhs, pair<Texture<GLubyte>, string> const &rhs)
-    {
-      return lhs.first.id() < rhs.first.id();
-    });
+    static atomic<uint64_t> s_lastSerial(0);
+    d_serial = ++s_lastSerial;
+
+    setMaterial(Material(textures));
+
+    // the batches read the copy while extracting a snapshot, which doesn't use GL
+    if(d_geometry->numOfVertices() == 0 && mesh.numOfVertices() != 0 && internal::BatchGeometry::mergeable(mesh))
+      *d_geometry = internal::BatchGeometry(mesh);
   }
 
   vector<pair<Texture<GLubyte>, string>> const &DrawState::textures() const
   {
-    return d_textures;
+    return d_material->textures();
   }
 
-  void DrawState::setTextures(vector<pair<Texture<GLubyte>, string>> const &param)
+  Material const &DrawState::material() const
   {
-    d_textures = param;
-    sort(d_textures.begin(), d_textures.end(), [](pair<Texture<GLubyte>, string> const &lhs, pair<Texture<GLubyte>, string> const &rhs)
-    {
-      return lhs.first.id() < rhs.first.id();
-    });
+    return *d_material;
+  }
+
+  uint32_t DrawState::materialId() const
+  {
+    return d_materialId;
+  }
+
+  uint64_t DrawState::serial() const
+  {
+    return d_serial;
   }
 
+  void DrawState::setMaterial(Material const &material)
+  {
+    d_materialId = Material::intern(material);
+    d_material = &Material::get(d_materialId);
+  }
+
+  void DrawState::setTextures(vector<pair<Texture<GLubyte>, string>> const &param)
+  {
+    setMaterial(Material(param, d_material->ambientIntensity(), d_material->diffuseIntensity(),
+                         d_material->specularIntensity(), d_material->shininess(), d_material->transparent()));
+  }
 
   void DrawState::setMaterial(vec3 ambient, vec3 diffuse, vec3 specular, float shininess)
   {
-    d_ambient = ambient;
-    d_diffuse = diffuse;
-    d_specular = specular;
-    d_shininess = shininess;
+    setMaterial(Material(d_material->textures(), ambient, diffuse, specular, shininess, d_material->transparent()));
   }
 
   Mesh const &DrawState::mesh() const
@@ -75,69 +96,51 @@ namespace dim
 
   vec3 const &DrawState::ambientIntensity() const
   {
-    return d_ambient;
+    return d_material->ambientIntensity();
   }
 
   vec3 const &DrawState::diffuseIntensity() const
   {
-    return d_diffuse;
+    return d_material->diffuseIntensity();
   }
 
   vec3 const &DrawState::specularIntensity() const
   {
-    return d_specular;
+    return d_material->specularIntensity();
   }
 
   float DrawState::shininess() const
   {
-    return d_shininess;
+    return d_material->shininess();
   }
 
-  bool DrawState::operator==(DrawState const &other) const
+  void DrawState::setTransparent(bool transparent)
   {
-    if(d_textures.size() != other.d_textures.size())
-      return false;
+    setMaterial(Material(d_material->textures(), d_material->ambientIntensity(), d_material->diffuseIntensity(),
+                         d_material->specularIntensity(), d_material->shininess(), transparent));
+  }
 
-    for(size_t idx = 0; idx != d_textures.size(); ++idx)
-    {
-      if(d_textures[idx].first.id() != other.d_textures[idx].first.id())
-        return false;
-    }
+  bool DrawState::transparent() const
+  {
+    return d_material->transparent();
+  }
 
-    if(d_mesh.id() != other.d_mesh.id())
-      return false;
+  bool DrawState::operator==(DrawState const &other) const
+  {
+    return d_materialId == other.d_materialId && d_serial == other.d_serial;
+  }
 
-    return true;
+  bool DrawState::sameMaterial(DrawState const &other) const
+  {
+    return d_materialId == other.d_materialId;
   }
 
   bool DrawState::operator<(DrawState const &other) const
   {
-    size_t minSize = std::min(d_textures.size(), other.d_textures.size());
-
-    for(size_t idx = 0; idx != minSize; ++idx)
-    {
-      if(d_textures[idx].first.id() < other.d_textures[idx].first.id())
-        return true;
-      if(d_textures[idx].first.id() > other.d_textures[idx].first.id())
-        return false;
-    }
-
-    if(d_textures.size() < other.d_textures.size())
-      return true;
-    if(d_textures.size() > other.d_textures.size())
-      return false;
-
-    if(d_mesh.id() < other.d_mesh.id())
-      return true;
-    if(d_mesh.id() > other.d_mesh.id())
-      return false;
-
-    if(d_shininess < other.d_shininess)
-      return true;
-    if(d_shininess > other.d_shininess)
-      return false;
+    if(d_materialId != other.d_materialId)
+      return d_materialId < other.d_materialId;
 
-    return false;
+    return d_serial < other.d_serial;
   }
 
   void DrawState::draw() const
@@ -158,6 +161,59 @@ namespace dim
 
 	}
 
+  vec4 const &DrawState::bounds() const
+  {
+    return d_bounds;
+  }
+
+  vector<Meshlet> const &DrawState::meshlets() const
+  {
+    return d_meshlets;
+  }
+
+  internal::BatchGeometry const &DrawState::geometry() const
+  {
+    // only meshes the batches can't merge get here empty, the physics asks for those on the GL thread
+    if(d_geometry->numOfVertices() == 0 && d_mesh.numOfVertices() != 0)
+      *d_geometry = internal::BatchGeometry(d_mesh);
+
+    return *d_geometry;
+  }
+
+  void DrawState::draw(vec3 const &eye, Frustum const &frustum) const
+  {
+    if(d_meshlets.empty())
+    {
+      d_mesh.draw();
+      return;
+    }
+
+    // neighbouring visible meshlets are drawn with one call
+    size_t first = 0;
+    size_t count = 0;
+
+    for(Meshlet const &meshlet : d_meshlets)
+    {
+      if(meshlet.backFacing(eye) || not frustum.visible(vec4(meshlet.center, meshlet.radius)))
+        continue;
+
+      if(count != 0 && first + count == meshlet.firstIndex)
+      {
+        count += meshlet.numOfIndices;
+        continue;
+      }
+
+      if(count != 0)
+        d_mesh.drawRange(first, count);
+
+      first = meshlet.firstIndex;
+      count = meshlet.numOfIndices;
+    }
+
+    if(count != 0)
+      d_mesh.drawRange(first, count);
+  }
+
 	// Scene
 
   Scene::Scene(Mesh const &mesh, std::vector<pair<Texture<GLubyte>, string>> const &textures)
@@ -180,6 +236,18 @@ namespace dim
     return d_states.size();
   }
 
+  vec4 Scene::bounds() const
+  {
+    if(d_states.empty())
+      return vec4(0.0);
+
+    vec4 sphere = d_states.front().bounds();
+    for(size_t idx = 1; idx != d_states.size(); ++idx)
+      sphere = mergeSpheres(sphere, d_states[idx].bounds());
+
+    return sphere;
+  }
+
   void Scene::add(Mesh const &mesh, std::vector<pair<Texture<GLubyte>, string>> const &textures)
   {
     d_states.push_back(DrawState(mesh, textures));
@@ -226,7 +294,34 @@ namespace dim
       array.push_back(vector.z);
     }
 
-    void fillArray(vector<GLfloat> &array, aiMesh const &mesh, bool normals, bool texCoords, bool binormals, bool tangents, bool bones, uint numOfTexCoords, uint numOfBoneWeights)
+    mat4 toGlm(aiMatrix4x4 const &m)
+    {
+      return mat4(m.a1, m.b1, m.c1, m.d1,
+                  m.a2, m.b2, m.c2, m.d2,
+                  m.a3, m.b3, m.c3, m.d3,
+                  m.a4, m.b4, m.c4, m.d4);
+    }
+
+    /*
+     * Numbers the bones by name over all meshes of the scene, so the meshes
+     * of one file index into one palette of bone matrices
+     */
+    unordered_map<string, uint> boneIndices(aiScene const &scene)
+    {
+      unordered_map<string, uint> indices;
+
+      for(size_t meshIdx = 0; meshIdx != scene.mNumMeshes; ++meshIdx)
+      {
+        aiMesh const &mesh = *scene.mMeshes[meshIdx];
+        for(size_t boneIdx = 0; boneIdx != mesh.mNumBones; ++boneIdx)
+          indices.insert({mesh.mBones[boneIdx]->mName.C_Str(), indices.size()});
+      }
+
+      return indices;
+    }
+
+    void fillArray(vector<GLfloat> &array, aiMesh const &mesh, bool normals, bool texCoords, bool binormals, bool tangents, bool bones, uint numOfTexCoords, uint numOfBoneWeights,
+                   unordered_map<string, uint> const &boneIndex)
     {
       vector<GLfloat> boneIds;
       vector<GLfloat> boneWeights;
@@ -242,6 +337,8 @@ namespace dim
         for(size_t boneIdx = 0; boneIdx != mesh.mNumBones; ++boneIdx)
         {
           aiBone const &bone = *mesh.mBones[boneIdx];
+          uint index = boneIndex.at(bone.mName.C_Str());
+
           for(size_t weightIdx = 0; weightIdx != bone.mNumWeights; ++weightIdx)
           {
             aiVertexWeight const &weight = bone.mWeights[weightIdx];
@@ -252,7 +349,7 @@ namespace dim
             }
 
             size_t idx = weight.mVertexId * numOfBoneWeights + vertexWeightIdx[weight.mVertexId];
-            boneIds[idx] = boneIdx;
+            boneIds[idx] = index;
             boneWeights[idx] = weight.mWeight;
 
             ++vertexWeightIdx[weight.mVertexId];
@@ -285,7 +382,55 @@ namespace dim
       }
     }
 
-    Mesh loadMesh(aiScene const &scene, std::vector<Scene::Option> const &options, size_t mesh, string const &filename)
+    vector<GLuint> indices(aiMesh const &mesh)
+    {
+      vector<GLuint> indexArray(mesh.mNumFaces * 3);
+
+      for(size_t idx = 0; idx != mesh.mNumFaces; ++idx)
+      {
+        indexArray[0 + idx * 3] = mesh.mFaces[idx].mIndices[0];
+        indexArray[0 + idx * 3 + 1] = mesh.mFaces[idx].mIndices[1];
+        indexArray[0 + idx * 3 + 2] = mesh.mFaces[idx].mIndices[2];
+      }
+
+      return indexArray;
+    }
+
+    vector<vec3> positions(vector<GLfloat> const &array, size_t numOfElements)
+    {
+      // the position is the first attribute of every vertex
+      vector<vec3> positions(array.size() / numOfElements);
+      for(size_t idx = 0; idx != positions.size(); ++idx)
+        positions[idx] = vec3(array[idx * numOfElements], array[idx * numOfElements + 1], array[idx * numOfElements + 2]);
+
+      return positions;
+    }
+
+    void optimize(vector<GLuint> &indices, vector<GLfloat> &array, size_t numOfElements, string const &name)
+    {
+      size_t numOfVertices = array.size() / numOfElements;
+      VertexCacheStats before = analyzeVertexCache(indices, numOfVertices);
+
+      vector<size_t> boundaries = optimizeVertexCache(indices, numOfVertices);
+      optimizeOverdraw(indices, positions(array, numOfElements), boundaries);
+      vector<GLuint> remap = optimizeVertexFetch(indices, numOfVertices);
+
+      vector<GLfloat> reordered(array.size());
+      for(size_t vertex = 0; vertex != numOfVertices; ++vertex)
+      {
+        copy(array.begin() + vertex * numOfElements, array.begin() + (vertex + 1) * numOfElements,
+             reordered.begin() + remap[vertex] * numOfElements);
+      }
+      array.swap(reordered);
+
+      VertexCacheStats after = analyzeVertexCache(indices, numOfVertices);
+      log(name, 0, LogType::note, "Vertex cache ACMR " + to_string(before.acmr) + " -> " + to_string(after.acmr) +
+                                  ", ATVR " + to_string(before.atvr) + " -> " + to_string(after.atvr));
+    }
+
+    Mesh loadMesh(aiScene const &scene, std::vector<Scene::Option> const &options, size_t mesh, string const &filename,
+                  unordered_map<string, uint> const &boneIndex, vector<Meshlet> &meshlets, internal::BatchGeometry &geometry,
+                  vec4 &bounds)
     {
       vector<pair<internal::AttributeAccessor, Shader::Format>> attributes;
       attributes.push_back({Shader::vertex, Shader::vec3});
@@ -385,22 +530,31 @@ namespace dim
       vector<GLfloat> array;
       array.reserve(numOfVertices * numOfElements);
 
-      fillArray(array, *scene.mMeshes[mesh], normals, texCoords, binormals, tangents, bones, numOfTexCoords, numOfBoneWeights);
+      fillArray(array, *scene.mMeshes[mesh], normals, texCoords, binormals, tangents, bones, numOfTexCoords, numOfBoneWeights, boneIndex);
 
-      Mesh model(array.data(), numOfVertices, attributes);
+      vector<GLuint> indexArray = indices(*scene.mMeshes[mesh]);
 
-      // Load indices
-      vector<GLushort> indexArray(scene.mMeshes[mesh]->mNumFaces * 3);
+      if(in(options, Scene::optimizeVertexCache))
+        optimize(indexArray, array, numOfElements, filename + ", mesh " + to_string(mesh));
 
-      for(size_t idx = 0; idx != scene.mMeshes[mesh]->mNumFaces; ++idx)
-      {
-        indexArray[0 + idx * 3] = scene.mMeshes[mesh]->mFaces[idx].mIndices[0];
-        indexArray[0 + idx * 3 + 1] = scene.mMeshes[mesh]->mFaces[idx].mIndices[1];
-        indexArray[0 + idx * 3 + 2] = scene.mMeshes[mesh]->mFaces[idx].mIndices[2];
-      }
+      if(in(options, Scene::splitMeshlets))
+        meshlets = buildMeshlets(positions(array, numOfElements), indexArray);
 
+      // before packing, so the bounds are in model space
+      bounds = boundingSphere(positions(array, numOfElements));
+
+      bool halfPositions = in(options, Scene::halfPositions);
+      Mesh model = in(options, Scene::packVertices) || halfPositions ?
+                   packMesh(array, numOfVertices, attributes, halfPositions) :
+                   Mesh(array.data(), numOfVertices, attributes);
+
+      // Load indices, 16 bit ones when the vertices allow it
       model.addElementBuffer(indexArray.data(), scene.mMeshes[mesh]->mNumFaces);
 
+      // batching and collision shapes read the copy instead of the GPU
+      if(not model.packed())
+        geometry = internal::BatchGeometry(move(array), move(indexArray), attributes);
+
       return model;
     }
 
@@ -548,8 +702,10 @@ namespace dim
     vector<GLfloat> points;
     points.reserve(numOfElements * numOfVertices);
 
+    unordered_map<string, uint> boneIndex = boneIndices(scene);
+
     for(size_t mesh = 0; mesh != scene.mNumMeshes; ++mesh)
-      fillArray(points, *scene.mMeshes[mesh], normals, texCoords, binormals, tangents, bones, numOfTexCoords, numOfBoneWeights);
+      fillArray(points, *scene.mMeshes[mesh], normals, texCoords, binormals, tangents, bones, numOfTexCoords, numOfBoneWeights, boneIndex);
 
     return points;
   }
@@ -566,53 +722,136 @@ namespace dim
 
 
 
-  bool extractBones(aiScene const &scene, aiNode const &node, Bone &bone)
+  namespace
   {
-    // Check if this node is in the list of nodes
-    bool isBone = false;
-    for(size_t meshIdx = 0; meshIdx != scene.mNumMeshes; ++meshIdx)
+    mat4 boneOffset(aiScene const &scene, aiString const &name)
     {
-      aiMesh &mesh = *scene.mMeshes[meshIdx];
-      for(size_t boneIdx = 0; boneIdx != mesh.mNumBones; ++boneIdx)
+      for(size_t meshIdx = 0; meshIdx != scene.mNumMeshes; ++meshIdx)
       {
-        if(mesh.mBones[boneIdx]->mName == node.mName)
+        aiMesh const &mesh = *scene.mMeshes[meshIdx];
+        for(size_t boneIdx = 0; boneIdx != mesh.mNumBones; ++boneIdx)
         {
-          isBone = true;
-          bone.setIndex(boneIdx);
-          bone.setName(node.mName.C_Str());
-          aiMatrix4x4 const &m = mesh.mBones[boneIdx]->mOffsetMatrix;
-          bone.setOffset(mat4(m.a1, m.b1, m.c1, m.d1,
-                              m.a2, m.b2, m.c2, m.d2,
-                              m.a3, m.b3, m.c3, m.d3,
-                              m.a4, m.b4, m.c4, m.d4));
-          break;
+          if(mesh.mBones[boneIdx]->mName == name)
+            return toGlm(mesh.mBones[boneIdx]->mOffsetMatrix);
         }
       }
-      if(isBone)
-        break;
+
+      return mat4(1.0);
     }
 
-    if(not isBone)
+    /*
+     * The transforms of nodes between two bones are folded into the
+     * transform of the lower bone
+     */
+    bool extractBones(aiScene const &scene, aiNode const &node, unordered_map<string, uint> const &boneIndex, Bone &bone,
+                      mat4 const &parent = mat4(1.0))
     {
+      mat4 transform = parent * toGlm(node.mTransformation);
+
+      auto index = boneIndex.find(node.mName.C_Str());
+      if(index == boneIndex.end())
+      {
+        for(size_t childIdx = 0; childIdx != node.mNumChildren; ++childIdx)
+        {
+          if(extractBones(scene, *node.mChildren[childIdx], boneIndex, bone, transform))
+            return true;
+        }
+        return false;
+      }
+
+      bone.setIndex(index->second);
+      bone.setName(node.mName.C_Str());
+      bone.setOffset(boneOffset(scene, node.mName));
+      bone.setTransform(transform);
+
       for(size_t childIdx = 0; childIdx != node.mNumChildren; ++childIdx)
       {
-        if(extractBones(scene, *node.mChildren[childIdx], bone))
-          return true;
+        Bone childBone;
+
+        if(extractBones(scene, *node.mChildren[childIdx], boneIndex, childBone))
+          bone.addChild(move(childBone));
       }
-      return false;
+
+      return true;
     }
 
-    // isBone == true
-    for(size_t childIdx = 0; childIdx != node.mNumChildren; ++childIdx)
+    Bone hiddenLoadBones(string const &filename, aiScene const &scene)
     {
-      Bone childBone;
+      unordered_map<string, uint> boneIndex = boneIndices(scene);
 
-      bool success = extractBones(scene, *node.mChildren[childIdx], childBone);
-      if(success)
-        bone.addChild(move(childBone));
+      Bone bone;
+      bone.setIndex(-1);
+      if(not extractBones(scene, *scene.mRootNode, boneIndex, bone))
+        throw log(filename, 0, LogType::error, "Mesh does not contain any bones");
+
+      return bone;
     }
+  }
 
-    return true;
+  Bone Scene::loadBones(string const &filename, vector<Option> options)
+  {
+    Assimp::Importer importer;
+    aiScene const *scene = loadScene(filename, importer, options);
+
+    return hiddenLoadBones(filename, *scene);
+  }
+
+  vector<AnimationClip> Scene::loadAnimations(string const &filename, vector<Option> options, float tolerance)
+  {
+    Assimp::Importer importer;
+    aiScene const *scene = loadScene(filename, importer, options);
+
+    unordered_map<string, uint> boneIndex = boneIndices(*scene);
+
+    vector<AnimationClip> clips;
+    for(size_t animIdx = 0; animIdx != scene->mNumAnimations; ++animIdx)
+    {
+      aiAnimation const &animation = *scene->mAnimations[animIdx];
+
+      // assimp leaves the ticks per second 0 when the file doesn't specify it
+      float ticksPerSecond = animation.mTicksPerSecond != 0 ? animation.mTicksPerSecond : 25;
+
+      vector<AnimationClip::Channel> channels;
+      for(size_t channelIdx = 0; channelIdx != animation.mNumChannels; ++channelIdx)
+      {
+        aiNodeAnim const &nodeAnim = *animation.mChannels[channelIdx];
+
+        auto index = boneIndex.find(nodeAnim.mNodeName.C_Str());
+        if(index == boneIndex.end())
+          continue;
+
+        AnimationClip::Channel channel;
+        channel.bone = index->second;
+
+        for(size_t key = 0; key != nodeAnim.mNumPositionKeys; ++key)
+        {
+          aiVectorKey const &position = nodeAnim.mPositionKeys[key];
+          channel.positions.emplace_back(position.mTime / ticksPerSecond, vec3(position.mValue.x, position.mValue.y, position.mValue.z));
+        }
+
+        for(size_t key = 0; key != nodeAnim.mNumRotationKeys; ++key)
+        {
+          aiQuatKey const &rotation = nodeAnim.mRotationKeys[key];
+          channel.rotations.emplace_back(rotation.mTime / ticksPerSecond,
+                                         quat(rotation.mValue.w, rotation.mValue.x, rotation.mValue.y, rotation.mValue.z));
+        }
+
+        for(size_t key = 0; key != nodeAnim.mNumScalingKeys; ++key)
+        {
+          aiVectorKey const &scaling = nodeAnim.mScalingKeys[key];
+          channel.scalings.emplace_back(scaling.mTime / ticksPerSecond, vec3(scaling.mValue.x, scaling.mValue.y, scaling.mValue.z));
+        }
+
+        channels.push_back(move(channel));
+      }
+
+      clips.emplace_back(animation.mName.C_Str(), animation.mDuration / ticksPerSecond, channels, tolerance);
+    }
+
+    if(clips.empty())
+      log(filename, 0, LogType::warning, "File does not contain any animations");
+
+    return clips;
   }
 
   pair<vector<GLfloat>, Bone> Scene::loadPointDataAndBones(string const &filename, vector<Option> options)
@@ -621,12 +860,7 @@ namespace dim
     Assimp::Importer importer;
     aiScene const *scene = loadScene(filename, importer, options);
 
-    Bone bone;
-    bone.setIndex(-1);
-    bool success = extractBones(*scene, *scene->mRootNode, bone);
-
-    if(success == false)
-      throw log(filename, 0, LogType::error, "Mesh does not contain any bones");
+    Bone bone = hiddenLoadBones(filename, *scene);
 
     return make_pair(hiddenLoadPointData(filename, *scene, options), move(bone));
   }
@@ -644,8 +878,18 @@ namespace dim
     aiScene const *scene = loadScene(filename, importer, options);
 
     // load meshes
+    unordered_map<string, uint> boneIndex = boneIndices(*scene);
+
     for(size_t mesh = 0; mesh != scene->mNumMeshes; ++mesh)
-      d_states.push_back(DrawState(loadMesh(*scene, options, mesh, filename), {}));
+    {
+      vector<Meshlet> meshlets;
+      internal::BatchGeometry geometry;
+      vec4 bounds;
+      Mesh loaded = loadMesh(*scene, options, mesh, filename, boneIndex, meshlets, geometry, bounds);
+      d_states.push_back(DrawState(loaded, {}, move(geometry)));
+      d_states.back().d_meshlets.swap(meshlets);
+      d_states.back().d_bounds = bounds;
+    }
 
     vector<vector<pair<Texture<GLubyte>, string>>> textures(scene->mNumMaterials);
     vector<aiColor3D> ambientColors(scene->mNumMaterials, aiColor3D(1.0, 1.0, 1.0));
@@ -653,6 +897,7 @@ namespace dim
     vector<aiColor3D> specularColors(scene->mNumMaterials, aiColor3D(1.0, 1.0, 1.0));
     vector<float> shininess(scene->mNumMaterials, 0);
     vector<float> specularIntensity(scene->mNumMaterials, 1);
+    vector<float> opacity(scene->mNumMaterials, 1);
     string baseName("in_texture");
 
     for(size_t material = 0; material != scene->mNumMaterials; ++material)
@@ -680,6 +925,7 @@ namespace dim
       scene->mMaterials[material]->Get(AI_MATKEY_COLOR_SPECULAR, specularColors[material]);
       scene->mMaterials[material]->Get(AI_MATKEY_SHININESS, shininess[material]);
       scene->mMaterials[material]->Get(AI_MATKEY_SHININESS_STRENGTH, specularIntensity[material]);
+      scene->mMaterials[material]->Get(AI_MATKEY_OPACITY, opacity[material]);
     }
 
     // set textures and materials inside object
@@ -687,11 +933,12 @@ namespace dim
     {
       uint materialIdx = scene->mMeshes[mesh]->mMaterialIndex;
 
-      d_states[mesh].setTextures(textures[materialIdx]);
-      d_states[mesh].setMaterial(vec3(ambientColors[materialIdx].r, ambientColors[materialIdx].g, ambientColors[materialIdx].b),
-                                 vec3(diffuseColors[materialIdx].r, diffuseColors[materialIdx].g, diffuseColors[materialIdx].b),
-                                 vec3(specularColors[materialIdx].r, specularColors[materialIdx].g, specularColors[materialIdx].b) * specularIntensity[materialIdx],
-                                 shininess[materialIdx]);
+      // meshes sharing a material, also across files, end up with the same material id
+      d_states[mesh].setMaterial(Material(textures[materialIdx],
+                                          vec3(ambientColors[materialIdx].r, ambientColors[materialIdx].g, ambientColors[materialIdx].b),
+                                          vec3(diffuseColors[materialIdx].r, diffuseColors[materialIdx].g, diffuseColors[materialIdx].b),
+                                          vec3(specularColors[materialIdx].r, specularColors[materialIdx].g, specularColors[materialIdx].b) * specularIntensity[materialIdx],
+                                          shininess[materialIdx], opacity[materialIdx] < 1));
     }
 
     sort(d_states.begin(), d_states.end());
@@ -703,6 +950,12 @@ namespace dim
       drawState.draw();
   }
 
+  void Scene::draw(vec3 const &eye) const
+  {
+    for(DrawState const &drawState : d_states)
+      drawState.draw(eye);
+  }
+
   bool Scene::operator==(Scene const &other) const
   {
     if(size() != other.size())
@@ -0,0 +1,179 @@
+// skeleton.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#include "dim/scene/skeleton.hpp"
+
+#include <algorithm>
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+  mat4 BoneTransform::matrix() const
+  {
+    mat4 matrix = mat4_cast(rotation);
+    matrix[0] *= scale.x;
+    matrix[1] *= scale.y;
+    matrix[2] *= scale.z;
+    matrix[3] = vec4(translation, 1.0);
+    return matrix;
+  }
+
+  BoneTransform BoneTransform::fromMatrix(mat4 const &matrix)
+  {
+    vec3 scale(length(vec3(matrix[0])), length(vec3(matrix[1])), length(vec3(matrix[2])));
+
+    mat3 rotation(vec3(matrix[0]) / scale.x, vec3(matrix[1]) / scale.y, vec3(matrix[2]) / scale.z);
+
+    return BoneTransform{vec3(matrix[3]), normalize(quat_cast(rotation)), scale};
+  }
+
+  Skeleton::Skeleton()
+  :
+    d_numOfBones(0)
+  {
+  }
+
+  Skeleton::Skeleton(Bone const &root)
+  :
+    d_numOfBones(0)
+  {
+    add(root, 0);
+
+    d_bindPose.resize(d_numOfBones, BoneTransform{vec3(0.0), quat(), vec3(1.0)});
+    for(Joint const &joint : d_joints)
+      d_bindPose[joint.index] = BoneTransform::fromMatrix(joint.transform);
+  }
+
+  void Skeleton::add(Bone const &bone, size_t parent)
+  {
+    size_t joint = d_joints.size();
+    d_joints.push_back(Joint{bone.index(), parent, bone.offset(), bone.transform(), bone.name()});
+    d_numOfBones = std::max<size_t>(d_numOfBones, bone.index() + 1);
+
+    for(Bone const &child : bone.children())
+      add(child, joint);
+  }
+
+  size_t Skeleton::numOfBones() const
+  {
+    return d_numOfBones;
+  }
+
+  size_t Skeleton::numOfJoints() const
+  {
+    return d_joints.size();
+  }
+
+  uint Skeleton::index(string const &name) const
+  {
+    for(Joint const &joint : d_joints)
+    {
+      if(joint.name == name)
+        return joint.index;
+    }
+
+    throw log(__FILE__, __LINE__, LogType::error, "The skeleton has no bone named " + name);
+  }
+
+  size_t Skeleton::joint(string const &name) const
+  {
+    for(size_t idx = 0; idx != d_joints.size(); ++idx)
+    {
+      if(d_joints[idx].name == name)
+        return idx;
+    }
+
+    throw log(__FILE__, __LINE__, LogType::error, "The skeleton has no bone named " + name);
+  }
+
+  uint Skeleton::index(size_t joint) const
+  {
+    return d_joints[joint].index;
+  }
+
+  size_t Skeleton::parent(size_t joint) const
+  {
+    return d_joints[joint].parent;
+  }
+
+  size_t Skeleton::subtreeEnd(size_t joint) const
+  {
+    size_t end = joint + 1;
+    while(end != d_joints.size() && d_joints[end].parent >= joint)
+      ++end;
+
+    return end;
+  }
+
+  Pose const &Skeleton::bindPose() const
+  {
+    return d_bindPose;
+  }
+
+  string const &Skeleton::name(size_t joint) const
+  {
+    return d_joints[joint].name;
+  }
+
+  mat4 const &Skeleton::bindTransform(size_t joint) const
+  {
+    return d_joints[joint].transform;
+  }
+
+  void Skeleton::palette(mat4 const *locals, mat4 *palette) const
+  {
+    static thread_local vector<mat4> globals;
+    globals.resize(d_joints.size());
+
+    for(size_t idx = 0; idx != d_joints.size(); ++idx)
+    {
+      Joint const &joint = d_joints[idx];
+
+      if(idx == 0)
+        globals[idx] = locals[joint.index];
+      else
+        globals[idx] = globals[joint.parent] * locals[joint.index];
+
+      palette[joint.index] = globals[idx] * joint.offset;
+    }
+  }
+
+  void Skeleton::palette(Pose const &pose, mat4 *palette) const
+  {
+    static thread_local vector<mat4> locals;
+    locals.resize(d_numOfBones);
+
+    for(Joint const &joint : d_joints)
+      locals[joint.index] = pose[joint.index].matrix();
+
+    this->palette(locals.data(), palette);
+  }
+
+  void Skeleton::bindPalette(mat4 *palette) const
+  {
+    vector<mat4> locals(d_numOfBones, mat4(1.0));
+    for(Joint const &joint : d_joints)
+      locals[joint.index] = joint.transform;
+
+    this->palette(locals.data(), palette);
+  }
+}
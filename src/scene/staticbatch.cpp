@@ -0,0 +1,175 @@
+// staticbatch.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#include "dim/scene/staticbatch.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+namespace internal
+{
+  namespace
+  {
+    struct Builder
+    {
+      ShaderScene state;
+      vector<pair<AttributeAccessor, Shader::Format>> formats;
+      vector<GLfloat> vertices;
+      vector<GLushort> indices;
+      size_t numOfVertices;
+      vec4 bounds;
+    };
+
+    void flush(Builder &builder, vector<shared_ptr<StaticMesh>> &meshes)
+    {
+      if(builder.numOfVertices == 0)
+        return;
+
+      meshes.push_back(make_shared<StaticMesh>(StaticMesh{builder.state, builder.formats, move(builder.vertices),
+                                                          move(builder.indices), builder.numOfVertices, builder.bounds,
+                                                          nullptr}));
+
+      builder.vertices.clear();
+      builder.indices.clear();
+      builder.numOfVertices = 0;
+    }
+  }
+
+  void StaticMesh::draw()
+  {
+    if(not mesh)
+    {
+      mesh.reset(new Mesh(vertices.data(), numOfVertices, formats));
+      mesh->addElementBuffer(indices.data(), indices.size() / 3);
+
+      vector<GLfloat>().swap(vertices);
+      vector<GLushort>().swap(indices);
+    }
+
+    mesh->draw();
+  }
+
+  StaticBatch::StaticBatch()
+  :
+    d_dirty(true)
+  {
+  }
+
+  void StaticBatch::setDirty()
+  {
+    d_dirty = true;
+  }
+
+  bool StaticBatch::dirty() const
+  {
+    return d_dirty;
+  }
+
+  void StaticBatch::clear()
+  {
+    d_meshes.clear();
+    d_dirty = true;
+  }
+
+  size_t StaticBatch::numOfMeshes() const
+  {
+    return d_meshes.size();
+  }
+
+  bool StaticBatch::batchable(DrawState const &drawState, bool isStatic)
+  {
+    // transparent geometry has to be sorted every frame
+    if(not isStatic || drawState.transparent())
+      return false;
+
+    return BatchGeometry::mergeable(drawState.mesh());
+  }
+
+  void StaticBatch::rebuild(FrameVector<NodeBase*> const &nodes, size_t numOfShaders, vector<shared_ptr<StaticMesh>> &retired)
+  {
+    move(d_meshes.begin(), d_meshes.end(), back_inserter(retired));
+    d_meshes.clear();
+    d_dirty = false;
+
+    // only the merged vertices outlive the rebuild, they move into the meshes
+    FrameArena::Scope scope;
+    FrameVector<Builder> builders;
+
+    for(NodeBase *node : nodes)
+    {
+      mat4 const &model = node->matrix();
+      mat3 normalMatrix(inverseTranspose(mat3(model)));
+
+      for(size_t idx = 0; idx != node->scene().size(); ++idx)
+      {
+        DrawState const &drawState = node->scene()[idx];
+        if(not batchable(drawState, node->isStatic()))
+          continue;
+
+        Mesh const &mesh = drawState.mesh();
+        ShaderScene state(*node, idx, numOfShaders);
+
+        // different meshes with the same shaders, material and vertex layout are merged
+        auto builder = find_if(builders.begin(), builders.end(), [&](Builder const &element)
+                               {
+                                 return element.state.sameMaterial(state) && element.formats == mesh.formats();
+                               });
+
+        if(builder == builders.end())
+        {
+          builders.push_back(Builder{state, mesh.formats(), {}, {}, 0, vec4(0.0)});
+          builder = builders.end() - 1;
+        }
+
+        // the indices are 16 bit, so start a new mesh before they overflow
+        if(builder->numOfVertices + mesh.numOfVertices() > BatchGeometry::maxVertices)
+          flush(*builder, d_meshes);
+
+        vec4 bounds = transformSphere(drawState.bounds(), model);
+        builder->bounds = builder->numOfVertices == 0 ? bounds : mergeSpheres(builder->bounds, bounds);
+
+        BatchGeometry const &source = drawState.geometry();
+        source.appendTo(builder->vertices, builder->indices, builder->formats, model, normalMatrix);
+        builder->numOfVertices += source.numOfVertices();
+      }
+    }
+
+    for(Builder &builder : builders)
+      flush(builder, d_meshes);
+  }
+
+  void StaticBatch::collect(ShaderScene const &state, vector<shared_ptr<StaticMesh>> &meshes,
+                            Visibility const &visibility) const
+  {
+    // a merged mesh is kept under the state of the first node in it, so it is only collected once
+    for(shared_ptr<StaticMesh> const &mesh : d_meshes)
+    {
+      if(mesh->state == state && visibility.visible(mesh->bounds))
+        meshes.push_back(mesh);
+    }
+  }
+}
+}
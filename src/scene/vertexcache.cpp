@@ -0,0 +1,324 @@
+// vertexcache.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#include "dim/scene/vertexcache.hpp"
+
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+  namespace
+  {
+    size_t const s_none = numeric_limits<size_t>::max();
+
+    struct Cluster
+    {
+      size_t first; ///< In triangles
+      size_t last;
+      float facing;
+    };
+
+    size_t skipDeadEnd(vector<GLuint> &deadEnd, vector<size_t> const &live, size_t &cursor)
+    {
+      // recently emitted vertices are the most likely to still be cached
+      while(not deadEnd.empty())
+      {
+        GLuint vertex = deadEnd.back();
+        deadEnd.pop_back();
+
+        if(live[vertex] != 0)
+          return vertex;
+      }
+
+      for(; cursor != live.size(); ++cursor)
+      {
+        if(live[cursor] != 0)
+          return cursor;
+      }
+
+      return s_none;
+    }
+
+    vec3 triangleNormal(vector<GLuint> const &indices, vector<vec3> const &positions, size_t triangle)
+    {
+      vec3 const &corner = positions[indices[triangle * 3]];
+      return cross(positions[indices[triangle * 3 + 1]] - corner, positions[indices[triangle * 3 + 2]] - corner);
+    }
+
+    vec3 triangleCenter(vector<GLuint> const &indices, vector<vec3> const &positions, size_t triangle)
+    {
+      return (positions[indices[triangle * 3]] + positions[indices[triangle * 3 + 1]] + positions[indices[triangle * 3 + 2]]) / 3.0f;
+    }
+  }
+
+  VertexCacheStats analyzeVertexCache(vector<GLuint> const &indices, size_t numOfVertices, size_t cacheSize)
+  {
+    // a vertex is cached while less than cacheSize misses happened after its own
+    vector<size_t> stamp(numOfVertices, 0);
+    vector<bool> used(numOfVertices, false);
+    size_t time = cacheSize + 1;
+    size_t misses = 0;
+    size_t numOfUsed = 0;
+
+    for(GLuint index : indices)
+    {
+      if(time - stamp[index] > cacheSize)
+      {
+        stamp[index] = time++;
+        ++misses;
+      }
+
+      if(not used[index])
+      {
+        used[index] = true;
+        ++numOfUsed;
+      }
+    }
+
+    size_t numOfTriangles = indices.size() / 3;
+    return VertexCacheStats{numOfTriangles == 0 ? 0 : float(misses) / numOfTriangles,
+                            numOfUsed == 0 ? 0 : float(misses) / numOfUsed};
+  }
+
+  vector<size_t> optimizeVertexCache(vector<GLuint> &indices, size_t numOfVertices, size_t cacheSize)
+  {
+    size_t numOfTriangles = indices.size() / 3;
+    vector<size_t> boundaries;
+
+    if(numOfTriangles == 0)
+      return boundaries;
+
+    // the triangles around every vertex
+    vector<size_t> offsets(numOfVertices + 1, 0);
+    for(size_t idx = 0; idx != numOfTriangles * 3; ++idx)
+      ++offsets[indices[idx] + 1];
+    partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    vector<size_t> adjacency(numOfTriangles * 3);
+    vector<size_t> slot(offsets.begin(), offsets.end() - 1);
+    for(size_t idx = 0; idx != numOfTriangles * 3; ++idx)
+      adjacency[slot[indices[idx]]++] = idx / 3;
+
+    vector<size_t> live(numOfVertices);
+    for(size_t vertex = 0; vertex != numOfVertices; ++vertex)
+      live[vertex] = offsets[vertex + 1] - offsets[vertex];
+
+    vector<size_t> stamp(numOfVertices, 0);
+    vector<bool> emitted(numOfTriangles, false);
+    vector<GLuint> deadEnd;
+    vector<GLuint> candidates;
+    vector<GLuint> output;
+    output.reserve(numOfTriangles * 3);
+
+    size_t time = cacheSize + 1;
+    size_t cursor = 0;
+    size_t fanning = skipDeadEnd(deadEnd, live, cursor);
+
+    while(fanning != s_none)
+    {
+      // emit every remaining triangle around the fanning vertex
+      candidates.clear();
+      for(size_t adj = offsets[fanning]; adj != offsets[fanning + 1]; ++adj)
+      {
+        size_t triangle = adjacency[adj];
+        if(emitted[triangle])
+          continue;
+
+        for(size_t corner = 0; corner != 3; ++corner)
+        {
+          GLuint vertex = indices[triangle * 3 + corner];
+
+          output.push_back(vertex);
+          deadEnd.push_back(vertex);
+          candidates.push_back(vertex);
+          --live[vertex];
+
+          if(time - stamp[vertex] > cacheSize)
+            stamp[vertex] = time++;
+        }
+
+        emitted[triangle] = true;
+      }
+
+      // prefer the oldest candidate that stays cached while fanning around it
+      size_t next = s_none;
+      long best = -1;
+      for(GLuint vertex : candidates)
+      {
+        if(live[vertex] == 0)
+          continue;
+
+        long priority = 0;
+        if(time - stamp[vertex] + 2 * live[vertex] <= cacheSize)
+          priority = time - stamp[vertex];
+
+        if(priority > best)
+        {
+          best = priority;
+          next = vertex;
+        }
+      }
+
+      if(next == s_none)
+      {
+        next = skipDeadEnd(deadEnd, live, cursor);
+
+        if(next != s_none)
+          boundaries.push_back(output.size());
+      }
+
+      fanning = next;
+    }
+
+    output.insert(output.end(), indices.begin() + numOfTriangles * 3, indices.end());
+    indices.swap(output);
+
+    return boundaries;
+  }
+
+  void optimizeOverdraw(vector<GLuint> &indices, vector<vec3> const &positions, vector<size_t> const &boundaries,
+                        float threshold, size_t cacheSize)
+  {
+    size_t numOfTriangles = indices.size() / 3;
+    if(numOfTriangles == 0)
+      return;
+
+    float limit = analyzeVertexCache(indices, positions.size(), cacheSize).acmr * threshold;
+
+    // cut the order into clusters
+    vector<Cluster> clusters;
+    vector<size_t> stamp(positions.size(), 0);
+    size_t time = cacheSize + 1;
+    size_t clusterMisses = 0;
+    size_t boundary = 0;
+
+    for(size_t triangle = 0; triangle != numOfTriangles; ++triangle)
+    {
+      bool hard = false;
+      while(boundary != boundaries.size() && boundaries[boundary] <= triangle * 3)
+      {
+        hard = true;
+        ++boundary;
+      }
+
+      size_t misses = 0;
+      for(size_t corner = 0; corner != 3; ++corner)
+      {
+        GLuint vertex = indices[triangle * 3 + corner];
+        if(time - stamp[vertex] > cacheSize)
+        {
+          stamp[vertex] = time++;
+          ++misses;
+        }
+      }
+
+      bool soft = misses == 3 && not clusters.empty() &&
+                  float(clusterMisses) / (triangle - clusters.back().first) <= limit;
+
+      if(clusters.empty() || hard || soft)
+      {
+        if(not clusters.empty())
+          clusters.back().last = triangle;
+
+        clusters.push_back(Cluster{triangle, numOfTriangles, 0});
+        clusterMisses = 0;
+      }
+
+      clusterMisses += misses;
+    }
+
+    if(clusters.size() == 1)
+      return;
+
+    // area weighted centers
+    vec3 meshCenter(0.0);
+    float meshArea = 0;
+    for(size_t triangle = 0; triangle != numOfTriangles; ++triangle)
+    {
+      float area = length(triangleNormal(indices, positions, triangle));
+      meshCenter += triangleCenter(indices, positions, triangle) * area;
+      meshArea += area;
+    }
+
+    if(meshArea == 0)
+      return;
+
+    meshCenter /= meshArea;
+
+    for(Cluster &cluster : clusters)
+    {
+      vec3 center(0.0);
+      vec3 normal(0.0);
+      float area = 0;
+
+      for(size_t triangle = cluster.first; triangle != cluster.last; ++triangle)
+      {
+        vec3 triangleArea = triangleNormal(indices, positions, triangle);
+        center += triangleCenter(indices, positions, triangle) * length(triangleArea);
+        normal += triangleArea;
+        area += length(triangleArea);
+      }
+
+      if(area != 0 && length(normal) != 0)
+        cluster.facing = dot(center / area - meshCenter, normalize(normal));
+    }
+
+    stable_sort(clusters.begin(), clusters.end(), [](Cluster const &lhs, Cluster const &rhs)
+                {
+                  return lhs.facing > rhs.facing;
+                });
+
+    vector<GLuint> output;
+    output.reserve(indices.size());
+    for(Cluster const &cluster : clusters)
+      output.insert(output.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.last * 3);
+
+    output.insert(output.end(), indices.begin() + numOfTriangles * 3, indices.end());
+    indices.swap(output);
+  }
+
+  vector<GLuint> optimizeVertexFetch(vector<GLuint> &indices, size_t numOfVertices)
+  {
+    GLuint const unused = numeric_limits<GLuint>::max();
+
+    vector<GLuint> remap(numOfVertices, unused);
+    GLuint next = 0;
+
+    for(GLuint &index : indices)
+    {
+      if(remap[index] == unused)
+        remap[index] = next++;
+
+      index = remap[index];
+    }
+
+    for(GLuint &vertex : remap)
+    {
+      if(vertex == unused)
+        vertex = next++;
+    }
+
+    return remap;
+  }
+}
@@ -0,0 +1,239 @@
+// vertexpacking.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+#include "dim/scene/vertexpacking.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+using namespace glm;
+using namespace std;
+
+namespace dim
+{
+  namespace
+  {
+    using internal::AttributeAccessor;
+
+    GLushort toHalf(float value)
+    {
+      uint32_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+
+      uint32_t sign = (bits >> 16) & 0x8000;
+      uint32_t mantissa = bits & 0x7fffff;
+      int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+
+      // infinity and nan
+      if(((bits >> 23) & 0xff) == 0xff)
+        return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+
+      if(exponent >= 31)
+        return sign | 0x7c00;
+
+      // denormals
+      if(exponent <= 0)
+      {
+        if(exponent < -10)
+          return sign;
+
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+
+        if((mantissa >> (shift - 1)) & 1)
+          ++half;
+
+        return sign | half;
+      }
+
+      // rounding may carry into the exponent, which is still correct
+      uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+      if(mantissa & 0x1000)
+        ++half;
+
+      return half;
+    }
+
+    GLshort toSnorm16(float value)
+    {
+      return static_cast<GLshort>(round(std::max(-1.0f, std::min(1.0f, value)) * 32767));
+    }
+
+    GLushort toUnorm16(float value)
+    {
+      return static_cast<GLushort>(round(std::max(0.0f, std::min(1.0f, value)) * 65535));
+    }
+
+    GLuint toInt2_10_10_10(GLfloat const *values, uint count)
+    {
+      GLuint packed = 0;
+      for(uint comp = 0; comp != std::min(count, 3u); ++comp)
+      {
+        int value = static_cast<int>(round(std::max(-1.0f, std::min(1.0f, values[comp])) * 511));
+        packed |= (static_cast<GLuint>(value) & 0x3ff) << (comp * 10);
+      }
+
+      return packed;
+    }
+
+    internal::VertexAttribute packing(AttributeAccessor const &attribute, Shader::Format format, bool halfPositions)
+    {
+      if(attribute == AttributeAccessor(Shader::vertex))
+      {
+        // only three component positions are quantized to the bounds
+        if(halfPositions || format != Shader::vec3)
+          return internal::VertexAttribute{attribute, format, Shader::float16, false};
+        return internal::VertexAttribute{attribute, format, Shader::int16, true};
+      }
+
+      if(format == Shader::vec3 && (attribute == AttributeAccessor(Shader::normal) ||
+                                    attribute == AttributeAccessor(Shader::tangent) ||
+                                    attribute == AttributeAccessor(Shader::binormal)))
+        return internal::VertexAttribute{attribute, format, Shader::int2_10_10_10, true};
+
+      if(attribute == AttributeAccessor(Shader::texCoord))
+        return internal::VertexAttribute{attribute, format, Shader::float16, false};
+
+      if(attribute == AttributeAccessor(Shader::boneId))
+        return internal::VertexAttribute{attribute, format, Shader::uint16, false};
+
+      if(attribute == AttributeAccessor(Shader::boneWeight))
+        return internal::VertexAttribute{attribute, format, Shader::uint16, true};
+
+      return internal::VertexAttribute{attribute, format, Shader::float32, false};
+    }
+
+    void pack(GLubyte *target, GLfloat const *values, internal::VertexAttribute const &attribute)
+    {
+      uint count = internal::formatSize(attribute.format);
+
+      switch(attribute.component)
+      {
+        case Shader::float16:
+          for(uint comp = 0; comp != count; ++comp)
+          {
+            GLushort value = toHalf(values[comp]);
+            memcpy(target + comp * sizeof(value), &value, sizeof(value));
+          }
+          break;
+        case Shader::int16:
+          for(uint comp = 0; comp != count; ++comp)
+          {
+            GLshort value = toSnorm16(values[comp]);
+            memcpy(target + comp * sizeof(value), &value, sizeof(value));
+          }
+          break;
+        case Shader::uint16:
+          for(uint comp = 0; comp != count; ++comp)
+          {
+            GLushort value = attribute.normalized ? toUnorm16(values[comp]) : static_cast<GLushort>(values[comp]);
+            memcpy(target + comp * sizeof(value), &value, sizeof(value));
+          }
+          break;
+        case Shader::int2_10_10_10:
+        {
+          GLuint value = toInt2_10_10_10(values, count);
+          memcpy(target, &value, sizeof(value));
+          break;
+        }
+        default:
+          memcpy(target, values, count * sizeof(GLfloat));
+          break;
+      }
+    }
+  }
+
+  Mesh packMesh(vector<GLfloat> const &vertices, size_t numOfVertices,
+                vector<pair<AttributeAccessor, Shader::Format>> const &formats, bool halfPositions)
+  {
+    vector<internal::VertexAttribute> layout;
+    size_t stride = 0;
+    size_t packedStride = 0;
+    int positionOffset = -1;
+
+    for(auto const &format : formats)
+    {
+      if(format.first == AttributeAccessor(Shader::vertex) && format.second == Shader::vec3)
+        positionOffset = stride;
+
+      layout.push_back(packing(format.first, format.second, halfPositions));
+      stride += internal::formatSize(format.second);
+      packedStride += internal::attributeSize(format.second, layout.back().component);
+    }
+
+    // packed positions are relative to the bounds, scaled equally on every
+    // axis. Half floats keep more precision around 0 as well, so far from
+    // the origin they lose less than the raw positions would
+    mat4 positionTransform(1.0);
+    vector<GLfloat> source(vertices);
+
+    if(positionOffset != -1 && numOfVertices != 0)
+    {
+      vec3 minimum(numeric_limits<float>::max());
+      vec3 maximum(-numeric_limits<float>::max());
+
+      for(size_t vertex = 0; vertex != numOfVertices; ++vertex)
+      {
+        GLfloat const *position = &vertices[vertex * stride + positionOffset];
+        minimum = glm::min(minimum, vec3(position[0], position[1], position[2]));
+        maximum = glm::max(maximum, vec3(position[0], position[1], position[2]));
+      }
+
+      vec3 center = (minimum + maximum) * 0.5f;
+      vec3 extent = (maximum - minimum) * 0.5f;
+      float scale = std::max(extent.x, std::max(extent.y, extent.z));
+      if(scale == 0)
+        scale = 1;
+
+      for(size_t vertex = 0; vertex != numOfVertices; ++vertex)
+      {
+        for(uint comp = 0; comp != 3; ++comp)
+        {
+          GLfloat &value = source[vertex * stride + positionOffset + comp];
+          value = (value - center[comp]) / scale;
+        }
+      }
+
+      positionTransform = mat4(scale);
+      positionTransform[3] = vec4(center, 1.0);
+    }
+
+    vector<GLubyte> packed(numOfVertices * packedStride, 0);
+
+    for(size_t vertex = 0; vertex != numOfVertices; ++vertex)
+    {
+      size_t offset = 0;
+      size_t packedOffset = 0;
+
+      for(auto const &attribute : layout)
+      {
+        pack(&packed[vertex * packedStride + packedOffset], &source[vertex * stride + offset], attribute);
+
+        offset += internal::formatSize(attribute.format);
+        packedOffset += internal::attributeSize(attribute.format, attribute.component);
+      }
+    }
+
+    return Mesh(packed.data(), numOfVertices, layout, positionTransform);
+  }
+}
@@ -0,0 +1,168 @@
+// jobsystem.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include "dim/core/jobsystem.hpp"
+
+using namespace dim;
+using namespace std;
+
+namespace
+{
+  size_t s_failures = 0;
+
+  void check(bool condition, char const *what)
+  {
+    if(condition)
+      return;
+
+    cerr << "failed: " << what << '\n';
+    ++s_failures;
+  }
+
+  // the dependent job stays queued while the first job holds its counter
+  void dependency()
+  {
+    JobSystem &jobSystem = JobSystem::instance();
+
+    atomic<bool> release(false);
+    atomic<bool> firstDone(false);
+    atomic<bool> ranEarly(false);
+    atomic<bool> sawFirst(false);
+
+    JobSystem::Counter first;
+    JobSystem::Counter second;
+
+    jobSystem.run([&]()
+                  {
+                    while(not release)
+                      this_thread::yield();
+                    firstDone = true;
+                  }, &first);
+
+    jobSystem.run([&]()
+                  {
+                    ranEarly = not release;
+                    sawFirst = firstDone.load();
+                  }, &second, first);
+
+    this_thread::sleep_for(chrono::milliseconds(20));
+    check(not second.done(), "the dependent job waits for its dependency");
+
+    release = true;
+    jobSystem.wait(second);
+
+    check(first.done(), "the dependency is done");
+    check(not ranEarly, "the dependent job didn't start before the dependency finished");
+    check(sawFirst, "the dependent job sees what the dependency did");
+  }
+
+  void parallelFor()
+  {
+    size_t const count = 100000;
+    vector<atomic<int>> hits(count);
+    for(atomic<int> &hit : hits)
+      hit = 0;
+
+    JobSystem::instance().parallelFor(count, [&](size_t idx)
+                                      {
+                                        ++hits[idx];
+                                      }, 16);
+
+    bool once = true;
+    for(atomic<int> const &hit : hits)
+      once = once && hit == 1;
+
+    check(once, "parallelFor calls every index exactly once");
+  }
+
+  // more jobs wait than there are workers, so the waits have to execute jobs
+  void nestedWait()
+  {
+    JobSystem &jobSystem = JobSystem::instance();
+
+    size_t const numOfOuter = 4 * (jobSystem.numOfThreads() + 1);
+    size_t const numOfInner = 16;
+
+    atomic<size_t> sum(0);
+    atomic<bool> early(false);
+    JobSystem::Counter outer;
+
+    for(size_t idx = 0; idx != numOfOuter; ++idx)
+    {
+      jobSystem.run([&]()
+                    {
+                      JobSystem::Counter inner;
+                      for(size_t job = 0; job != numOfInner; ++job)
+                        jobSystem.run([&]() { ++sum; }, &inner);
+
+                      jobSystem.wait(inner);
+                      if(not inner.done())
+                        early = true;
+                    }, &outer);
+    }
+
+    jobSystem.wait(outer);
+    check(not early, "a wait inside a job returns once its jobs are done");
+    check(sum == numOfOuter * numOfInner, "every nested job ran");
+  }
+
+  void withoutThreads()
+  {
+    JobSystem &jobSystem = JobSystem::instance();
+    jobSystem.setNumOfThreads(0);
+
+    check(jobSystem.numOfThreads() == 0, "no worker threads are left");
+
+    thread::id ranOn;
+    JobSystem::Counter counter;
+    jobSystem.run([&]() { ranOn = this_thread::get_id(); }, &counter);
+
+    check(counter.done(), "without threads a job is done when run returns");
+    check(ranOn == this_thread::get_id(), "without threads a job runs on the calling thread");
+
+    // the order of execution is the order of the calls
+    vector<size_t> order;
+    jobSystem.parallelFor(1000, [&](size_t idx) { order.push_back(idx); }, 1);
+
+    bool inOrder = order.size() == 1000;
+    for(size_t idx = 0; inOrder && idx != order.size(); ++idx)
+      inOrder = order[idx] == idx;
+
+    check(inOrder, "without threads parallelFor runs in order");
+  }
+}
+
+int main()
+{
+  JobSystem::instance().setNumOfThreads(4);
+
+  dependency();
+  parallelFor();
+  nestedWait();
+  withoutThreads();
+
+  return s_failures == 0 ? 0 : 1;
+}
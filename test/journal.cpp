@@ -0,0 +1,184 @@
+// journal.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iterator>
+
+#include "dim/scene/journal.hpp"
+
+using namespace dim::internal;
+using namespace std;
+
+namespace
+{
+  size_t s_failures = 0;
+
+  string const s_base = "test_journal.base";
+
+  typedef map<uint64_t, string> Nodes;
+
+  void check(bool condition, char const *what)
+  {
+    if(condition)
+      return;
+
+    cerr << "failed: " << what << '\n';
+    ++s_failures;
+  }
+
+  void removeFiles()
+  {
+    remove(s_base.c_str());
+    remove(Journal::journalName(s_base).c_str());
+    remove((s_base + ".tmp").c_str());
+  }
+
+  string contents(string const &filename)
+  {
+    ifstream file(filename, ios::binary);
+    return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+  }
+
+  void overwrite(string const &filename, string const &data)
+  {
+    ofstream file(filename, ios::binary | ios::trunc);
+    file.write(data.data(), data.size());
+  }
+
+  // appends the records and waits until they are on disk, a large limit keeps them in the journal
+  void append(vector<Journal::Record> records, size_t maxSize = 1 << 20)
+  {
+    Journal journal(s_base, maxSize);
+    journal.append(move(records));
+    journal.flush();
+  }
+
+  void plain()
+  {
+    removeFiles();
+    check(Journal::plain(s_base), "a missing file is plain");
+
+    // what SceneGraph::save writes, nodes one after the other
+    overwrite(s_base, "node one\nnode two\n");
+    check(Journal::plain(s_base), "a file written by save is plain");
+
+    check(Journal::writeBase(s_base, Nodes{{1, "one"}}), "writing a base");
+    check(not Journal::plain(s_base), "a base is not plain");
+    check(Journal::replay(s_base) == (Nodes{{1, "one"}}), "a base replays its nodes");
+  }
+
+  // a journal cut off in its first record leaves the base as it was
+  void truncated()
+  {
+    removeFiles();
+    Journal::writeBase(s_base, Nodes{{1, "one"}, {2, "two"}});
+    append({Journal::Record{Journal::Record::put, 3, "three"}});
+
+    string journal = contents(Journal::journalName(s_base));
+    overwrite(Journal::journalName(s_base), journal.substr(0, journal.size() / 2));
+
+    check(Journal::replay(s_base) == (Nodes{{1, "one"}, {2, "two"}}), "a truncated journal replays the base");
+  }
+
+  // cuts the journal at every byte of its last record, which is dropped on
+  // replay and repaired when the journal is opened again
+  void tornLastRecord()
+  {
+    removeFiles();
+    Journal::writeBase(s_base, Nodes{{1, "one"}});
+    append({Journal::Record{Journal::Record::put, 2, "two"}});
+    size_t const intact = contents(Journal::journalName(s_base)).size();
+
+    append({Journal::Record{Journal::Record::put, 12, "twelve\nlines"}});
+    string const journal = contents(Journal::journalName(s_base));
+    string const base = contents(s_base);
+
+    Nodes const before{{1, "one"}, {2, "two"}};
+    Nodes const repaired{{1, "one"}, {2, "two"}, {3, "three"}};
+
+    bool dropped = true;
+    bool reopened = true;
+    for(size_t size = intact; size != journal.size(); ++size)
+    {
+      overwrite(s_base, base);
+      overwrite(Journal::journalName(s_base), journal.substr(0, size));
+
+      dropped = dropped && Journal::replay(s_base) == before;
+
+      // records appended after the repair are read back
+      append({Journal::Record{Journal::Record::put, 3, "three"}});
+      reopened = reopened && Journal::replay(s_base) == repaired;
+    }
+
+    check(dropped, "a torn last record is dropped on replay");
+    check(reopened, "opening a torn journal repairs it");
+
+    overwrite(s_base, base);
+    overwrite(Journal::journalName(s_base), journal);
+    check(Journal::replay(s_base) == (Nodes{{1, "one"}, {2, "two"}, {12, "twelve\nlines"}}), "the whole journal replays every record");
+  }
+
+  // compacting merges the journal into the base without changing the nodes,
+  // and replaying the old journal on the new base changes nothing either
+  void compaction()
+  {
+    removeFiles();
+    Journal::writeBase(s_base, Nodes{{1, "one"}, {2, "two"}});
+    append({Journal::Record{Journal::Record::put, 3, "three"},
+            Journal::Record{Journal::Record::remove, 1, ""},
+            Journal::Record{Journal::Record::put, 2, "second"}});
+
+    Nodes const expected{{2, "second"}, {3, "three"}};
+    check(Journal::replay(s_base) == expected, "the journal replays on the base");
+
+    string const journal = contents(Journal::journalName(s_base));
+
+    // the limit of 0 compacts after the next write
+    append({Journal::Record{Journal::Record::put, 3, "three"}}, 0);
+    check(contents(Journal::journalName(s_base)).empty(), "compacting empties the journal");
+    check(not Journal::plain(s_base), "compacting writes a base");
+    check(Journal::replay(s_base) == expected, "compacting keeps the nodes");
+
+    // a crash between replacing the base and emptying the journal
+    overwrite(Journal::journalName(s_base), journal);
+    check(Journal::replay(s_base) == expected, "replaying the journal again on the compacted base changes nothing");
+
+    append({Journal::Record{Journal::Record::clear, 0, ""}, Journal::Record{Journal::Record::put, 4, "four"}}, 0);
+    check(Journal::replay(s_base) == (Nodes{{4, "four"}}), "a clear removes the nodes of the base");
+  }
+}
+
+int main()
+{
+  plain();
+  truncated();
+  tornLastRecord();
+  compaction();
+
+  removeFiles();
+
+  return s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+// slotmap.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#include <iostream>
+#include <limits>
+
+#include "dim/util/slotmap.hpp"
+
+using namespace dim;
+using namespace std;
+
+namespace dim
+{
+  struct SlotMapTest
+  {
+    // the free slot of index starts at generation, as if it was reused that often
+    template <typename Type>
+    static void seed(SlotMap<Type> &map, uint32_t index, uint32_t generation)
+    {
+      map.d_slots[index].generation = generation;
+    }
+  };
+}
+
+namespace
+{
+  size_t s_failures = 0;
+
+  void check(bool condition, char const *what)
+  {
+    if(condition)
+      return;
+
+    cerr << "failed: " << what << '\n';
+    ++s_failures;
+  }
+
+  void stale()
+  {
+    SlotMap<int> map;
+    Handle first = map.insert(1);
+    Handle second = map.insert(2);
+
+    check(map.erase(first), "erasing a live handle");
+    check(not map.erase(first), "erasing it twice");
+    check(map.get(first) == 0, "a stale handle finds nothing");
+    check(*map.get(second) == 2, "the moved value keeps its handle");
+
+    Handle reused = map.insert(3);
+    check(reused.index == first.index, "the free slot is reused");
+    check(reused != first, "a reused slot gets a new generation");
+    check(not map.contains(first), "the old handle stays stale");
+    check(not map.contains(Handle()), "a default handle refers to nothing");
+  }
+
+  // runs one slot through its last generations, seeded close to the largest
+  void wrap()
+  {
+    SlotMap<int> map;
+    Handle handle = map.insert(0);
+    map.erase(handle);
+    SlotMapTest::seed(map, handle.index, numeric_limits<uint32_t>::max() - 7);
+
+    handle = map.insert(0);
+    while(handle.generation != numeric_limits<uint32_t>::max())
+    {
+      check(map.contains(handle), "every generation up to the largest is valid");
+      map.erase(handle);
+      handle = map.insert(0);
+    }
+
+    Handle last = handle;
+    check(map.contains(last), "the largest generation is valid");
+
+    map.erase(last);
+    check(not map.contains(last), "the largest generation goes stale");
+    check(not map.contains(Handle(last.index, 0)), "generation 0 is never valid");
+
+    handle = map.insert(0);
+    check(handle.generation == 1, "the generation wraps around to 1");
+    check(map.contains(handle), "the wrapped handle is valid");
+    check(not map.contains(last), "the last handle stays stale after the wrap");
+    check(map.size() == 1, "the map holds a single value");
+  }
+}
+
+int main()
+{
+  stale();
+  wrap();
+
+  return s_failures == 0 ? 0 : 1;
+}
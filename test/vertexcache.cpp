@@ -0,0 +1,168 @@
+// vertexcache.cpp
+//
+// Copyright 2013 Klaas Winter <klaaswinter@gmail.com>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA 02110-1301, USA.
+
+
+#include <random>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include <algorithm>
+
+#include "dim/scene/vertexcache.hpp"
+
+using namespace dim;
+using namespace std;
+
+namespace
+{
+  size_t s_failures = 0;
+
+  size_t const s_side = 32; ///< In quads
+
+  typedef vector<GLuint> Triangle;
+
+  void check(bool condition, char const *what)
+  {
+    if(condition)
+      return;
+
+    cerr << "failed: " << what << '\n';
+    ++s_failures;
+  }
+
+  size_t numOfVertices()
+  {
+    return (s_side + 1) * (s_side + 1);
+  }
+
+  vector<glm::vec3> gridPositions()
+  {
+    vector<glm::vec3> positions;
+    for(size_t y = 0; y <= s_side; ++y)
+    {
+      for(size_t x = 0; x <= s_side; ++x)
+        positions.push_back(glm::vec3(x, y, 0));
+    }
+    return positions;
+  }
+
+  // the triangles of a regular grid in a random order
+  vector<GLuint> shuffledGrid()
+  {
+    vector<Triangle> triangles;
+    for(GLuint y = 0; y != s_side; ++y)
+    {
+      for(GLuint x = 0; x != s_side; ++x)
+      {
+        GLuint corner = y * (s_side + 1) + x;
+        GLuint above = corner + s_side + 1;
+        triangles.push_back(Triangle{corner, corner + 1, above});
+        triangles.push_back(Triangle{corner + 1, above + 1, above});
+      }
+    }
+
+    shuffle(triangles.begin(), triangles.end(), mt19937(42));
+
+    vector<GLuint> indices;
+    for(Triangle const &triangle : triangles)
+      indices.insert(indices.end(), triangle.begin(), triangle.end());
+    return indices;
+  }
+
+  // every triangle starting at its smallest index, so equal triangles compare equal whatever corner they start at
+  vector<Triangle> sortedTriangles(vector<GLuint> const &indices)
+  {
+    vector<Triangle> triangles;
+    for(size_t idx = 0; idx + 2 < indices.size(); idx += 3)
+    {
+      Triangle triangle(indices.begin() + idx, indices.begin() + idx + 3);
+      rotate(triangle.begin(), min_element(triangle.begin(), triangle.end()), triangle.end());
+      triangles.push_back(triangle);
+    }
+    sort(triangles.begin(), triangles.end());
+    return triangles;
+  }
+
+  void vertexCache()
+  {
+    vector<GLuint> indices = shuffledGrid();
+    vector<Triangle> before = sortedTriangles(indices);
+    float acmr = analyzeVertexCache(indices, numOfVertices()).acmr;
+
+    vector<size_t> boundaries = optimizeVertexCache(indices, numOfVertices());
+
+    check(analyzeVertexCache(indices, numOfVertices()).acmr < acmr, "optimizing for the cache lowers the acmr");
+    check(sortedTriangles(indices) == before, "optimizing for the cache keeps the triangles");
+    check(is_sorted(boundaries.begin(), boundaries.end()), "the boundaries are in order");
+    check(boundaries.empty() or boundaries.back() <= indices.size(), "the boundaries lie within the indices");
+  }
+
+  void vertexFetch()
+  {
+    vector<GLuint> original = shuffledGrid();
+    vector<GLuint> indices = original;
+
+    vector<GLuint> remap = optimizeVertexFetch(indices, numOfVertices());
+
+    vector<GLuint> sorted = remap;
+    sort(sorted.begin(), sorted.end());
+    bool permutation = sorted.size() == numOfVertices();
+    for(size_t idx = 0; permutation and idx != sorted.size(); ++idx)
+      permutation = sorted[idx] == idx;
+    check(permutation, "the new numbers are a permutation of the vertices");
+
+    bool remapped = indices.size() == original.size();
+    for(size_t idx = 0; remapped and idx != indices.size(); ++idx)
+      remapped = indices[idx] == remap[original[idx]];
+    check(remapped, "the indices refer to the renumbered vertices");
+
+    bool ordered = true;
+    GLuint next = 0;
+    for(size_t idx = 0; ordered and idx != indices.size(); ++idx)
+    {
+      ordered = indices[idx] <= next;
+      if(indices[idx] == next)
+        ++next;
+    }
+    check(ordered, "the vertices are numbered in the order they are used");
+  }
+
+  void overdraw()
+  {
+    vector<GLuint> indices = shuffledGrid();
+    vector<size_t> boundaries = optimizeVertexCache(indices, numOfVertices());
+    vector<Triangle> before = sortedTriangles(indices);
+    float acmr = analyzeVertexCache(indices, numOfVertices()).acmr;
+
+    optimizeOverdraw(indices, gridPositions(), boundaries);
+
+    check(sortedTriangles(indices) == before, "optimizing for overdraw keeps the triangles and their winding");
+    check(analyzeVertexCache(indices, numOfVertices()).acmr <= acmr * 1.05f + 0.05f,
+          "optimizing for overdraw mostly keeps the cache order");
+  }
+}
+
+int main()
+{
+  vertexCache();
+  vertexFetch();
+  overdraw();
+
+  return s_failures == 0 ? 0 : 1;
+}